@@ -2,16 +2,40 @@
 
 #include <phobos/image.hpp>
 #include <optional>
+#include <string_view>
 
 namespace ph {
 
 struct Attachment {
 	ph::ImageView view {};
     std::optional<ph::RawImage> image = std::nullopt;
+    // Transient attachments may share memory with other transient attachments, see Context::create_transient_attachment().
+    bool transient = false;
 
     explicit inline operator bool() const {
         return view && true; // cast view to bool
     }
 };
 
-}
\ No newline at end of file
+// Lifetime of a transient attachment in a render graph, used to place transient attachments in shared memory.
+struct TransientAttachmentUsage {
+    std::string_view name;
+    // Indices of the first and last pass that use the attachment.
+    uint32_t first_pass = 0;
+    uint32_t last_pass = 0;
+    // Set when the attachment is placed in memory: index of the usage that used the same memory before this one.
+    // The first attachment placed in a block aliases the last one, since that one was used by the previous frame.
+    std::optional<uint32_t> aliases = std::nullopt;
+};
+
+struct TransientMemoryStats {
+    uint32_t attachments = 0;
+    // Amount of memory blocks the transient attachments were placed in
+    uint32_t memory_blocks = 0;
+    // Memory the transient attachments would use if they all had their own allocation
+    VkDeviceSize required_bytes = 0;
+    VkDeviceSize allocated_bytes = 0;
+    VkDeviceSize saved_bytes = 0;
+};
+
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <phobos/image.hpp>
+#include <phobos/buffer.hpp>
+
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+
+namespace ph {
+
+class Context;
+struct AppSettings;
+
+// A single persistent descriptor set holding large arrays of sampled images, storage images and storage buffers.
+// Resources are added once and stay at the same array index until they are removed, so shaders can index the arrays
+// directly and draws do not need a descriptor set per material.
+// The set uses update-after-bind, so resources can be added while the set is bound in command buffers that are still executing.
+class BindlessHeap {
+public:
+	// The heap is bound to AppSettings::bindless_set_index in every pipeline layout. Declare the arrays in shaders as, for example,
+	// layout(set = 1, binding = 0) uniform sampler2D textures[];
+	static constexpr uint32_t sampled_image_binding = 0;
+	static constexpr uint32_t storage_image_binding = 1;
+	static constexpr uint32_t storage_buffer_binding = 2;
+	// Returned when an array in the heap is full
+	static constexpr uint32_t invalid_index = static_cast<uint32_t>(-1);
+
+	BindlessHeap(Context& ctx, AppSettings const& settings);
+	~BindlessHeap();
+
+	BindlessHeap(BindlessHeap const&) = delete;
+	BindlessHeap& operator=(BindlessHeap const&) = delete;
+
+	// Adding the same resource multiple times returns the same index. Each add must be matched with a remove.
+	uint32_t add_sampled_image(ImageView view, VkSampler sampler, VkImageLayout layout);
+	uint32_t add_storage_image(ImageView view, VkImageLayout layout);
+	uint32_t add_storage_buffer(BufferSlice slice);
+
+	// The slot is only reused once all frames that could still access it have completed.
+	void remove_sampled_image(uint32_t index);
+	void remove_storage_image(uint32_t index);
+	void remove_storage_buffer(uint32_t index);
+
+	VkDescriptorSetLayout get_set_layout() const;
+	VkDescriptorSet get_set() const;
+	uint32_t get_set_index() const;
+
+	// Returns removed slots to the free list once the frames that could use them have retired.
+	void next_frame();
+
+private:
+	// Everything that identifies the descriptor in a slot. Fields that do not apply to the array are left at their default.
+	struct ResourceKey {
+		uint64_t view_id = static_cast<uint64_t>(-1);
+		VkSampler sampler = nullptr;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkBuffer buffer = nullptr;
+		VkDeviceSize offset = 0;
+		VkDeviceSize range = 0;
+
+		bool operator==(ResourceKey const& rhs) const = default;
+	};
+
+	struct ResourceKeyHash {
+		size_t operator()(ResourceKey const& key) const;
+	};
+
+	struct HeapArray {
+		uint32_t binding = 0;
+		VkDescriptorType type{};
+		uint32_t capacity = 0;
+		// Slots at or above this index were never handed out
+		uint32_t next_unused = 0;
+		std::vector<uint32_t> free_slots;
+		// Removed slots, with the amount of frames left before they can be reused.
+		std::vector<std::pair<uint32_t, uint32_t>> retiring_slots;
+		// Maps a resource to its slot, so the same resource always gets the same index.
+		std::unordered_map<ResourceKey, uint32_t, ResourceKeyHash> slot_by_resource;
+		// Resource and reference count of every slot
+		std::vector<ResourceKey> slot_resource;
+		std::vector<uint32_t> slot_refcount;
+	};
+
+	Context* ctx = nullptr;
+	VkDescriptorSetLayout set_layout = nullptr;
+	VkDescriptorPool pool = nullptr;
+	VkDescriptorSet set = nullptr;
+
+	HeapArray sampled_images;
+	HeapArray storage_images;
+	HeapArray storage_buffers;
+	// Amount of next_frame() calls before a removed slot can be reused
+	uint32_t retire_delay = 0;
+	uint32_t set_index = 0;
+
+	// Descriptor writes to the set must be externally synchronized.
+	std::mutex mutex;
+
+	// Returns the slot of the resource and whether it was newly allocated (and thus still needs to be written).
+	std::pair<uint32_t, bool> acquire_slot(HeapArray& array, ResourceKey const& resource);
+	void release_slot(HeapArray& array, uint32_t index);
+	void retire_slots(HeapArray& array);
+	void write(HeapArray const& array, uint32_t index, VkDescriptorImageInfo const* image, VkDescriptorBufferInfo const* buffer);
+};
+
+}
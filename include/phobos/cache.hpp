@@ -1,27 +1,94 @@
 #pragma once
 
 #include <mutex>
+#include <memory>
 #include <functional>
-#include <unordered_map>
+#include <deque>
+#include <vector>
 #include <algorithm>
+#include <unordered_map>
+#include <utility>
 
 #include <phobos/hash.hpp>
+#include <phobos/cache_key.hpp>
 
 namespace ph {
 
+// Decides which unused entries are evicted from a Cache.
+struct CacheRetentionPolicy {
+    enum class Mode {
+        // Evict entries that were not used for more than max_frames frames.
+        FrameAge,
+        // Evict the least recently used entries while the cache holds more than max_entries entries.
+        LRU,
+        // Keep every entry until the cache is destroyed.
+        Never
+    };
+
+    Mode mode = Mode::FrameAge;
+    uint32_t max_frames = 0;
+    size_t max_entries = 0;
+};
+
+struct CacheStats {
+    // Amount of entries currently in the cache
+    size_t entries = 0;
+    // Amount of entries evicted over the lifetime of the cache
+    uint64_t evictions = 0;
+    // Amount of inserted keys that were evicted before. A high value means the retention policy is too strict for this cache.
+    // Only the most recently evicted keys are remembered (see Cache::max_evicted_hashes), so keys that come back much later are not counted.
+    uint64_t recreations = 0;
+};
+
+// Open addressing hash table with usage tracking. Unused entries can be removed with evict_unused(), according to the retention policy of the cache.
+// Lookups compare the full key (see CacheKeyTraits), the hash is only used to find the slot.
+// Pointers returned by get() stay valid until the entry is erased, even if other entries are inserted.
+// Entries are kept in a list ordered by the frame they were last used in, so eviction only has to look at the entries that expire.
 template<typename Key, typename Value>
 class Cache {
 private:
+    using Traits = CacheKeyTraits<Key>;
+    using StoredKey = typename Traits::stored_type;
+
+    static constexpr uint32_t empty_slot = static_cast<uint32_t>(-1);
+
+    // A slot in the open addressing table. The hash is stored inline so probing only has to compare keys if the hashes match.
+    struct Slot {
+        size_t hash = 0;
+        // Index into entries, or empty_slot
+        uint32_t entry = empty_slot;
+    };
+
     struct Entry {
+        StoredKey key{};
         Value data{};
-        Key key{};
-        mutable size_t frames_since_last_usage = 0;
-        mutable bool used_this_frame = false;
+        size_t hash = 0;
+    };
+
+    // Kept apart from the entries, so the usage list can be updated without touching keys and values.
+    struct Usage {
+        // Value of current_frame when the entry was last inserted or looked up
+        uint64_t last_used = 0;
+        // Neighbours in the usage list, which goes from least to most recently used.
+        uint32_t prev = empty_slot;
+        uint32_t next = empty_slot;
+        // Entries with pins, or that were inserted with insert_unused() and not looked up yet, are never evicted.
+        uint32_t pins = 0;
+        bool unused = false;
+        bool alive = false;
     };
 public:
+    // Amount of evicted keys remembered to detect recreations. Older evictions are forgotten so the history does not grow forever.
+    static constexpr size_t max_evicted_hashes = 1024;
+
     Cache(uint32_t max_frames = 0) {
         mutex = std::make_unique<std::mutex>();
-        this->max_frames = max_frames;
+        policy.max_frames = max_frames;
+    }
+
+    // Entries used in the last min_frames frames are never evicted, whatever the policy says.
+    Cache(CacheRetentionPolicy policy, uint32_t min_frames) : policy(policy), min_frames(min_frames) {
+        mutex = std::make_unique<std::mutex>();
     }
 
     Cache(Cache const&) = delete;
@@ -32,96 +99,148 @@ public:
     template<typename F>
     void foreach(F&& func) const {
         std::lock_guard lock(*mutex);
-        for (auto const& [_, val] : cache) {
-            func(val.data);
+        for (uint32_t i = 0; i < usage.size(); ++i) {
+            if (usage[i].alive) {
+                func(entries[i].data);
+            }
         }
     }
 
-
+    // Removes the entries the retention policy no longer allows, and calls func with each removed value.
+    // Only the removed entries are visited. func is called after the cache is unlocked, so it may use the cache.
     template<typename F>
-    void foreach_unused(F&& func) {
-        std::lock_guard lock(*mutex);
-        for (auto& [_, val] : cache) {
-            if (val.frames_since_last_usage > max_frames) {
-                func(val.data);
+    void evict_unused(F&& func) {
+        evict_unused(std::forward<F>(func), [](Value const&) { return false; });
+    }
+
+    // Same as evict_unused(func), but entries for which keep(value) returns true are not evicted. keep is called with the cache locked.
+    // Kept entries count as used in this frame, so they are only visited again once they expire.
+    template<typename F, typename Keep>
+    void evict_unused(F&& func, Keep&& keep) {
+        std::vector<Value> evicted;
+        {
+            std::lock_guard lock(*mutex);
+            while (lru_head != empty_slot && should_evict(current_frame - usage[lru_head].last_used)) {
+                uint32_t const index = lru_head;
+                if (usage[index].pins > 0 || usage[index].unused || keep(std::as_const(entries[index].data))) {
+                    touch(index);
+                    continue;
+                }
+                evicted.push_back(std::move(entries[index].data));
+                remember_evicted(entries[index].hash);
+                erase_entry(index);
+                stats.evictions += 1;
             }
         }
+        for (Value& value : evicted) {
+            func(value);
+        }
     }
 
-    // Remove unused entries from the cache
-    void erase_unused() {
+    // Remove all entries from the cache
+    void clear() {
         std::lock_guard lock(*mutex);
-        auto find_unused_func = [this](std::pair<size_t const, Entry> const& item) -> bool {
-            return item.second.frames_since_last_usage > max_frames;
-        };
-        for (auto it = cache.begin(); it != cache.end();) {
-            if (find_unused_func(*it)) {
-                it = cache.erase(it);
-            }
-            else {
-                ++it;
-            }
-        }
+        slots.clear();
+        entries.clear();
+        usage.clear();
+        free_entries.clear();
+        count = 0;
+        evicted_hashes.clear();
+        evicted_order.clear();
+        lru_head = empty_slot;
+        lru_tail = empty_slot;
+    }
+
+    // Returns the value stored for the key, and whether val was inserted. If the key is already in the cache, val is not stored
+    // and the existing value is returned instead, so the caller can destroy val.
+    std::pair<Value*, bool> insert(Key const& key, Value val) {
+        size_t hash = std::hash<Key>()(key);
+        std::lock_guard lock(*mutex);
+        auto const [entry, inserted] = insert_entry(hash, key, std::move(val));
+        return { &entries[entry].data, inserted };
     }
 
-    void insert(Key const& key, Value val) {
+    std::pair<Value*, bool> insert(Key&& key, Value&& val) {
         size_t hash = std::hash<Key>()(key);
         std::lock_guard lock(*mutex);
-        cache[hash] = Entry{ .data = std::move(val), .key = key, .frames_since_last_usage = 0, .used_this_frame = false };
+        auto const [entry, inserted] = insert_entry(hash, key, std::move(val));
+        return { &entries[entry].data, inserted };
     }
 
-    void insert(Key&& key, Value&& val) {
+    // Inserts an entry that is not evicted before it is looked up with get(), for objects that are created ahead of their first use.
+    // Same return value as insert(). An entry that is already in the cache is left as it is.
+    std::pair<Value*, bool> insert_unused(Key const& key, Value val) {
         size_t hash = std::hash<Key>()(key);
         std::lock_guard lock(*mutex);
-        cache[hash] = Entry{ .data = std::move(val), .key = std::move(key), .frames_since_last_usage = 0, .used_this_frame = false };
+        auto const [entry, inserted] = insert_entry(hash, key, std::move(val));
+        if (inserted) usage[entry].unused = true;
+        return { &entries[entry].data, inserted };
     }
 
     Value* get(Key const& key) {
+        bool first_use = false;
+        return get(key, first_use);
+    }
+
+    // first_use is set to true if this is the first lookup of an entry inserted with insert_unused().
+    Value* get(Key const& key, bool& first_use) {
         size_t hash = std::hash<Key>()(key);
         std::lock_guard lock(*mutex);
-        auto it = cache.find(hash);
-        if (it != cache.end()) {
-            it->second.used_this_frame = true;
-            return &it->second.data;
-        }
-        else return nullptr;
+        uint32_t entry = find_entry(hash, key);
+        if (entry == empty_slot) return nullptr;
+        // Mark the entry as used
+        first_use = usage[entry].unused;
+        usage[entry].unused = false;
+        touch(entry);
+        return &entries[entry].data;
     }
 
     Value const* get(Key const& key) const {
         size_t hash = std::hash<Key>()(key);
         std::lock_guard lock(*mutex);
-        auto it = cache.find(hash);
-        if (it != cache.end()) {
-            // Mark the entry as used
-            it->second.used_this_frame = true;
-            return &it->second.data;
-        }
-        else return nullptr;
+        uint32_t entry = find_entry(hash, key);
+        if (entry == empty_slot) return nullptr;
+        // Mark the entry as used
+        usage[entry].unused = false;
+        touch(entry);
+        return &entries[entry].data;
     }
 
-    Key* get_key(size_t hash) {
+    // Does not mark the entry as used.
+    bool contains(Key const& key) const {
+        size_t hash = std::hash<Key>()(key);
+        std::lock_guard lock(*mutex);
+        return find_entry(hash, key) != empty_slot;
+    }
+
+    // Pinned entries are never evicted. Every pin() must be matched by an unpin(). Does nothing if the key is not in the cache.
+    void pin(Key const& key) {
+        size_t hash = std::hash<Key>()(key);
         std::lock_guard lock(*mutex);
-        return &cache.at(hash).key;
+        uint32_t entry = find_entry(hash, key);
+        if (entry != empty_slot) usage[entry].pins += 1;
     }
 
+    void unpin(Key const& key) {
+        size_t hash = std::hash<Key>()(key);
+        std::lock_guard lock(*mutex);
+        uint32_t entry = find_entry(hash, key);
+        if (entry != empty_slot && usage[entry].pins > 0) usage[entry].pins -= 1;
+    }
+
+    // Returns 0 if the key is not in the cache.
     size_t get_frames_since_last_usage(Key const& key) {
         size_t hash = std::hash<Key>()(key);
         std::lock_guard lock(*mutex);
-        return cache[hash].frames_since_last_usage;
+        uint32_t entry = find_entry(hash, key);
+        if (entry == empty_slot) return 0;
+        return static_cast<size_t>(current_frame - usage[entry].last_used);
     }
 
-    // Update frames since last usage for every entry
+    // Starts a new frame. This does not visit any entries.
     void next_frame() {
         std::lock_guard lock(*mutex);
-        for (auto& [key, entry] : cache) {
-            if (!entry.used_this_frame) {
-                entry.frames_since_last_usage += 1;
-            }
-            else {
-                entry.frames_since_last_usage = 0;
-            }
-            entry.used_this_frame = false;
-        }
+        current_frame += 1;
     }
 
     void lock() {
@@ -133,14 +252,186 @@ public:
     }
 
     void set_max_frames(uint32_t frames) {
-        max_frames = frames;
+        policy.max_frames = frames;
+    }
+
+    CacheStats get_stats() const {
+        std::lock_guard lock(*mutex);
+        CacheStats result = stats;
+        result.entries = count;
+        return result;
     }
 
 private:
-    std::unordered_map<size_t, Entry> cache;
+    // Power of two size, at most 75% full.
+    std::vector<Slot> slots;
+    // A deque so pointers to values stay valid when inserting. Erased entries are reused through free_entries.
+    std::deque<Entry> entries;
+    mutable std::vector<Usage> usage;
+    std::vector<uint32_t> free_entries;
+    // Amount of live entries
+    size_t count = 0;
+    // Least and most recently used entries
+    mutable uint32_t lru_head = empty_slot;
+    mutable uint32_t lru_tail = empty_slot;
+    uint64_t current_frame = 0;
     std::unique_ptr<std::mutex> mutex;
 
-    uint32_t max_frames = 0;
+    CacheRetentionPolicy policy{};
+    uint32_t min_frames = 0;
+    CacheStats stats{};
+    // Hashes of evicted keys, to detect recreations. Hash collisions can be counted as a recreation as well.
+    // Maps the hash to its eviction number, so entries in evicted_order that were already recreated or evicted again can be told apart.
+    std::unordered_map<size_t, uint64_t> evicted_hashes;
+    // Hash and eviction number of the last max_evicted_hashes evictions, oldest first.
+    std::deque<std::pair<size_t, uint64_t>> evicted_order;
+
+    void remember_evicted(size_t hash) {
+        uint64_t const eviction = stats.evictions;
+        evicted_hashes[hash] = eviction;
+        evicted_order.emplace_back(hash, eviction);
+        if (evicted_order.size() > max_evicted_hashes) {
+            auto const [oldest_hash, oldest_eviction] = evicted_order.front();
+            auto it = evicted_hashes.find(oldest_hash);
+            if (it != evicted_hashes.end() && it->second == oldest_eviction) {
+                evicted_hashes.erase(it);
+            }
+            evicted_order.pop_front();
+        }
+    }
+
+    // The usage list is ordered by age, so once this returns false for an entry it also does for every entry after it.
+    bool should_evict(uint64_t age) const {
+        if (age <= min_frames) return false;
+        switch (policy.mode) {
+        case CacheRetentionPolicy::Mode::FrameAge:
+            return age > policy.max_frames;
+        case CacheRetentionPolicy::Mode::LRU:
+            return count > policy.max_entries;
+        case CacheRetentionPolicy::Mode::Never:
+        default:
+            return false;
+        }
+    }
+
+    size_t slot_mask() const {
+        return slots.size() - 1;
+    }
+
+    uint32_t find_entry(size_t hash, Key const& key) const {
+        if (slots.empty()) return empty_slot;
+        for (size_t i = hash & slot_mask(); slots[i].entry != empty_slot; i = (i + 1) & slot_mask()) {
+            if (slots[i].hash == hash && Traits::equal(entries[slots[i].entry].key, key)) {
+                return slots[i].entry;
+            }
+        }
+        return empty_slot;
+    }
+
+    // Returns the index of the entry and whether it was inserted. An existing entry keeps its value.
+    std::pair<uint32_t, bool> insert_entry(size_t hash, Key const& key, Value&& val) {
+        uint32_t existing = find_entry(hash, key);
+        if (existing != empty_slot) {
+            touch(existing);
+            return { existing, false };
+        }
+
+        if ((count + 1) * 4 > slots.size() * 3) {
+            grow();
+        }
+
+        if (!evicted_hashes.empty() && evicted_hashes.erase(hash) > 0) {
+            stats.recreations += 1;
+        }
+
+        uint32_t index = 0;
+        if (!free_entries.empty()) {
+            index = free_entries.back();
+            free_entries.pop_back();
+            entries[index] = Entry{ .key = Traits::store(key), .data = std::move(val), .hash = hash };
+        }
+        else {
+            index = static_cast<uint32_t>(entries.size());
+            entries.push_back(Entry{ .key = Traits::store(key), .data = std::move(val), .hash = hash });
+            usage.emplace_back();
+        }
+        usage[index] = Usage{ .last_used = current_frame, .prev = empty_slot, .next = empty_slot, .pins = 0, .unused = false, .alive = true };
+        link_back(index);
+        place_slot(Slot{ .hash = hash, .entry = index });
+        count += 1;
+        return { index, true };
+    }
+
+    // Moves the entry to the back of the usage list
+    void touch(uint32_t index) const {
+        Usage& entry = usage[index];
+        // Already at the right spot in the list
+        if (entry.last_used == current_frame && index == lru_tail) return;
+        entry.last_used = current_frame;
+        unlink(index);
+        link_back(index);
+    }
+
+    void link_back(uint32_t index) const {
+        usage[index].prev = lru_tail;
+        usage[index].next = empty_slot;
+        if (lru_tail != empty_slot) usage[lru_tail].next = index;
+        else lru_head = index;
+        lru_tail = index;
+    }
+
+    void unlink(uint32_t index) const {
+        Usage& entry = usage[index];
+        if (entry.prev != empty_slot) usage[entry.prev].next = entry.next;
+        else lru_head = entry.next;
+        if (entry.next != empty_slot) usage[entry.next].prev = entry.prev;
+        else lru_tail = entry.prev;
+        entry.prev = empty_slot;
+        entry.next = empty_slot;
+    }
+
+    void place_slot(Slot slot) {
+        size_t i = slot.hash & slot_mask();
+        while (slots[i].entry != empty_slot) {
+            i = (i + 1) & slot_mask();
+        }
+        slots[i] = slot;
+    }
+
+    void grow() {
+        std::vector<Slot> old = std::move(slots);
+        slots = std::vector<Slot>(std::max<size_t>(16, old.size() * 2));
+        for (Slot const& slot : old) {
+            if (slot.entry != empty_slot) {
+                place_slot(slot);
+            }
+        }
+    }
+
+    void erase_entry(uint32_t index) {
+        size_t i = entries[index].hash & slot_mask();
+        while (slots[i].entry != index) {
+            i = (i + 1) & slot_mask();
+        }
+        // Backward shift deletion: move later entries of the probe sequence into the hole, so lookups never need tombstones.
+        size_t hole = i;
+        for (size_t j = (hole + 1) & slot_mask(); slots[j].entry != empty_slot; j = (j + 1) & slot_mask()) {
+            size_t const home = slots[j].hash & slot_mask();
+            // Distance from the home slot, taking wrap-around into account
+            bool const can_move = ((j - home) & slot_mask()) >= ((j - hole) & slot_mask());
+            if (can_move) {
+                slots[hole] = slots[j];
+                hole = j;
+            }
+        }
+        slots[hole] = Slot{};
+
+        unlink(index);
+        entries[index] = Entry{};
+        usage[index] = Usage{};
+        free_entries.push_back(index);
+        count -= 1;
+    }
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,384 @@
+#pragma once
+
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+
+#include <phobos/pipeline.hpp>
+#include <phobos/shader.hpp>
+#include <phobos/hash.hpp>
+
+namespace ph {
+
+// Describes how a Cache stores and compares its keys. Entries are only returned if the stored key compares equal to the key that is
+// looked up, so a hash collision can never return the wrong object.
+// By default, the key is stored as-is and compared with operator==. Keys that point to memory owned by the caller (like Vulkan create infos)
+// are specialized to store a copy of that memory.
+template<typename Key>
+struct CacheKeyTraits {
+    using stored_type = Key;
+
+    static stored_type store(Key const& key) {
+        return key;
+    }
+
+    static bool equal(stored_type const& stored, Key const& key) {
+        return stored == key;
+    }
+};
+
+namespace key_equal {
+
+inline bool equal(VkAttachmentDescription const& lhs, VkAttachmentDescription const& rhs) {
+    return lhs.flags == rhs.flags && lhs.format == rhs.format && lhs.samples == rhs.samples
+        && lhs.loadOp == rhs.loadOp && lhs.storeOp == rhs.storeOp && lhs.stencilLoadOp == rhs.stencilLoadOp && lhs.stencilStoreOp == rhs.stencilStoreOp
+        && lhs.initialLayout == rhs.initialLayout && lhs.finalLayout == rhs.finalLayout;
+}
+
+inline bool equal(VkAttachmentReference const& lhs, VkAttachmentReference const& rhs) {
+    return lhs.attachment == rhs.attachment && lhs.layout == rhs.layout;
+}
+
+inline bool equal(VkSubpassDependency const& lhs, VkSubpassDependency const& rhs) {
+    return lhs.srcSubpass == rhs.srcSubpass && lhs.dstSubpass == rhs.dstSubpass && lhs.srcStageMask == rhs.srcStageMask && lhs.dstStageMask == rhs.dstStageMask
+        && lhs.srcAccessMask == rhs.srcAccessMask && lhs.dstAccessMask == rhs.dstAccessMask && lhs.dependencyFlags == rhs.dependencyFlags;
+}
+
+inline bool equal(VkDescriptorSetLayoutBinding const& lhs, VkDescriptorSetLayoutBinding const& rhs) {
+    // Immutable samplers are compared by address, since the array is owned by the caller and cannot be read after insertion.
+    // This can only cause an extra layout to be created, never the wrong one to be returned.
+    return lhs.binding == rhs.binding && lhs.descriptorType == rhs.descriptorType && lhs.descriptorCount == rhs.descriptorCount
+        && lhs.stageFlags == rhs.stageFlags && lhs.pImmutableSamplers == rhs.pImmutableSamplers;
+}
+
+inline bool equal(VkPushConstantRange const& lhs, VkPushConstantRange const& rhs) {
+    return lhs.stageFlags == rhs.stageFlags && lhs.offset == rhs.offset && lhs.size == rhs.size;
+}
+
+inline bool equal(DescriptorSetLayoutCreateInfo const& lhs, DescriptorSetLayoutCreateInfo const& rhs) {
+    return lhs.push_descriptor == rhs.push_descriptor && lhs.flags == rhs.flags
+        && std::equal(lhs.bindings.begin(), lhs.bindings.end(), rhs.bindings.begin(), rhs.bindings.end(),
+            [](auto const& a, auto const& b) { return equal(a, b); });
+}
+
+inline bool equal(PipelineLayoutCreateInfo const& lhs, PipelineLayoutCreateInfo const& rhs) {
+    auto const eq = [](auto const& a, auto const& b) { return equal(a, b); };
+    return std::equal(lhs.push_constants.begin(), lhs.push_constants.end(), rhs.push_constants.begin(), rhs.push_constants.end(), eq)
+        && std::equal(lhs.set_layouts.begin(), lhs.set_layouts.end(), rhs.set_layouts.begin(), rhs.set_layouts.end(), eq);
+}
+
+// Types that are hashed as raw bytes are compared as raw bytes as well, see is_bytewise_hashable.
+template<typename T> requires is_bytewise_hashable<T>::value
+inline bool equal(T const& lhs, T const& rhs) {
+    return std::memcmp(&lhs, &rhs, sizeof(T)) == 0;
+}
+
+inline bool equal(VkPipelineInputAssemblyStateCreateInfo const& lhs, VkPipelineInputAssemblyStateCreateInfo const& rhs) {
+    return lhs.flags == rhs.flags && lhs.topology == rhs.topology && lhs.primitiveRestartEnable == rhs.primitiveRestartEnable;
+}
+
+inline bool equal(VkPipelineDepthStencilStateCreateInfo const& lhs, VkPipelineDepthStencilStateCreateInfo const& rhs) {
+    return lhs.flags == rhs.flags && lhs.depthTestEnable == rhs.depthTestEnable && lhs.depthWriteEnable == rhs.depthWriteEnable
+        && lhs.depthCompareOp == rhs.depthCompareOp && lhs.depthBoundsTestEnable == rhs.depthBoundsTestEnable && lhs.stencilTestEnable == rhs.stencilTestEnable
+        && equal(lhs.front, rhs.front) && equal(lhs.back, rhs.back) && lhs.minDepthBounds == rhs.minDepthBounds && lhs.maxDepthBounds == rhs.maxDepthBounds;
+}
+
+inline bool equal(VkPipelineRasterizationStateCreateInfo const& lhs, VkPipelineRasterizationStateCreateInfo const& rhs) {
+    return lhs.flags == rhs.flags && lhs.depthClampEnable == rhs.depthClampEnable && lhs.rasterizerDiscardEnable == rhs.rasterizerDiscardEnable
+        && lhs.polygonMode == rhs.polygonMode && lhs.cullMode == rhs.cullMode && lhs.frontFace == rhs.frontFace && lhs.depthBiasEnable == rhs.depthBiasEnable
+        && lhs.depthBiasConstantFactor == rhs.depthBiasConstantFactor && lhs.depthBiasClamp == rhs.depthBiasClamp
+        && lhs.depthBiasSlopeFactor == rhs.depthBiasSlopeFactor && lhs.lineWidth == rhs.lineWidth;
+}
+
+// The sample mask is not compared, since it points to memory owned by the caller. See sample_mask_words().
+inline bool equal(VkPipelineMultisampleStateCreateInfo const& lhs, VkPipelineMultisampleStateCreateInfo const& rhs) {
+    return lhs.flags == rhs.flags && lhs.rasterizationSamples == rhs.rasterizationSamples && lhs.sampleShadingEnable == rhs.sampleShadingEnable
+        && lhs.minSampleShading == rhs.minSampleShading && lhs.alphaToCoverageEnable == rhs.alphaToCoverageEnable && lhs.alphaToOneEnable == rhs.alphaToOneEnable;
+}
+
+inline bool equal(VkViewport const& lhs, VkViewport const& rhs) {
+    return lhs.x == rhs.x && lhs.y == rhs.y && lhs.width == rhs.width && lhs.height == rhs.height && lhs.minDepth == rhs.minDepth && lhs.maxDepth == rhs.maxDepth;
+}
+
+// Amount of 32-bit words pSampleMask points to, zero if there is no sample mask.
+inline size_t sample_mask_words(VkPipelineMultisampleStateCreateInfo const& info) {
+    return info.pSampleMask ? (info.rasterizationSamples + 31) / 32 : 0;
+}
+
+template<typename T>
+inline bool equal(std::vector<T> const& lhs, std::vector<T> const& rhs) {
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](T const& a, T const& b) { return equal(a, b); });
+}
+
+// Compares the same fields as std::hash<ph::PipelineCreateInfo>, except for the sample mask.
+inline bool equal(PipelineCreateInfo const& lhs, PipelineCreateInfo const& rhs) {
+    if (lhs.name != rhs.name || !equal(lhs.layout, rhs.layout) || lhs.shaders != rhs.shaders || lhs.dynamic_states != rhs.dynamic_states
+        || lhs.blend_logic_op_enable != rhs.blend_logic_op_enable) return false;
+    if (!equal(lhs.vertex_input_bindings, rhs.vertex_input_bindings) || !equal(lhs.vertex_attributes, rhs.vertex_attributes)
+        || !equal(lhs.blend_attachments, rhs.blend_attachments)) return false;
+    if (!equal(lhs.input_assembly, rhs.input_assembly) || !equal(lhs.depth_stencil, rhs.depth_stencil)
+        || !equal(lhs.rasterizer, rhs.rasterizer) || !equal(lhs.multisample, rhs.multisample)) return false;
+    // Dynamic viewports and scissors are ignored, only their amount matters
+    if (lhs.viewports.size() != rhs.viewports.size() || lhs.scissors.size() != rhs.scissors.size()) return false;
+    bool const dynamic_viewport = std::find(lhs.dynamic_states.begin(), lhs.dynamic_states.end(), VK_DYNAMIC_STATE_VIEWPORT) != lhs.dynamic_states.end();
+    bool const dynamic_scissor = std::find(lhs.dynamic_states.begin(), lhs.dynamic_states.end(), VK_DYNAMIC_STATE_SCISSOR) != lhs.dynamic_states.end();
+    if (!dynamic_viewport && !equal(lhs.viewports, rhs.viewports)) return false;
+    if (!dynamic_scissor && !equal(lhs.scissors, rhs.scissors)) return false;
+    return true;
+}
+
+inline bool equal(DescriptorBinding const& lhs, DescriptorBinding const& rhs) {
+    if (lhs.binding != rhs.binding || lhs.type != rhs.type || lhs.descriptors.size() != rhs.descriptors.size()) return false;
+    for (size_t i = 0; i < lhs.descriptors.size(); ++i) {
+        auto const& a = lhs.descriptors[i];
+        auto const& b = rhs.descriptors[i];
+        // Only the fields that are used by the descriptor type are compared, same as in std::hash<ph::DescriptorBinding>
+        switch (lhs.type) {
+        case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+        case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+            if (a.image.view.id != b.image.view.id || a.image.sampler != b.image.sampler || a.image.layout != b.image.layout) return false;
+            break;
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+            if (a.buffer.buffer != b.buffer.buffer || a.buffer.offset != b.buffer.offset || a.buffer.range != b.buffer.range) return false;
+            break;
+#if PHOBOS_ENABLE_RAY_TRACING
+        case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
+            if (a.accel_structure.structure != b.accel_structure.structure) return false;
+            break;
+#endif
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+}
+
+// Framebuffer create infos point to an array of attachments, so a copy of the attachments is stored instead.
+// For an imageless framebuffer, the attachment image infos in the pNext chain are stored instead of the views.
+template<>
+struct CacheKeyTraits<VkFramebufferCreateInfo> {
+    struct ImagelessAttachment {
+        VkImageCreateFlags flags = {};
+        VkImageUsageFlags usage = {};
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t layers = 0;
+        std::vector<VkFormat> formats;
+    };
+
+    struct stored_type {
+        VkFramebufferCreateFlags flags = {};
+        VkRenderPass render_pass = nullptr;
+        std::vector<VkImageView> attachments;
+        std::vector<ImagelessAttachment> imageless_attachments;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t layers = 0;
+    };
+
+    static stored_type store(VkFramebufferCreateInfo const& info) {
+        stored_type stored{
+            .flags = info.flags,
+            .render_pass = info.renderPass,
+            .attachments = {},
+            .imageless_attachments = {},
+            .width = info.width,
+            .height = info.height,
+            .layers = info.layers
+        };
+        if (VkFramebufferAttachmentsCreateInfo const* imageless = get_imageless_attachments(info)) {
+            for (uint32_t i = 0; i < imageless->attachmentImageInfoCount; ++i) {
+                VkFramebufferAttachmentImageInfo const& attachment = imageless->pAttachmentImageInfos[i];
+                stored.imageless_attachments.push_back(ImagelessAttachment{
+                    .flags = attachment.flags,
+                    .usage = attachment.usage,
+                    .width = attachment.width,
+                    .height = attachment.height,
+                    .layers = attachment.layerCount,
+                    .formats = std::vector<VkFormat>(attachment.pViewFormats, attachment.pViewFormats + attachment.viewFormatCount)
+                });
+            }
+        }
+        else {
+            stored.attachments = std::vector<VkImageView>(info.pAttachments, info.pAttachments + info.attachmentCount);
+        }
+        return stored;
+    }
+
+    static bool equal(stored_type const& stored, VkFramebufferCreateInfo const& info) {
+        if (stored.flags != info.flags || stored.render_pass != info.renderPass
+            || stored.width != info.width || stored.height != info.height || stored.layers != info.layers) return false;
+        VkFramebufferAttachmentsCreateInfo const* imageless = get_imageless_attachments(info);
+        if (!imageless) {
+            return std::equal(stored.attachments.begin(), stored.attachments.end(), info.pAttachments, info.pAttachments + info.attachmentCount);
+        }
+        return std::equal(stored.imageless_attachments.begin(), stored.imageless_attachments.end(),
+            imageless->pAttachmentImageInfos, imageless->pAttachmentImageInfos + imageless->attachmentImageInfoCount,
+            [](ImagelessAttachment const& a, VkFramebufferAttachmentImageInfo const& b) {
+                return a.flags == b.flags && a.usage == b.usage && a.width == b.width && a.height == b.height && a.layers == b.layerCount
+                    && std::equal(a.formats.begin(), a.formats.end(), b.pViewFormats, b.pViewFormats + b.viewFormatCount);
+            });
+    }
+};
+
+// Render pass create infos point to arrays of attachments, subpasses and dependencies, so a copy of these is stored instead.
+template<>
+struct CacheKeyTraits<VkRenderPassCreateInfo> {
+    struct Subpass {
+        VkPipelineBindPoint bind_point{};
+        std::vector<VkAttachmentReference> inputs;
+        std::vector<VkAttachmentReference> colors;
+        std::vector<VkAttachmentReference> resolves;
+        std::optional<VkAttachmentReference> depth_stencil;
+        std::vector<uint32_t> preserve;
+    };
+
+    struct stored_type {
+        VkRenderPassCreateFlags flags = {};
+        std::vector<VkAttachmentDescription> attachments;
+        std::vector<Subpass> subpasses;
+        std::vector<VkSubpassDependency> dependencies;
+    };
+
+    static stored_type store(VkRenderPassCreateInfo const& info) {
+        stored_type stored{
+            .flags = info.flags,
+            .attachments = std::vector<VkAttachmentDescription>(info.pAttachments, info.pAttachments + info.attachmentCount),
+            .subpasses = {},
+            .dependencies = std::vector<VkSubpassDependency>(info.pDependencies, info.pDependencies + info.dependencyCount)
+        };
+        stored.subpasses.reserve(info.subpassCount);
+        for (uint32_t i = 0; i < info.subpassCount; ++i) {
+            VkSubpassDescription const& subpass = info.pSubpasses[i];
+            stored.subpasses.push_back(Subpass{
+                .bind_point = subpass.pipelineBindPoint,
+                .inputs = std::vector<VkAttachmentReference>(subpass.pInputAttachments, subpass.pInputAttachments + subpass.inputAttachmentCount),
+                .colors = std::vector<VkAttachmentReference>(subpass.pColorAttachments, subpass.pColorAttachments + subpass.colorAttachmentCount),
+                .resolves = subpass.pResolveAttachments
+                    ? std::vector<VkAttachmentReference>(subpass.pResolveAttachments, subpass.pResolveAttachments + subpass.colorAttachmentCount)
+                    : std::vector<VkAttachmentReference>{},
+                .depth_stencil = subpass.pDepthStencilAttachment ? std::optional(*subpass.pDepthStencilAttachment) : std::nullopt,
+                .preserve = std::vector<uint32_t>(subpass.pPreserveAttachments, subpass.pPreserveAttachments + subpass.preserveAttachmentCount)
+            });
+        }
+        return stored;
+    }
+
+    static bool equal(stored_type const& stored, VkRenderPassCreateInfo const& info) {
+        auto const eq = [](auto const& a, auto const& b) { return key_equal::equal(a, b); };
+        if (stored.flags != info.flags) return false;
+        if (!std::equal(stored.attachments.begin(), stored.attachments.end(), info.pAttachments, info.pAttachments + info.attachmentCount, eq)) return false;
+        if (!std::equal(stored.dependencies.begin(), stored.dependencies.end(), info.pDependencies, info.pDependencies + info.dependencyCount, eq)) return false;
+        if (stored.subpasses.size() != info.subpassCount) return false;
+        for (uint32_t i = 0; i < info.subpassCount; ++i) {
+            Subpass const& a = stored.subpasses[i];
+            VkSubpassDescription const& b = info.pSubpasses[i];
+            if (a.bind_point != b.pipelineBindPoint) return false;
+            if (!std::equal(a.inputs.begin(), a.inputs.end(), b.pInputAttachments, b.pInputAttachments + b.inputAttachmentCount, eq)) return false;
+            if (!std::equal(a.colors.begin(), a.colors.end(), b.pColorAttachments, b.pColorAttachments + b.colorAttachmentCount, eq)) return false;
+            if (a.resolves.empty() != (b.pResolveAttachments == nullptr)) return false;
+            if (b.pResolveAttachments && !std::equal(a.resolves.begin(), a.resolves.end(), b.pResolveAttachments, b.pResolveAttachments + b.colorAttachmentCount, eq)) return false;
+            if (a.depth_stencil.has_value() != (b.pDepthStencilAttachment != nullptr)) return false;
+            if (a.depth_stencil && !key_equal::equal(*a.depth_stencil, *b.pDepthStencilAttachment)) return false;
+            if (!std::equal(a.preserve.begin(), a.preserve.end(), b.pPreserveAttachments, b.pPreserveAttachments + b.preserveAttachmentCount)) return false;
+        }
+        return true;
+    }
+};
+
+// Keys that own all of their memory, but have no operator== of their own.
+template<typename Key>
+struct CacheKeyEqualTraits {
+    using stored_type = Key;
+
+    static stored_type store(Key const& key) {
+        return key;
+    }
+
+    static bool equal(stored_type const& stored, Key const& key) {
+        return key_equal::equal(stored, key);
+    }
+};
+
+template<>
+struct CacheKeyTraits<DescriptorSetLayoutCreateInfo> : CacheKeyEqualTraits<DescriptorSetLayoutCreateInfo> {};
+
+template<>
+struct CacheKeyTraits<PipelineLayoutCreateInfo> : CacheKeyEqualTraits<PipelineLayoutCreateInfo> {};
+
+template<>
+struct CacheKeyTraits<DescriptorSetBinding> {
+    using stored_type = DescriptorSetBinding;
+
+    static stored_type store(DescriptorSetBinding const& key) {
+        return key;
+    }
+
+    static bool equal(stored_type const& stored, DescriptorSetBinding const& key) {
+        return stored.set_layout == key.set_layout
+            && std::equal(stored.bindings.begin(), stored.bindings.end(), key.bindings.begin(), key.bindings.end(),
+                [](auto const& a, auto const& b) { return key_equal::equal(a, b); });
+    }
+};
+
+// Stores the code and entry point only, the shader stage does not matter for the module. The code is compared on a hash match.
+template<>
+struct CacheKeyTraits<ShaderModuleCreateInfo> {
+    struct stored_type {
+        std::vector<uint32_t> code;
+        std::string entry_point;
+    };
+
+    static stored_type store(ShaderModuleCreateInfo const& key) {
+        return stored_type{ .code = key.code, .entry_point = key.entry_point };
+    }
+
+    static bool equal(stored_type const& stored, ShaderModuleCreateInfo const& key) {
+        return stored.entry_point == key.entry_point && stored.code.size() == key.code.size()
+            && std::memcmp(stored.code.data(), key.code.data(), key.code.size() * sizeof(uint32_t)) == 0;
+    }
+};
+
+template<>
+struct CacheKeyTraits<ComputePipelineCreateInfo> {
+    using stored_type = ComputePipelineCreateInfo;
+
+    static stored_type store(ComputePipelineCreateInfo const& key) {
+        return key;
+    }
+
+    static bool equal(stored_type const& stored, ComputePipelineCreateInfo const& key) {
+        return stored.name == key.name && stored.shader == key.shader && key_equal::equal(stored.layout, key.layout);
+    }
+};
+
+#if PHOBOS_ENABLE_RAY_TRACING
+template<>
+struct CacheKeyTraits<RayTracingPipelineCreateInfo> {
+    using stored_type = RayTracingPipelineCreateInfo;
+
+    static stored_type store(RayTracingPipelineCreateInfo const& key) {
+        return key;
+    }
+
+    static bool equal(stored_type const& stored, RayTracingPipelineCreateInfo const& key) {
+        auto const same_group = [](RayTracingShaderGroup const& a, RayTracingShaderGroup const& b) {
+            return a.type == b.type && a.general == b.general && a.closest_hit == b.closest_hit && a.any_hit == b.any_hit && a.intersection == b.intersection;
+        };
+        return stored.name == key.name && stored.max_recursion_depth == key.max_recursion_depth && stored.shaders == key.shaders
+            && std::equal(stored.shader_groups.begin(), stored.shader_groups.end(), key.shader_groups.begin(), key.shader_groups.end(), same_group)
+            && key_equal::equal(stored.layout, key.layout);
+    }
+};
+#endif
+
+}
@@ -2,6 +2,9 @@
 
 #include <vulkan/vulkan.h>
 #include <string_view>
+#include <span>
+#include <array>
+#include <vector>
 
 #include <plib/bit_flag.hpp>
 
@@ -14,6 +17,15 @@ namespace ph {
 class Context;
 class Queue;
 
+struct CommandBufferStats {
+	// Amount of state commands (binds, dynamic state and push constants) that were recorded.
+	uint32_t commands_emitted = 0;
+	// Amount of state commands that were dropped because they would not have changed any state.
+	uint32_t commands_elided = 0;
+};
+
+// Binds and dynamic state that would not change the current state are not recorded.
+// Recording commands through handle() bypasses this tracking, call invalidate_state() afterwards.
 class CommandBuffer {
 public:
 	CommandBuffer() = default;
@@ -28,11 +40,34 @@ public:
 
 	CommandBuffer& begin_renderpass(VkRenderPassBeginInfo const& info);
 	CommandBuffer& end_renderpass();
+	// Begins a pass with dynamic rendering. formats must match the views in info, graphics pipelines bound in the pass are compiled against them.
+	// Requires AppSettings::enable_dynamic_rendering.
+	CommandBuffer& begin_rendering(VkRenderingInfoKHR const& info, RenderingFormats const& formats);
+	CommandBuffer& end_rendering();
 
 	Pipeline const& get_bound_pipeline() const;
+	// Binding by id only looks up the pipeline in the cache the first time it is bound in this command buffer (per render pass or set of formats).
+	// The name overloads look up the id first.
+	CommandBuffer& bind_pipeline(PipelineId id);
 	CommandBuffer& bind_pipeline(std::string_view name);
+	CommandBuffer& bind_compute_pipeline(PipelineId id);
 	CommandBuffer& bind_compute_pipeline(std::string_view name);
-	CommandBuffer& bind_descriptor_set(VkDescriptorSet set);
+	// Non-blocking variants of bind_pipeline and bind_compute_pipeline. If the pipeline is still being compiled in the background,
+	// nothing is bound and false is returned. The caller can then skip the draw or bind a fallback pipeline instead.
+	bool try_bind_pipeline(PipelineId id);
+	bool try_bind_pipeline(std::string_view name);
+	bool try_bind_compute_pipeline(PipelineId id);
+	bool try_bind_compute_pipeline(std::string_view name);
+	// Binds the set at set_index. Sets at other indices stay bound, as long as the pipeline layouts are compatible up to that index.
+	CommandBuffer& bind_descriptor_set(VkDescriptorSet set, uint32_t set_index = 0);
+	// Binds a set with dynamic uniform or storage buffers. dynamic_offsets holds one offset per dynamic descriptor, ordered by binding
+	// (see DescriptorBuilder::get_dynamic_offsets()).
+	CommandBuffer& bind_descriptor_set(VkDescriptorSet set, uint32_t set_index, std::span<uint32_t const> dynamic_offsets);
+	// Pushes the descriptors straight into the command buffer, without allocating a descriptor set. set_index must have been marked as a
+	// push descriptor set when creating the current pipeline. The bindings can be built with DescriptorBuilder::get_set_binding().
+	CommandBuffer& push_descriptors(DescriptorSetBinding const& set_binding, uint32_t set_index = 0);
+	// Binds the bindless heap to AppSettings::bindless_set_index for the current pipeline. The heap must be enabled in AppSettings.
+	CommandBuffer& bind_bindless_heap();
 
 	CommandBuffer& bind_vertex_buffer(uint32_t first_binding, VkBuffer buffer, VkDeviceSize offset);
 	CommandBuffer& bind_vertex_buffer(uint32_t first_binding, BufferSlice slice);
@@ -53,6 +88,11 @@ public:
 	CommandBuffer& barrier(plib::bit_flag<ph::PipelineStage> src_stage, plib::bit_flag<ph::PipelineStage> dst_stage, VkBufferMemoryBarrier const& barrier, VkDependencyFlags dependency = VK_DEPENDENCY_BY_REGION_BIT);
 	CommandBuffer& barrier(plib::bit_flag<ph::PipelineStage> src_stage, plib::bit_flag<ph::PipelineStage> dst_stage, VkImageMemoryBarrier const& barrier, VkDependencyFlags dependency = VK_DEPENDENCY_BY_REGION_BIT);
 	CommandBuffer& barrier(plib::bit_flag<ph::PipelineStage> src_stage, plib::bit_flag<ph::PipelineStage> dst_stage, VkMemoryBarrier const& barrier, VkDependencyFlags dependency = VK_DEPENDENCY_BY_REGION_BIT);
+	// Records all barriers with a single vkCmdPipelineBarrier call
+	CommandBuffer& barriers(plib::bit_flag<ph::PipelineStage> src_stage, plib::bit_flag<ph::PipelineStage> dst_stage, std::span<VkMemoryBarrier const> memory,
+		std::span<VkBufferMemoryBarrier const> buffers, std::span<VkImageMemoryBarrier const> images, VkDependencyFlags dependency = VK_DEPENDENCY_BY_REGION_BIT);
+	// Records the barriers with vkCmdPipelineBarrier2KHR. Synchronization2 must be enabled in AppSettings.
+	CommandBuffer& barriers(VkDependencyInfoKHR const& dependency);
 
 	CommandBuffer& transition_layout(plib::bit_flag<ph::PipelineStage> src_stage, plib::bit_flag<ph::ResourceAccess> src_access, plib::bit_flag<ph::PipelineStage> dst_stage, plib::bit_flag<ph::ResourceAccess> dst_access, 
 		ph::ImageView const& view, VkImageLayout old_layout, VkImageLayout new_layout);
@@ -92,12 +132,87 @@ public:
 
 	VkCommandBuffer handle() const;
 
+	// Forgets all tracked state, so the next bind of every kind is always recorded.
+	CommandBuffer& invalidate_state();
+	CommandBufferStats const& get_stats() const;
+
 private:
 	Context* ctx = nullptr;
 	VkCommandBuffer cmd_buf = nullptr;
 	VkRenderPass cur_renderpass = nullptr;
+	// Set between begin_rendering and end_rendering
+	bool in_dynamic_rendering = false;
+	RenderingFormats cur_rendering_formats{};
 	VkRect2D cur_render_area = {};
 	Pipeline cur_pipeline{};
+
+	// Descriptor sets above this index, and vertex buffer bindings above max_tracked_vertex_buffers, are always recorded.
+	static constexpr uint32_t max_tracked_sets = 8;
+	static constexpr uint32_t max_tracked_vertex_buffers = 8;
+
+	// Pipelines and descriptor sets are bound separately for every bind point.
+	struct BindPointState {
+		VkPipeline pipeline = nullptr;
+		VkPipelineLayout layout = nullptr;
+		std::array<VkDescriptorSet, max_tracked_sets> sets{};
+	};
+
+	struct VertexBufferState {
+		VkBuffer buffer = nullptr;
+		VkDeviceSize offset = 0;
+	};
+
+	struct IndexBufferState {
+		VkBuffer buffer = nullptr;
+		VkDeviceSize offset = 0;
+		VkIndexType type{};
+	};
+
+	// The last push constant range that was pushed, so pushing the same data again can be skipped.
+	struct PushConstantState {
+		VkPipelineLayout layout = nullptr;
+		VkShaderStageFlags stages = 0;
+		uint32_t offset = 0;
+		std::vector<std::byte> data;
+	};
+
+	// Graphics, compute and ray tracing
+	std::array<BindPointState, 3> bind_points{};
+	std::array<VertexBufferState, max_tracked_vertex_buffers> vertex_buffers{};
+	IndexBufferState index_buffer{};
+	PushConstantState push_constant_state{};
+	// Viewport and scissor have to be set again after a pipeline change, since pipelines with static viewport or scissor overwrite them.
+	std::optional<VkViewport> viewport = std::nullopt;
+	std::optional<VkRect2D> scissor = std::nullopt;
+	CommandBufferStats stats{};
+
+	// A pipeline that was looked up in the cache while recording this command buffer.
+	struct ResolvedPipeline {
+		// Always null for compute pipelines, and for pipelines resolved for dynamic rendering
+		VkRenderPass render_pass = nullptr;
+		// Only set for pipelines resolved for dynamic rendering
+		RenderingFormats formats{};
+		// Version of the named pipeline this was resolved from, see Context::get_pipeline_version()
+		uint32_t version = 0;
+		Pipeline pipeline{};
+	};
+	// Indexed by PipelineId. A graphics pipeline has one entry for every render pass or set of formats it was bound in.
+	std::vector<std::vector<ResolvedPipeline>> resolved_pipelines;
+	std::vector<ResolvedPipeline> resolved_compute_pipelines;
+
+	// Returns nullptr if wait is false and the pipeline is not compiled yet.
+	Pipeline const* resolve_pipeline(PipelineId id, bool wait);
+	Pipeline const* resolve_compute_pipeline(PipelineId id, bool wait);
+
+	// Graphics state is not kept between passes, since the next pass may need different pipeline variants.
+	void reset_graphics_state();
+	// Binds the pipeline and updates cur_pipeline, unless it is already bound.
+	void bind_pipeline_state(Pipeline const& pipeline);
+	BindPointState& get_bind_point_state(PipelineType type);
+	// Marks a set as unknown, for sets that were bound with dynamic offsets or pushed.
+	void forget_descriptor_set(uint32_t set_index);
+	// Returns true if the command should be recorded, and counts it.
+	bool track(bool changed);
 };
 
 }
\ No newline at end of file
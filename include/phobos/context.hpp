@@ -11,6 +11,8 @@
 #include <phobos/shader.hpp>
 #include <phobos/buffer.hpp>
 #include <phobos/scratch_allocator.hpp>
+#include <phobos/descriptor_allocator.hpp>
+#include <phobos/bindless_heap.hpp>
 
 
 #include <vulkan/vulkan.h>
@@ -47,6 +49,37 @@ struct GPURequirements {
 	void* pNext = nullptr;
 };
 
+// Retention policies of the object caches. Entries used by frames that may still be in flight are never evicted,
+// so a FrameAge policy with max_frames below max_frames_in_flight + 2 behaves as if it was max_frames_in_flight + 2.
+struct CacheSettings {
+	CacheRetentionPolicy framebuffers{};
+	CacheRetentionPolicy render_passes{};
+	// Also used for the pipeline and descriptor set layout caches, since cached pipelines refer to their layouts.
+	// Pipelines compiled in the background are kept until they are first bound, and so are their layouts and the render pass they are compiled for.
+	CacheRetentionPolicy pipelines{};
+	CacheRetentionPolicy shader_modules{};
+	// Maximum amount of descriptor pools kept per thread and frame in flight. Pools above this amount are destroyed once they
+	// went unused for DescriptorPoolAllocator::idle_resets_before_trim resets. Zero keeps every pool.
+	uint32_t max_descriptor_pools = 0;
+};
+
+// Eviction statistics of every cache, see Context::get_cache_stats().
+struct CacheStatistics {
+	CacheStats framebuffers{};
+	CacheStats render_passes{};
+	CacheStats set_layouts{};
+	CacheStats pipeline_layouts{};
+	CacheStats pipelines{};
+	CacheStats compute_pipelines{};
+#if PHOBOS_ENABLE_RAY_TRACING
+	CacheStats ray_tracing_pipelines{};
+#endif
+	CacheStats shader_modules{};
+	// Descriptor pools of all threads and frames. Evictions and recreations are pools destroyed and created because of
+	// CacheSettings::max_descriptor_pools.
+	CacheStats descriptor_pools{};
+};
+
 struct AppSettings {
 	// Application name and version. These are passed to vulkan directly, and could show up in tools like NSight for example.
 	std::string_view app_name;
@@ -91,6 +124,34 @@ struct AppSettings {
 	VkDeviceSize scratch_ubo_size = 128 * 1024;
 	// Size of SSBO scratch allocator. Defaults to 1 MiB.
 	VkDeviceSize scratch_ssbo_size = 1024 * 1024;
+	// Path to the on-disk pipeline cache. The cache is loaded from this file on startup and written back when the context is destroyed.
+	// A file written by a different device or driver version is ignored. If this is empty, the pipeline cache is only kept in memory.
+	std::string_view pipeline_cache_path;
+	// Amount of background threads used to compile pipelines before they are first bound. 
+	// Setting this to zero disables background compilation. Defaults to 1.
+	uint32_t pipeline_compile_threads = 1;
+	// Array sizes of the bindless descriptor heap, see ph::BindlessHeap. The heap is only created if at least one of these is nonzero.
+	// It requires runtimeDescriptorArray, descriptorBindingPartiallyBound, descriptorBindingUpdateUnusedWhilePending and the 
+	// descriptorBinding*UpdateAfterBind features for the used descriptor types to be enabled in gpu_requirements.features_1_2.
+	uint32_t bindless_sampled_images = 0;
+	uint32_t bindless_storage_images = 0;
+	uint32_t bindless_storage_buffers = 0;
+	// Descriptor set index the heap is bound to in every pipeline layout. Shaders must not declare other resources in this set.
+	uint32_t bindless_set_index = 1;
+	// Enables VK_KHR_push_descriptor, which is required for pipelines with a push descriptor set.
+	// See PipelineBuilder::set_push_descriptor_set() and CommandBuffer::push_descriptors().
+	bool enable_push_descriptors = false;
+	// Enables the imagelessFramebuffer feature. The render graph then creates framebuffers from the format, usage and size of 
+	// its attachments instead of their image views, so a new swapchain image or a recreated view does not need a new framebuffer.
+	bool enable_imageless_framebuffers = false;
+	// Enables VK_KHR_dynamic_rendering. The render graph then records passes with vkCmdBeginRenderingKHR instead of creating render passes
+	// and framebuffers, and graphics pipelines are compiled against the attachment formats of the pass. Takes precedence over imageless framebuffers.
+	bool enable_dynamic_rendering = false;
+	// Enables VK_KHR_synchronization2. Barriers are then recorded with vkCmdPipelineBarrier2KHR, so every barrier keeps its own stage masks
+	// and stages like PipelineStage::Copy are not widened. Command buffers are submitted with vkQueueSubmit2KHR.
+	bool enable_synchronization2 = false;
+	// Controls how long unused pipelines, render passes, framebuffers and descriptor pools are kept around.
+	CacheSettings cache_retention{};
 };
 
 struct SurfaceInfo {
@@ -247,6 +308,9 @@ public:
 
 	bool is_headless() const;
 	bool validation_enabled() const;
+	bool imageless_framebuffers_enabled() const;
+	bool dynamic_rendering_enabled() const;
+	bool synchronization2_enabled() const;
 	uint32_t thread_count() const;
 
     VkDevice device();
@@ -284,7 +348,7 @@ public:
 	void present(Queue& queue);
 
 	// These must be called at the start and end of a thread context. Note that end_thread must be called when all work on the thread is complete, so be sure to add
-	// proper synchronization. Note that (right now) phobos does not verify thread synchronization, so if you supply the same thread index 
+	// proper synchronization. end_thread also frees the descriptor sets allocated with DescriptorLifetime::Thread on this thread index. Note that (right now) phobos does not verify thread synchronization, so if you supply the same thread index 
 	// on two concurrent jobs anything might happen.
 	[[nodiscard]] InThreadContext begin_thread(uint32_t thread_index);
 	void end_thread(uint32_t thread_index);
@@ -308,6 +372,11 @@ public:
 	void create_attachment(std::string_view name, VkExtent2D size, VkFormat format, ImageType type);
     void create_attachment(std::string_view name, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, ImageType type);
     void create_attachment(std::string_view name, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, uint32_t layers, ImageType type);
+	// The contents of a transient attachment do not need to survive across frames. A render graph that uses it places it in memory shared with
+	// other transient attachments that are not used in the same passes, which recreates its image and view. Get the attachment again after
+	// building the graph, and only use transient attachments in a single render graph per frame.
+	void create_transient_attachment(std::string_view name, VkExtent2D size, VkFormat format, ImageType type);
+	void create_transient_attachment(std::string_view name, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, uint32_t layers, ImageType type);
 	// Does not actually resize if the new size is identical to the old size.
 	void resize_attachment(std::string_view name, VkExtent2D new_size);
 	bool is_swapchain_attachment(std::string const& name);
@@ -317,12 +386,23 @@ public:
 	std::string get_swapchain_attachment_name() const;
 
 	ShaderHandle create_shader(std::string_view path, std::string_view entry_point, ShaderStage stage);
-	void create_named_pipeline(ph::PipelineCreateInfo pci);
-	void create_named_pipeline(ph::ComputePipelineCreateInfo pci);
+	PipelineId create_named_pipeline(ph::PipelineCreateInfo pci);
+	PipelineId create_named_pipeline(ph::ComputePipelineCreateInfo pci);
+	PipelineId get_pipeline_id(std::string_view name);
+	PipelineId get_compute_pipeline_id(std::string_view name);
 	void reflect_shaders(ph::PipelineCreateInfo& pci);
 	void reflect_shaders(ph::ComputePipelineCreateInfo& pci);
 	ShaderMeta const& get_shader_meta(ph::Pipeline const& pipeline);
 	VkSampler basic_sampler();
+	// Writes the pipeline cache to AppSettings::pipeline_cache_path. This is done automatically on shutdown, 
+	// but calling it after creating your pipelines makes sure the work is not lost if the application does not exit cleanly.
+	void save_pipeline_cache();
+	// Returns descriptor pool usage of the most recently completed frame.
+	DescriptorPoolStats get_descriptor_pool_stats();
+	// Returns eviction and recreation counts of every cache, to tune CacheSettings against objects that are recreated over and over.
+	CacheStatistics get_cache_stats();
+	// Returns nullptr if the bindless heap was not enabled in AppSettings.
+	BindlessHeap* get_bindless_heap();
 
 #if PHOBOS_ENABLE_RAY_TRACING
 	void create_named_pipeline(ph::RayTracingPipelineCreateInfo pci);
@@ -409,13 +489,36 @@ private:
 	VkFramebuffer get_or_create(VkFramebufferCreateInfo const& info, std::string const& name = "");
 	VkRenderPass get_or_create(VkRenderPassCreateInfo const& info, std::string const& name = "");
 	VkDescriptorSetLayout get_or_create(DescriptorSetLayoutCreateInfo const& dslci);
-	PipelineLayout get_or_create(PipelineLayoutCreateInfo const& plci, VkDescriptorSetLayout set_layout);
+	PipelineLayout get_or_create(PipelineLayoutCreateInfo const& plci);
 	Pipeline get_or_create_pipeline(std::string_view name, VkRenderPass render_pass);
 	Pipeline get_or_create_compute_pipeline(std::string_view name);
 #if PHOBOS_ENABLE_RAY_TRACING
 	Pipeline get_or_create_ray_tracing_pipeline(std::string_view name);
 #endif
-	VkDescriptorSet get_or_create(DescriptorSetBinding const& set_binding, Pipeline const& pipeline, void* pNext = nullptr);
+	// These do not block on pipeline compilation. If the pipeline is not compiled yet, a background compile is started and std::nullopt is returned.
+	std::optional<Pipeline> get_pipeline_if_ready(std::string_view name, VkRenderPass render_pass);
+	std::optional<Pipeline> get_compute_pipeline_if_ready(std::string_view name);
+	Pipeline get_or_create_pipeline(PipelineId id, VkRenderPass render_pass);
+	Pipeline get_or_create_compute_pipeline(PipelineId id);
+	std::optional<Pipeline> get_pipeline_if_ready(PipelineId id, VkRenderPass render_pass);
+	// Dynamic rendering variants, the pipeline is compiled against the attachment formats instead of a render pass.
+	Pipeline get_or_create_pipeline(PipelineId id, RenderingFormats const& formats);
+	std::optional<Pipeline> get_pipeline_if_ready(PipelineId id, RenderingFormats const& formats);
+	std::optional<Pipeline> get_compute_pipeline_if_ready(PipelineId id);
+	// Incremented every time the pipeline is redefined with create_named_pipeline(), so resolved pipelines can be invalidated.
+	uint32_t get_pipeline_version(PipelineId id);
+	uint32_t get_compute_pipeline_version(PipelineId id);
+	VkDescriptorSet get_or_create(DescriptorSetBinding const& set_binding, Pipeline const& pipeline, uint32_t set_index = 0, void* pNext = nullptr, uint32_t thread_index = main_thread_index,
+		DescriptorLifetime lifetime = DescriptorLifetime::Frame);
+	// Records the descriptors directly into the command buffer. Set set_index of the pipeline must be a push descriptor set.
+	void push_descriptor_set(VkCommandBuffer cmd_buf, DescriptorSetBinding const& set_binding, Pipeline const& pipeline, uint32_t set_index);
+	// Record vkCmdBeginRenderingKHR and vkCmdEndRenderingKHR. Dynamic rendering must be enabled in AppSettings.
+	void begin_rendering(VkCommandBuffer cmd_buf, VkRenderingInfoKHR const& info);
+	void end_rendering(VkCommandBuffer cmd_buf);
+	// Record vkCmdPipelineBarrier2KHR and submit with vkQueueSubmit2KHR. Synchronization2 must be enabled in AppSettings.
+	void pipeline_barrier2(VkCommandBuffer cmd_buf, VkDependencyInfoKHR const& info);
+	void queue_submit2(VkQueue queue, VkSubmitInfo2KHR const& info, VkFence fence);
+	TransientMemoryStats alias_transient_attachments(std::vector<TransientAttachmentUsage>& usages);
 
 	ShaderMeta const& get_shader_meta(std::string_view pipeline_name);
 	ShaderMeta const& get_compute_shader_meta(std::string_view pipeline_name);
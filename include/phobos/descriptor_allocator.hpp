@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <unordered_map>
+
+namespace ph {
+
+struct DescriptorPoolStats {
+	// Amount of descriptor pools that had at least one set allocated from them.
+	uint32_t pools_in_use = 0;
+	// Total amount of descriptor pools, including pools that are currently unused.
+	uint32_t pool_count = 0;
+	// Amount of descriptor sets allocated since the last reset.
+	uint32_t sets_allocated = 0;
+	// Amount of pools destroyed by reset() to get back within the pool budget, over the lifetime of the allocator.
+	uint64_t pools_evicted = 0;
+	// Amount of pools created to replace evicted pools, over the lifetime of the allocator.
+	uint64_t pools_recreated = 0;
+};
+
+// Allocates descriptor sets from a chain of descriptor pools. When a pool is exhausted, the next pool in the chain is used,
+// and a new pool is created if there is none. Sets are never freed individually, instead all pools are reset at once with reset().
+class DescriptorPoolAllocator {
+public:
+	DescriptorPoolAllocator() = default;
+	DescriptorPoolAllocator(VkDevice device, uint32_t sets_per_pool);
+	DescriptorPoolAllocator(DescriptorPoolAllocator&& rhs) noexcept;
+
+	~DescriptorPoolAllocator();
+
+	DescriptorPoolAllocator& operator=(DescriptorPoolAllocator&& rhs) noexcept;
+
+	// layout_sizes holds the amount of descriptors of each type in the set layout. These are used to size new pools
+	// after the layouts that are actually allocated. Returns nullptr if allocation failed.
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout, std::vector<VkDescriptorPoolSize> const& layout_sizes, void* pNext = nullptr);
+
+	// Resets all pools, freeing every set allocated from this allocator. None of these sets may still be in use by the GPU.
+	// If max_pools is nonzero, pools beyond the first max_pools are destroyed once they went unused for idle_resets_before_trim resets.
+	void reset(uint32_t max_pools = 0);
+
+	// A few frames that need more pools than the budget allows should not destroy and recreate those pools every frame.
+	static constexpr uint32_t idle_resets_before_trim = 16;
+
+	DescriptorPoolStats get_stats() const;
+private:
+	VkDevice device = nullptr;
+	uint32_t sets_per_pool = 0;
+
+	std::vector<VkDescriptorPool> pools;
+	// For every pool, the amount of resets since a set was last allocated from it.
+	std::vector<uint32_t> idle_resets;
+	// Index of the pool we are currently allocating from
+	size_t current_pool = 0;
+	uint32_t sets_allocated = 0;
+	uint64_t pools_evicted = 0;
+	uint64_t pools_recreated = 0;
+
+	// Total amount of sets and descriptors allocated over the lifetime of the allocator. New pools are sized after the average set.
+	uint64_t total_sets = 0;
+	std::unordered_map<VkDescriptorType, uint64_t> total_descriptors;
+
+	VkDescriptorPool create_pool(std::vector<VkDescriptorPoolSize> const& layout_sizes);
+	void destroy_pools();
+};
+
+}
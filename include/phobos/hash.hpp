@@ -2,6 +2,11 @@
 
 #include <functional>
 #include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <type_traits>
 
 #include <vulkan/vulkan.h>
 
@@ -10,19 +15,155 @@
 
 namespace ph {
 
-// Credits for this hash_cobmine go to martty
+namespace detail {
+
+constexpr uint64_t wyhash_secret[4] = { 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull };
+
+// Full 64x64 -> 128 bit multiply, a receives the low and b the high half.
+inline void wyhash_mum(uint64_t& a, uint64_t& b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t const r = static_cast<__uint128_t>(a) * b;
+    a = static_cast<uint64_t>(r);
+    b = static_cast<uint64_t>(r >> 64);
+#else
+    uint64_t const ha = a >> 32, hb = b >> 32, la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+    uint64_t const rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t const t = rl + (rm0 << 32);
+    uint64_t carry = t < rl;
+    uint64_t const lo = t + (rm1 << 32);
+    carry += lo < t;
+    a = lo;
+    b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
+
+inline uint64_t wyhash_mix(uint64_t a, uint64_t b) {
+    wyhash_mum(a, b);
+    return a ^ b;
+}
+
+inline uint64_t wyhash_read8(unsigned char const* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint64_t wyhash_read4(unsigned char const* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+}
+
+// Hashes a range of bytes with wyhash (final version 4). This is much faster than combining the hashes of single fields,
+// and mixes short keys well enough that similar keys do not end up in neighbouring cache slots.
+inline size_t hash_bytes(void const* data, size_t size, uint64_t seed = 0) {
+    using namespace detail;
+    unsigned char const* p = static_cast<unsigned char const*>(data);
+    seed ^= wyhash_mix(seed ^ wyhash_secret[0], wyhash_secret[1]);
+    uint64_t a = 0, b = 0;
+    if (size <= 16) {
+        if (size >= 4) {
+            a = (wyhash_read4(p) << 32) | wyhash_read4(p + ((size >> 3) << 2));
+            b = (wyhash_read4(p + size - 4) << 32) | wyhash_read4(p + size - 4 - ((size >> 3) << 2));
+        }
+        else if (size > 0) {
+            a = (uint64_t(p[0]) << 16) | (uint64_t(p[size >> 1]) << 8) | p[size - 1];
+        }
+    }
+    else {
+        size_t i = size;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wyhash_mix(wyhash_read8(p) ^ wyhash_secret[1], wyhash_read8(p + 8) ^ seed);
+                see1 = wyhash_mix(wyhash_read8(p + 16) ^ wyhash_secret[2], wyhash_read8(p + 24) ^ see1);
+                see2 = wyhash_mix(wyhash_read8(p + 32) ^ wyhash_secret[3], wyhash_read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wyhash_mix(wyhash_read8(p) ^ wyhash_secret[1], wyhash_read8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wyhash_read8(p + i - 16);
+        b = wyhash_read8(p + i - 8);
+    }
+    a ^= wyhash_secret[1];
+    b ^= seed;
+    wyhash_mum(a, b);
+    return static_cast<size_t>(wyhash_mix(a ^ wyhash_secret[0] ^ size, b ^ wyhash_secret[1]));
+}
+
+// Mixes the hash of every value into seed. The order of the values matters.
 template <typename T>
 inline void hash_combine(size_t& seed, const T& v) {
     std::hash<T> hasher;
-    seed ^= hasher(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    seed = static_cast<size_t>(detail::wyhash_mix(seed ^ detail::wyhash_secret[0], hasher(v) ^ detail::wyhash_secret[1]));
 }
 template <typename T, typename... Rest>
 inline void hash_combine(size_t& seed, const T& v, Rest const&... rest) {
-    std::hash<T> hasher;
-    seed ^= hasher(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    hash_combine(seed, v);
     hash_combine(seed, rest...);
 }
 
+// Types that may be hashed as raw bytes. This is only valid if equal values always have identical bytes,
+// so it is limited to scalars and Vulkan structs made of integers and enums only.
+template<typename T>
+struct is_bytewise_hashable : std::bool_constant<std::is_integral_v<T> || std::is_enum_v<T> || std::is_pointer_v<T>> {};
+
+template<> struct is_bytewise_hashable<VkAttachmentDescription> : std::true_type {};
+template<> struct is_bytewise_hashable<VkAttachmentReference> : std::true_type {};
+template<> struct is_bytewise_hashable<VkSubpassDependency> : std::true_type {};
+template<> struct is_bytewise_hashable<VkPushConstantRange> : std::true_type {};
+template<> struct is_bytewise_hashable<VkVertexInputBindingDescription> : std::true_type {};
+template<> struct is_bytewise_hashable<VkVertexInputAttributeDescription> : std::true_type {};
+template<> struct is_bytewise_hashable<VkStencilOpState> : std::true_type {};
+template<> struct is_bytewise_hashable<VkPipelineColorBlendAttachmentState> : std::true_type {};
+template<> struct is_bytewise_hashable<VkRect2D> : std::true_type {};
+
+// Mixes the hash of count values into seed. Bytewise hashable types are hashed as one packed byte range.
+template<typename T>
+inline void hash_range(size_t& seed, T const* data, size_t count) {
+    if constexpr (is_bytewise_hashable<T>::value) {
+        static_assert(std::has_unique_object_representations_v<T>, "Bytewise hashed type has padding");
+        hash_combine(seed, count, data ? hash_bytes(data, count * sizeof(T)) : size_t{ 0 });
+    }
+    else {
+        hash_combine(seed, count);
+        for (size_t i = 0; i < count; ++i) {
+            hash_combine(seed, data[i]);
+        }
+    }
+}
+
+// Hashes the listed members of x as one packed byte range. Listing the members at compile time keeps sType, pNext,
+// pointers and padding out of the hash, without hashing every field on its own.
+// Example: hash_members<&VkRect2D::offset, &VkRect2D::extent>(rect)
+template<auto... Members, typename T>
+inline size_t hash_members(T const& x) {
+    constexpr size_t size = (sizeof(x.*Members) + ...);
+    unsigned char packed[size];
+    unsigned char* out = packed;
+    ((std::memcpy(out, &(x.*Members), sizeof(x.*Members)), out += sizeof(x.*Members)), ...);
+    return hash_bytes(packed, size);
+}
+
+// Returns the attachment descriptions of an imageless framebuffer, or nullptr if the framebuffer is not imageless.
+inline VkFramebufferAttachmentsCreateInfo const* get_imageless_attachments(VkFramebufferCreateInfo const& info) {
+    if (!(info.flags & VK_FRAMEBUFFER_CREATE_IMAGELESS_BIT)) return nullptr;
+    for (auto const* next = static_cast<VkBaseInStructure const*>(info.pNext); next; next = next->pNext) {
+        if (next->sType == VK_STRUCTURE_TYPE_FRAMEBUFFER_ATTACHMENTS_CREATE_INFO) {
+            return reinterpret_cast<VkFramebufferAttachmentsCreateInfo const*>(next);
+        }
+    }
+    return nullptr;
+}
+
 template<typename E>
 constexpr auto to_integral(E e) -> typename std::underlying_type<E>::type {
     return static_cast<typename std::underlying_type<E>::type>(e);
@@ -36,9 +177,7 @@ template<typename T>
 struct hash<vector<T>> {
     size_t operator()(::std::vector<T> const& v) const noexcept {
         size_t h = 0;
-        for (auto const& elem : v) {
-            ph::hash_combine(h, elem);
-        }
+        ph::hash_range(h, v.data(), v.size());
         return h;
     }
 };
@@ -46,19 +185,14 @@ struct hash<vector<T>> {
 template<>
 struct hash<VkAttachmentDescription> {
     size_t operator()(VkAttachmentDescription const& x) const noexcept {
-        size_t h = 0;
-        ph::hash_combine(h, x.flags, x.initialLayout, x.finalLayout, x.format, x.loadOp,
-            x.stencilLoadOp, x.storeOp, x.stencilStoreOp, x.samples);
-        return h;
+        return ph::hash_bytes(&x, sizeof(x));
     }
 };
 
 template<>
 struct hash<VkAttachmentReference> {
     size_t operator()(VkAttachmentReference const& x) const noexcept {
-        size_t h = 0;
-        ph::hash_combine(h, x.attachment, x.layout);
-        return h;
+        return ph::hash_bytes(&x, sizeof(x));
     }
 };
 
@@ -66,12 +200,12 @@ template<>
 struct hash<VkSubpassDescription> {
     size_t operator()(VkSubpassDescription const& x) const noexcept {
         size_t h = 0;
-        for (size_t i = 0; i < x.colorAttachmentCount; ++i) {
-            ph::hash_combine(h, x.pColorAttachments[i]);
-        }
-        if (x.pDepthStencilAttachment) {
-            ph::hash_combine(h, *x.pDepthStencilAttachment);
-        }
+        ph::hash_combine(h, x.flags, x.pipelineBindPoint);
+        ph::hash_range(h, x.pInputAttachments, x.inputAttachmentCount);
+        ph::hash_range(h, x.pColorAttachments, x.colorAttachmentCount);
+        ph::hash_range(h, x.pResolveAttachments, x.pResolveAttachments ? x.colorAttachmentCount : 0);
+        ph::hash_range(h, x.pDepthStencilAttachment, x.pDepthStencilAttachment ? 1 : 0);
+        ph::hash_range(h, x.pPreserveAttachments, x.preserveAttachmentCount);
         return h;
     }
 };
@@ -79,11 +213,7 @@ struct hash<VkSubpassDescription> {
 template<>
 struct hash<VkSubpassDependency> {
     size_t operator()(VkSubpassDependency const& x) const noexcept {
-        size_t h = 0;
-        ph::hash_combine(h, x.srcSubpass, x.dstSubpass,
-            x.srcAccessMask, x.dstAccessMask,
-           x.srcStageMask, x.dstStageMask);
-        return h;
+        return ph::hash_bytes(&x, sizeof(x));
     }
 };
 
@@ -91,15 +221,10 @@ template<>
 struct hash<VkRenderPassCreateInfo> {
     size_t operator()(VkRenderPassCreateInfo const& info) const noexcept {
         size_t h = 0;
-        for (size_t i = 0; i < info.attachmentCount; ++i) {
-            ph::hash_combine(h, info.pAttachments[i]);
-        }
-        for (size_t i = 0; i < info.subpassCount; ++i) {
-            ph::hash_combine(h, info.pSubpasses[i]);
-        }
-        for (size_t i = 0; i < info.dependencyCount; ++i) {
-            ph::hash_combine(h, info.pDependencies[i]);
-        }
+        ph::hash_combine(h, info.flags);
+        ph::hash_range(h, info.pAttachments, info.attachmentCount);
+        ph::hash_range(h, info.pSubpasses, info.subpassCount);
+        ph::hash_range(h, info.pDependencies, info.dependencyCount);
         return h;
     }
 };
@@ -107,17 +232,23 @@ struct hash<VkRenderPassCreateInfo> {
 template<>
 struct hash<VkRenderPass> {
     size_t operator()(VkRenderPass const& pass) const noexcept {
-        size_t h = 0;
-        ph::hash_combine(h, reinterpret_cast<uint64_t>(pass));
-        return h;
+        return ph::hash_bytes(&pass, sizeof(pass));
     }
 };
 
 template<>
 struct hash<VkImageView> {
     size_t operator()(VkImageView const& view) const noexcept {
-        size_t h = 0;
-        ph::hash_combine(h, reinterpret_cast<uint64_t>(view));
+        return ph::hash_bytes(&view, sizeof(view));
+    }
+};
+
+template<>
+struct hash<VkFramebufferAttachmentImageInfo> {
+    size_t operator()(VkFramebufferAttachmentImageInfo const& x) const noexcept {
+        using T = VkFramebufferAttachmentImageInfo;
+        size_t h = ph::hash_members<&T::flags, &T::usage, &T::width, &T::height, &T::layerCount>(x);
+        ph::hash_range(h, x.pViewFormats, x.viewFormatCount);
         return h;
     }
 };
@@ -125,21 +256,25 @@ struct hash<VkImageView> {
 template<>
 struct hash<VkFramebufferCreateInfo> {
     size_t operator()(VkFramebufferCreateInfo const& info) const noexcept {
-        size_t h = 0;
-        ph::hash_combine(h, info.renderPass, info.width, info.height, info.layers);
-        for (size_t i = 0; i < info.attachmentCount; ++i) {
-            ph::hash_combine(h, info.pAttachments[i]);
+        size_t h = ph::hash_members<&VkFramebufferCreateInfo::flags, &VkFramebufferCreateInfo::renderPass,
+            &VkFramebufferCreateInfo::width, &VkFramebufferCreateInfo::height, &VkFramebufferCreateInfo::layers>(info);
+        // An imageless framebuffer has no views, only a description of the images it can be used with
+        if (VkFramebufferAttachmentsCreateInfo const* imageless = ph::get_imageless_attachments(info)) {
+            ph::hash_range(h, imageless->pAttachmentImageInfos, imageless->attachmentImageInfoCount);
+        }
+        else {
+            ph::hash_range(h, info.pAttachments, info.attachmentCount);
         }
-        // Flags aren't hashed ...
         return h;
     }
 };
 
+// Shader modules are keyed on their code and entry point. The code is hashed once by Context::create_shader.
 template<>
-struct hash<ph::PipelineCreateInfo> {
-    size_t operator()(ph::PipelineCreateInfo const& info) const noexcept {
+struct hash<ph::ShaderModuleCreateInfo> {
+    size_t operator()(ph::ShaderModuleCreateInfo const& x) const noexcept {
         size_t h = 0;
-        ph::hash_combine(h, info.name); // ?? TODO
+        ph::hash_combine(h, x.code_hash, x.entry_point);
         return h;
     }
 };
@@ -156,18 +291,95 @@ struct hash<ph::ShaderHandle> {
 template<>
 struct hash<VkPushConstantRange> {
     size_t operator()(VkPushConstantRange const& x) const noexcept {
-        size_t h = 0;
-        ph::hash_combine(h, x.size, x.offset, x.stageFlags);
+        return ph::hash_bytes(&x, sizeof(x));
+    }
+};
+
+template<>
+struct hash<VkVertexInputBindingDescription> {
+    size_t operator()(VkVertexInputBindingDescription const& x) const noexcept {
+        return ph::hash_bytes(&x, sizeof(x));
+    }
+};
+
+template<>
+struct hash<VkVertexInputAttributeDescription> {
+    size_t operator()(VkVertexInputAttributeDescription const& x) const noexcept {
+        return ph::hash_bytes(&x, sizeof(x));
+    }
+};
+
+template<>
+struct hash<VkPipelineInputAssemblyStateCreateInfo> {
+    size_t operator()(VkPipelineInputAssemblyStateCreateInfo const& x) const noexcept {
+        return ph::hash_members<&VkPipelineInputAssemblyStateCreateInfo::flags, &VkPipelineInputAssemblyStateCreateInfo::topology,
+            &VkPipelineInputAssemblyStateCreateInfo::primitiveRestartEnable>(x);
+    }
+};
+
+template<>
+struct hash<VkStencilOpState> {
+    size_t operator()(VkStencilOpState const& x) const noexcept {
+        return ph::hash_bytes(&x, sizeof(x));
+    }
+};
+
+template<>
+struct hash<VkPipelineDepthStencilStateCreateInfo> {
+    size_t operator()(VkPipelineDepthStencilStateCreateInfo const& x) const noexcept {
+        using T = VkPipelineDepthStencilStateCreateInfo;
+        return ph::hash_members<&T::flags, &T::depthTestEnable, &T::depthWriteEnable, &T::depthCompareOp, &T::depthBoundsTestEnable,
+            &T::stencilTestEnable, &T::front, &T::back, &T::minDepthBounds, &T::maxDepthBounds>(x);
+    }
+};
+
+template<>
+struct hash<VkPipelineRasterizationStateCreateInfo> {
+    size_t operator()(VkPipelineRasterizationStateCreateInfo const& x) const noexcept {
+        using T = VkPipelineRasterizationStateCreateInfo;
+        return ph::hash_members<&T::flags, &T::depthClampEnable, &T::rasterizerDiscardEnable, &T::polygonMode, &T::cullMode, &T::frontFace,
+            &T::depthBiasEnable, &T::depthBiasConstantFactor, &T::depthBiasClamp, &T::depthBiasSlopeFactor, &T::lineWidth>(x);
+    }
+};
+
+template<>
+struct hash<VkPipelineMultisampleStateCreateInfo> {
+    size_t operator()(VkPipelineMultisampleStateCreateInfo const& x) const noexcept {
+        using T = VkPipelineMultisampleStateCreateInfo;
+        size_t h = ph::hash_members<&T::flags, &T::rasterizationSamples, &T::sampleShadingEnable, &T::minSampleShading,
+            &T::alphaToCoverageEnable, &T::alphaToOneEnable>(x);
+        // The sample mask has one bit per sample, stored in 32-bit words
+        ph::hash_range(h, x.pSampleMask, x.pSampleMask ? (x.rasterizationSamples + 31) / 32 : 0);
         return h;
     }
 };
 
+template<>
+struct hash<VkPipelineColorBlendAttachmentState> {
+    size_t operator()(VkPipelineColorBlendAttachmentState const& x) const noexcept {
+        return ph::hash_bytes(&x, sizeof(x));
+    }
+};
+
+template<>
+struct hash<VkViewport> {
+    size_t operator()(VkViewport const& x) const noexcept {
+        return ph::hash_members<&VkViewport::x, &VkViewport::y, &VkViewport::width, &VkViewport::height,
+            &VkViewport::minDepth, &VkViewport::maxDepth>(x);
+    }
+};
+
+template<>
+struct hash<VkRect2D> {
+    size_t operator()(VkRect2D const& x) const noexcept {
+        return ph::hash_bytes(&x, sizeof(x));
+    }
+};
+
 template<>
 struct hash<VkSampler> {
     size_t operator()(VkSampler const& x) const noexcept {
-        size_t h = 0;
-        ph::hash_combine(h, reinterpret_cast<uint64_t>(x));
-        return h;
+        return ph::hash_bytes(&x, sizeof(x));
     }
 };
 
@@ -184,18 +396,14 @@ struct hash<ph::DescriptorImageInfo> {
 template<>
 struct hash<VkBuffer> {
     size_t operator()(VkBuffer const& x) const noexcept {
-        size_t h = 0;
-        ph::hash_combine(h, reinterpret_cast<uint64_t>((VkBuffer)x));
-        return h;
+        return ph::hash_bytes(&x, sizeof(x));
     }
 };
 
 template<>
 struct hash<ph::DescriptorBufferInfo> {
     size_t operator()(ph::DescriptorBufferInfo const& x) const noexcept {
-        size_t h = 0;
-        ph::hash_combine(h, x.buffer, (size_t)x.offset, (size_t)x.range);
-        return h;
+        return ph::hash_members<&ph::DescriptorBufferInfo::buffer, &ph::DescriptorBufferInfo::offset, &ph::DescriptorBufferInfo::range>(x);
     }
 };
 
@@ -238,7 +446,16 @@ template<>
 struct hash<ph::DescriptorSetBinding> {
     size_t operator()(ph::DescriptorSetBinding const& x) const noexcept {
         size_t h = 0;
-        ph::hash_combine(h, x.bindings, reinterpret_cast<uint64_t>(x.set_layout));
+        // DescriptorBuilder computes the same hash while the bindings are added
+        if (x.has_bindings_hash) {
+            h = x.bindings_hash;
+        }
+        else {
+            for (ph::DescriptorBinding const& binding : x.bindings) {
+                ph::hash_combine(h, binding);
+            }
+        }
+        ph::hash_combine(h, x.bindings.size(), reinterpret_cast<uint64_t>(x.set_layout));
         return h;
     }
 };
@@ -246,12 +463,10 @@ struct hash<ph::DescriptorSetBinding> {
 template<>
 struct hash<VkDescriptorSetLayoutBinding> {
     size_t operator()(VkDescriptorSetLayoutBinding const& x) const noexcept {
-        size_t h = 0;
-        ph::hash_combine(h, x.binding, x.descriptorCount, x.descriptorType, x.stageFlags);
+        size_t h = ph::hash_members<&VkDescriptorSetLayoutBinding::binding, &VkDescriptorSetLayoutBinding::descriptorCount,
+            &VkDescriptorSetLayoutBinding::descriptorType, &VkDescriptorSetLayoutBinding::stageFlags>(x);
         // Make sure to only do this when there are immmutable samplers
-        for (size_t i = 0; x.pImmutableSamplers && i < x.descriptorCount; ++i) {
-            ph::hash_combine(h, x.pImmutableSamplers[i]);
-        }
+        ph::hash_range(h, x.pImmutableSamplers, x.pImmutableSamplers ? x.descriptorCount : 0);
         return h;
     }
 };
@@ -260,7 +475,7 @@ template<>
 struct hash<ph::DescriptorSetLayoutCreateInfo> {
     size_t operator()(ph::DescriptorSetLayoutCreateInfo const& info) const noexcept {
         size_t h = 0;
-        ph::hash_combine(h, info.bindings, info.flags);
+        ph::hash_combine(h, info.bindings, info.flags, info.push_descriptor);
         return h;
     }
 };
@@ -269,7 +484,44 @@ template<>
 struct hash<ph::PipelineLayoutCreateInfo> {
     size_t operator()(ph::PipelineLayoutCreateInfo const& info) const noexcept {
         size_t h = 0;
-        ph::hash_combine(h, info.push_constants, info.set_layout);
+        ph::hash_combine(h, info.push_constants, info.set_layouts);
+        return h;
+    }
+};
+
+template<>
+struct hash<ph::BufferSlice> {
+    size_t operator()(ph::BufferSlice const& slice) const noexcept {
+        size_t h = 0;
+        ph::hash_combine(h, slice.buffer, slice.offset, slice.range);
+        return h;
+    }
+};
+
+template<>
+struct hash<ph::RenderingFormats> {
+    size_t operator()(ph::RenderingFormats const& formats) const noexcept {
+        size_t h = 0;
+        ph::hash_combine(h, formats.color_formats, formats.depth_format, formats.stencil_format);
+        return h;
+    }
+};
+
+// Hashes the full pipeline state. The name is included since pipelines are looked up by name, 
+// the render pass is not part of the create info and is handled by the pipeline cache.
+template<>
+struct hash<ph::PipelineCreateInfo> {
+    size_t operator()(ph::PipelineCreateInfo const& info) const noexcept {
+        size_t h = 0;
+        ph::hash_combine(h, info.name, info.layout, info.vertex_input_bindings, info.vertex_attributes, info.shaders,
+            info.input_assembly, info.depth_stencil, info.dynamic_states, info.rasterizer, info.multisample,
+            info.blend_attachments, info.blend_logic_op_enable);
+        // Viewports and scissors are ignored by the driver if they are dynamic, so they should not create a new variant either.
+        bool const dynamic_viewport = std::find(info.dynamic_states.begin(), info.dynamic_states.end(), VK_DYNAMIC_STATE_VIEWPORT) != info.dynamic_states.end();
+        bool const dynamic_scissor = std::find(info.dynamic_states.begin(), info.dynamic_states.end(), VK_DYNAMIC_STATE_SCISSOR) != info.dynamic_states.end();
+        ph::hash_combine(h, info.viewports.size(), info.scissors.size());
+        if (!dynamic_viewport) ph::hash_combine(h, info.viewports);
+        if (!dynamic_scissor) ph::hash_combine(h, info.scissors);
         return h;
     }
 };
@@ -278,17 +530,26 @@ template<>
 struct hash<ph::ComputePipelineCreateInfo> {
     size_t operator()(ph::ComputePipelineCreateInfo const& info) const noexcept {
         size_t h = 0;
-        ph::hash_combine(h, info.name);
+        ph::hash_combine(h, info.name, info.layout, info.shader);
         return h;
     }
 };
 
 #if PHOBOS_ENABLE_RAY_TRACING
+template<>
+struct hash<ph::RayTracingShaderGroup> {
+    size_t operator()(ph::RayTracingShaderGroup const& x) const noexcept {
+        size_t h = 0;
+        ph::hash_combine(h, x.type, x.general, x.closest_hit, x.any_hit, x.intersection);
+        return h;
+    }
+};
+
 template<>
 struct hash<ph::RayTracingPipelineCreateInfo> {
     size_t operator()(ph::RayTracingPipelineCreateInfo const& info) const noexcept {
         size_t h = 0;
-        ph::hash_combine(h, info.name);
+        ph::hash_combine(h, info.name, info.layout, info.shaders, info.shader_groups, info.max_recursion_depth);
         return h;
     }
 };
@@ -32,6 +32,9 @@ struct RawImage {
     VkImageLayout current_layout = VK_IMAGE_LAYOUT_UNDEFINED;
     VkImage handle = nullptr;
     VmaAllocation memory = nullptr;
+    // Usage and create flags the image was created with
+    VkImageUsageFlags usage{};
+    VkImageCreateFlags flags{};
 };
 
 struct ImageView {
@@ -16,6 +16,7 @@ public:
 	void create_attachment(std::string_view name, VkExtent2D size, VkFormat format, ImageType type);
     void create_attachment(std::string_view name, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, ImageType type);
     void create_attachment(std::string_view name, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, uint32_t layers, ImageType type);
+    void create_transient_attachment(std::string_view name, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, uint32_t layers, ImageType type);
 	void resize_attachment(std::string_view name, VkExtent2D new_size);
 	bool is_swapchain_attachment(std::string const& name);
 	bool is_attachment(ImageView view);
@@ -26,6 +27,11 @@ public:
 
 	// Called at the beginning of a frame by the frame implementation to set the swapchain attachment to point to the correct image view.
 	void new_frame(ImageView& swapchain_view);
+	// Places the transient attachments in usages in memory blocks, so that attachments with non-overlapping lifetimes share a block.
+	// Every set of usages gets its own placement, so graphs that use different transient attachments don't move each other's attachments.
+	// Attachments of an earlier placement that are not in usages get their own memory back.
+	// Images and views of transient attachments are recreated if the placement changes.
+	TransientMemoryStats alias_transient_attachments(std::vector<TransientAttachmentUsage>& usages);
 
 private:
 	ContextImpl* ctx;
@@ -37,6 +43,7 @@ private:
 	struct InternalAttachment {
 		ph::ImageView view;
 		std::optional<RawImage> image;
+		bool transient = false;
 	};
 	std::unordered_map<std::string, InternalAttachment> attachments{};
 
@@ -45,6 +52,40 @@ private:
 		uint32_t frames_left = 0;
 	};
 	std::vector<DeferredDelete> deferred_delete{};
+
+	// Memory shared by transient attachments
+	struct TransientBlock {
+		VmaAllocation memory = nullptr;
+		VkMemoryRequirements requirements{};
+		// Indices into the usages the block was created for.
+		std::vector<uint32_t> residents;
+	};
+
+	// A usage the transient attachments were placed for, so the placement is only redone if the usages change.
+	struct TransientPlacement {
+		std::string name;
+		uint32_t first_pass = 0;
+		uint32_t last_pass = 0;
+		std::optional<uint32_t> aliases = std::nullopt;
+	};
+
+	// The placement of the transient attachments used by one render graph. An attachment is in at most one group.
+	struct TransientGroup {
+		std::vector<TransientPlacement> usages;
+		std::vector<TransientBlock> blocks;
+		TransientMemoryStats stats{};
+	};
+	std::vector<TransientGroup> transient_groups{};
+
+	struct DeferredFree {
+		VmaAllocation memory = nullptr;
+		uint32_t frames_left = 0;
+	};
+	std::vector<DeferredFree> deferred_free{};
+
+	bool is_transient_placement_valid(TransientGroup const& group, std::vector<TransientAttachmentUsage> const& usages) const;
+	// Gives a transient attachment that was placed in a shared block a new image with its own memory.
+	void restore_own_memory(std::string const& name, InternalAttachment& attachment);
 };
 
 }
@@ -1,10 +1,180 @@
 #pragma once
 
 #include <phobos/context.hpp>
+#include <phobos/descriptor_allocator.hpp>
+
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+
+namespace ph {
+namespace impl {
+
+// Everything that decides whether a pipeline can be used with a render pass. Two render passes are compatible if their attachments have 
+// the same formats and sample counts, and the subpasses reference the same attachments. Load/store ops and image layouts are left out, 
+// see 'Render Pass Compatibility' in the vulkan spec. With dynamic rendering, only the attachment formats of the pass matter.
+struct RenderPassCompatibility {
+	struct Subpass {
+		std::vector<uint32_t> colors;
+		std::vector<uint32_t> inputs;
+		std::vector<uint32_t> resolves;
+		std::optional<uint32_t> depth_stencil;
+
+		bool operator==(Subpass const& rhs) const = default;
+	};
+
+	std::vector<VkFormat> formats;
+	std::vector<VkSampleCountFlagBits> samples;
+	std::vector<Subpass> subpasses;
+	// Only set for dynamic rendering, in which case the other members are empty.
+	std::optional<RenderingFormats> rendering_formats;
+	// Only set for a render pass that was not created through the cache. Such a render pass is only compatible with itself.
+	VkRenderPass foreign_render_pass = nullptr;
+	// Hash of all of the above, computed once on creation.
+	size_t hash = 0;
+
+	static RenderPassCompatibility from_render_pass(VkRenderPassCreateInfo const& info);
+	static RenderPassCompatibility from_formats(RenderingFormats const& formats);
+	static RenderPassCompatibility from_foreign_render_pass(VkRenderPass pass);
+
+	bool operator==(RenderPassCompatibility const& rhs) const = default;
+};
+
+// Graphics pipelines are compiled once for every render pass compatibility class they are used in, so render passes that 
+// only differ in things like load/store ops and layouts share pipelines.
+// This is the key used for lookups, the pipeline cache stores a copy of the pipeline state, see CacheKeyTraits<PipelineVariantKey>.
+struct PipelineVariantKey {
+	// Full pipeline state. Must outlive the key.
+	ph::PipelineCreateInfo const* state = nullptr;
+	// Hash of *state, see std::hash<ph::PipelineCreateInfo>
+	size_t state_hash = 0;
+	// Shared with the render pass, so building a key does not copy the compatibility data.
+	std::shared_ptr<RenderPassCompatibility const> compatibility;
+};
+
+// What a graphics pipeline is compiled against: a render pass, or the attachment formats of a pass recorded with dynamic rendering.
+struct PipelineTarget {
+	VkRenderPass render_pass = nullptr;
+	// Only used if render_pass is null
+	RenderingFormats formats{};
+};
+
+}
+
+// Stores the pipeline state and the compatibility data of the render pass, so a lookup only returns a pipeline if both are equal.
+template<>
+struct CacheKeyTraits<impl::PipelineVariantKey> {
+	struct stored_type {
+		// multisample.pSampleMask is cleared, since it points to memory owned by the caller. The mask is stored in sample_mask instead.
+		PipelineCreateInfo state;
+		std::vector<VkSampleMask> sample_mask;
+		std::shared_ptr<impl::RenderPassCompatibility const> compatibility;
+	};
+
+	static stored_type store(impl::PipelineVariantKey const& key) {
+		VkSampleMask const* mask = key.state->multisample.pSampleMask;
+		stored_type stored{
+			.state = *key.state,
+			.sample_mask = std::vector<VkSampleMask>(mask, mask + key_equal::sample_mask_words(key.state->multisample)),
+			.compatibility = key.compatibility
+		};
+		stored.state.multisample.pSampleMask = nullptr;
+		return stored;
+	}
+
+	static bool equal(stored_type const& stored, impl::PipelineVariantKey const& key) {
+		if (stored.compatibility != key.compatibility && *stored.compatibility != *key.compatibility) return false;
+		VkSampleMask const* mask = key.state->multisample.pSampleMask;
+		return key_equal::equal(stored.state, *key.state)
+			&& std::equal(stored.sample_mask.begin(), stored.sample_mask.end(), mask, mask + key_equal::sample_mask_words(key.state->multisample));
+	}
+};
+
+}
+
+namespace std {
+
+template<>
+struct hash<ph::impl::PipelineVariantKey> {
+	size_t operator()(ph::impl::PipelineVariantKey const& x) const noexcept {
+		size_t h = 0;
+		ph::hash_combine(h, x.state_hash, x.compatibility->hash);
+		return h;
+	}
+};
+
+}
 
 namespace ph {
 namespace impl {
 
+// A single descriptor in the data passed to vkUpdateDescriptorSetWithTemplate. Every template entry uses this as its stride.
+union DescriptorTemplateEntry {
+	VkDescriptorImageInfo image;
+	VkDescriptorBufferInfo buffer;
+#if PHOBOS_ENABLE_RAY_TRACING
+	VkAccelerationStructureKHR accel_structure;
+#endif
+};
+
+// Descriptor infos referenced by the VkWriteDescriptorSet structures of a single binding.
+struct DescriptorWriteInfo {
+	std::vector<VkDescriptorBufferInfo> buffer_infos;
+	std::vector<VkDescriptorImageInfo> image_infos;
+#if PHOBOS_ENABLE_RAY_TRACING
+	std::vector<VkWriteDescriptorSetAccelerationStructureKHR> accel_infos;
+#endif
+};
+
+// Descriptor sets and the pools they are allocated from, for a single thread index.
+struct DescriptorShard {
+	Cache<DescriptorSetBinding, VkDescriptorSet> sets;
+	DescriptorPoolAllocator allocator;
+	// Reused between descriptor set writes so the update template data does not need a new allocation every time.
+	std::vector<DescriptorTemplateEntry> template_data;
+};
+
+// A pipeline that is being compiled, either queued for the compile workers or claimed by a thread that compiles it itself.
+struct CompileClaim {
+	// A queued compile that was not started yet can be taken over by a thread that needs the pipeline right away.
+	bool started = false;
+	// Set once the pipeline is in the cache, or once the compile was dropped.
+	bool done = false;
+};
+
+// The pipelines of one kind that are being compiled. Keyed on the full pipeline key, so pipelines with the same hash never
+// wait on each other's compile. Only used with CacheImpl::compile_mutex held.
+template<typename Key>
+class CompileClaims {
+public:
+	// Returns null if no compile for this key is running or queued.
+	std::shared_ptr<CompileClaim> find(Key const& key) {
+		size_t const hash = std::hash<Key>{}(key);
+		std::erase_if(claims, [](Entry const& entry) { return entry.claim->done; });
+		for (Entry const& entry : claims) {
+			if (entry.hash == hash && CacheKeyTraits<Key>::equal(entry.key, key)) return entry.claim;
+		}
+		return nullptr;
+	}
+
+	// The key must not have a claim yet.
+	std::shared_ptr<CompileClaim> claim(Key const& key, bool started) {
+		std::shared_ptr<CompileClaim> claim = std::make_shared<CompileClaim>(CompileClaim{ .started = started });
+		claims.push_back(Entry{ .hash = std::hash<Key>{}(key), .key = CacheKeyTraits<Key>::store(key), .claim = claim });
+		return claim;
+	}
+
+private:
+	struct Entry {
+		size_t hash = 0;
+		typename CacheKeyTraits<Key>::stored_type key;
+		std::shared_ptr<CompileClaim> claim;
+	};
+
+	std::vector<Entry> claims;
+};
+
 class CacheImpl {
 public:
 	CacheImpl(Context& ctx, AppSettings const& settings);
@@ -13,32 +183,157 @@ public:
 	VkFramebuffer get_or_create_framebuffer(VkFramebufferCreateInfo const& info, std::string const& name = "");
 	VkRenderPass get_or_create_renderpass(VkRenderPassCreateInfo const& info, std::string const& name = "");
 	VkDescriptorSetLayout get_or_create_descriptor_set_layout(DescriptorSetLayoutCreateInfo const& dslci);
-	PipelineLayout get_or_create_pipeline_layout(PipelineLayoutCreateInfo const& plci, VkDescriptorSetLayout set_layout);
-	Pipeline get_or_create_pipeline(ph::PipelineCreateInfo& pci, VkRenderPass render_pass);
-	Pipeline get_or_create_compute_pipeline(ph::ComputePipelineCreateInfo& pci);
+	// Also creates the set layouts of every set in the pipeline layout.
+	PipelineLayout get_or_create_pipeline_layout(PipelineLayoutCreateInfo const& plci);
+	// state_hash must be std::hash<ph::PipelineCreateInfo> of pci, named pipelines store it precomputed, see NamedPipeline.
+	Pipeline get_or_create_pipeline(ph::PipelineCreateInfo const& pci, size_t state_hash, PipelineTarget const& target);
+	Pipeline get_or_create_compute_pipeline(ph::ComputePipelineCreateInfo const& pci);
 #if PHOBOS_ENABLE_RAY_TRACING
 	Pipeline get_or_create_ray_tracing_pipeline(ph::RayTracingPipelineCreateInfo& pci);
 #endif
-	VkDescriptorSet get_or_create_descriptor_set(DescriptorSetBinding const& set_binding, Pipeline const& pipeline, void* pNext = nullptr);
+	// Sets are allocated from and cached in the shard of thread_index, so this can be called concurrently with different thread indices.
+	VkDescriptorSet get_or_create_descriptor_set(DescriptorSetBinding const& set_binding, Pipeline const& pipeline, uint32_t set_index, void* pNext = nullptr, uint32_t thread_index = main_thread_index,
+		DescriptorLifetime lifetime = DescriptorLifetime::Frame);
+	VkShaderModule get_or_create_shader_module(ph::ShaderModuleCreateInfo const& info);
+	// Records the descriptors into the command buffer with vkCmdPushDescriptorSetKHR. No descriptor set is allocated or cached.
+	void push_descriptor_set(VkCommandBuffer cmd_buf, DescriptorSetBinding const& set_binding, Pipeline const& pipeline, uint32_t set_index);
+
+	// Returns std::nullopt and queues a background compile if the pipeline is not in the cache yet.
+	std::optional<Pipeline> get_pipeline_if_ready(ph::PipelineCreateInfo const& pci, size_t state_hash, PipelineTarget const& target);
+	std::optional<Pipeline> get_compute_pipeline_if_ready(ph::ComputePipelineCreateInfo const& pci);
+	// Queues a background compile if the pipeline is not in the cache yet and no compile for it is running.
+	void request_pipeline_compile(ph::PipelineCreateInfo const& pci, size_t state_hash, PipelineTarget const& target);
+	// Queues compiles for every render pass or format class the named pipeline was used with before. Used when a named pipeline is redefined.
+	void request_pipeline_variants(ph::PipelineCreateInfo const& pci, size_t state_hash);
+	void request_compute_pipeline_compile(ph::ComputePipelineCreateInfo const& pci);
+#if PHOBOS_ENABLE_RAY_TRACING
+	void request_ray_tracing_pipeline_compile(ph::RayTracingPipelineCreateInfo const& pci);
+#endif
 
 	void next_frame();
+	// Frees all descriptor sets of the current frame, in every shard. Must only be called once the frame's fence has been signaled.
+	void reset_frame_descriptor_sets();
+	// Frees all descriptor sets with DescriptorLifetime::Thread of this thread index. Called from Context::end_thread().
+	void reset_thread_descriptor_sets(uint32_t thread_index);
+	void save_pipeline_cache();
+	CacheStatistics get_stats();
 
 	Cache<VkFramebufferCreateInfo, VkFramebuffer> framebuffer;
 	Cache<VkRenderPassCreateInfo, VkRenderPass> renderpass;
 	Cache<ph::DescriptorSetLayoutCreateInfo, VkDescriptorSetLayout> set_layout;
 	Cache<ph::PipelineLayoutCreateInfo, ph::PipelineLayout> pipeline_layout;
-	Cache<ph::PipelineCreateInfo, ph::Pipeline> pipeline;
+	Cache<PipelineVariantKey, ph::Pipeline> pipeline;
 	Cache<ph::ComputePipelineCreateInfo, ph::Pipeline> compute_pipeline;
 #if PHOBOS_ENABLE_RAY_TRACING
 	Cache<ph::RayTracingPipelineCreateInfo, ph::Pipeline> rtx_pipeline{};
 #endif
 	Cache<ShaderHandle, ph::ShaderModuleCreateInfo> shader;
-	RingBuffer<Cache<DescriptorSetBinding, VkDescriptorSet>> descriptor_set{};
-
-	// TODO: automatically growing descriptor pool
-	static constexpr size_t sets_per_type = 1024;
-	VkDescriptorPool descr_pool = nullptr;
+	// Keyed on the code and entry point, so shader handles that only differ in stage share a module.
+	Cache<ph::ShaderModuleCreateInfo, VkShaderModule> shader_module;
+	// Descriptor sets only live for one frame. They are cached within that frame and freed in bulk when the frame is reused.
+	// Every frame has one shard per thread index, so recording threads do not contend with each other. The last shard belongs to 
+	// the main thread, like the main command pools of a Queue, see frame_shard_index().
+	RingBuffer<std::vector<DescriptorShard>> descriptor_shards{};
+	// Sets with DescriptorLifetime::Thread, one shard per thread index. These are not tied to a frame fence and are freed in end_thread().
+	std::vector<DescriptorShard> thread_descriptor_shards{};
+	static constexpr uint32_t sets_per_pool = 1024;
+	// Descriptor allocator statistics of the last frame that was completed, summed over all shards.
+	DescriptorPoolStats last_frame_descriptor_stats{};
+	// Null if the bindless heap is disabled. Its set layout is added to every pipeline layout at its set index.
+	std::unique_ptr<BindlessHeap> bindless_heap;
+	// Passed to every vkCreate*Pipelines call, persisted to pipeline_cache_path.
+	VkPipelineCache pipeline_cache = nullptr;
 private:
+	std::string pipeline_cache_path;
+	uint32_t max_descriptor_pools = 0;
+
+	// These create the pipeline without looking in the cache first and insert the result. They may be called from the compile workers.
+	// A precompiled pipeline is compiled before it is used. It is not evicted before its first use, and neither are its layouts.
+	Pipeline create_pipeline(ph::PipelineCreateInfo const& pci, PipelineTarget const& target, PipelineVariantKey const& key, bool precompiled);
+	Pipeline create_compute_pipeline(ph::ComputePipelineCreateInfo const& pci, bool precompiled);
+#if PHOBOS_ENABLE_RAY_TRACING
+	Pipeline create_ray_tracing_pipeline(ph::RayTracingPipelineCreateInfo const& pci, bool precompiled);
+#endif
+
+	// Looks up a pipeline and registers usage of its layouts. The first lookup of a precompiled pipeline unpins its layouts.
+	template<typename Key>
+	std::optional<Pipeline> find_pipeline(Cache<Key, ph::Pipeline>& cache, Key const& key, PipelineLayoutCreateInfo const& plci);
+
+	// Registers usage of the pipeline layout and all of its set layouts, so they are not evicted while the pipeline is in use.
+	void mark_layouts_used(PipelineLayoutCreateInfo const& plci);
+	void pin_layouts(PipelineLayoutCreateInfo const& plci);
+	void unpin_layouts(PipelineLayoutCreateInfo const& plci);
+	// Keeps the render pass from being evicted until the returned pin is destroyed. Compile jobs hold one for the render pass they compile against.
+	// Returns null for a null render pass.
+	std::shared_ptr<void> pin_render_pass(VkRenderPass pass);
+
+	// Index of the frame shard of a thread index. main_thread_index maps to the last shard.
+	size_t frame_shard_index(uint32_t thread_index) const;
+
+	void compile_worker();
+	// Queues the job unless the key already has a claim. The claim is released by the worker once the job ran.
+	template<typename Key>
+	void enqueue_compile(CompileClaims<Key>& claims, Key const& key, std::function<void()> job);
+	// Looks up the pipeline, or calls create to compile it on this thread. If a worker is already compiling the same pipeline, this
+	// waits for it instead. A compile that is still queued is taken out of the queue and done by this thread.
+	template<typename Key, typename Create>
+	Pipeline find_or_compile(Cache<Key, ph::Pipeline>& cache, CompileClaims<Key>& claims, Key const& key, PipelineLayoutCreateInfo const& plci, Create&& create);
+	// Marks the claim as done and wakes up threads waiting for it.
+	void release_compile(std::shared_ptr<CompileClaim> const& claim);
+
+	std::vector<std::thread> compile_workers;
+	std::deque<std::pair<std::shared_ptr<CompileClaim>, std::function<void()>>> compile_queue;
+	CompileClaims<PipelineVariantKey> graphics_compiles;
+	CompileClaims<ph::ComputePipelineCreateInfo> compute_compiles;
+#if PHOBOS_ENABLE_RAY_TRACING
+	CompileClaims<ph::RayTracingPipelineCreateInfo> rtx_compiles;
+#endif
+	std::mutex compile_mutex;
+	std::condition_variable compile_queue_cv;
+	std::condition_variable compile_done_cv;
+	bool stop_compile_workers = false;
+	// Set and pipeline layouts can be created from the compile workers as well.
+	std::mutex layout_mutex;
+	std::mutex shader_module_mutex;
+
+	// Everything needed to allocate and write descriptor sets with a given set layout.
+	struct SetLayoutInfo {
+		// Amount of descriptors of each type in the set layout, used to size descriptor pools.
+		std::vector<VkDescriptorPoolSize> sizes;
+		// The last binding in a layout can have a variable descriptor count, which is only known when allocating.
+		bool has_variable_count = false;
+		VkDescriptorType variable_count_type{};
+		// Writes all bindings in template_bindings at once. Null if the layout has bindings with a variable or partially bound descriptor count.
+		VkDescriptorUpdateTemplate update_template = nullptr;
+		// Sorted on binding number, the template reads the descriptors of each binding in this order.
+		std::vector<VkDescriptorSetLayoutBinding> template_bindings;
+		// Total amount of DescriptorTemplateEntry values the template reads
+		size_t template_descriptor_count = 0;
+		bool push_descriptor = false;
+	};
+	std::unordered_map<VkDescriptorSetLayout, SetLayoutInfo> set_layout_info;
+
+	// Returns false if the bindings do not match the layout's update template, in which case nothing was written.
+	bool write_descriptor_set_with_template(VkDescriptorSet set, DescriptorSetBinding const& set_binding, SetLayoutInfo const& layout_info, std::vector<DescriptorTemplateEntry>& data);
+	void write_descriptor_set(VkDescriptorSet set, DescriptorSetBinding const& set_binding);
+	// write_infos holds the descriptor infos the writes point to, so it must outlive the writes.
+	void fill_descriptor_writes(VkDescriptorSet set, DescriptorSetBinding const& set_binding, std::vector<VkWriteDescriptorSet>& writes, std::vector<DescriptorWriteInfo>& write_infos);
+	// Null if push descriptors are not enabled
+	PFN_vkCmdPushDescriptorSetKHR push_descriptor_fun = nullptr;
+
+	PipelineVariantKey get_variant_key(ph::PipelineCreateInfo const& pci, size_t state_hash, PipelineTarget const& target);
+
+	// Compatibility class of every render pass in the renderpass cache
+	std::unordered_map<VkRenderPass, std::shared_ptr<RenderPassCompatibility const>> renderpass_class;
+	// Amount of pins on each render pass, see pin_render_pass().
+	std::unordered_map<VkRenderPass, uint32_t> renderpass_pins;
+	// For every named graphics pipeline, one target for each compatibility class it was compiled for.
+	struct PipelineVariant {
+		std::shared_ptr<RenderPassCompatibility const> compatibility;
+		PipelineTarget target;
+	};
+	std::unordered_map<std::string, std::vector<PipelineVariant>> pipeline_variants;
+	std::mutex variant_mutex;
 
 	Context* ctx;
 };
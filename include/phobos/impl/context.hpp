@@ -16,6 +16,9 @@ public:
 
 	bool is_headless() const;
 	bool validation_enabled() const;
+	bool imageless_framebuffers_enabled() const;
+	bool dynamic_rendering_enabled() const;
+	bool synchronization2_enabled() const;
 	uint32_t thread_count() const;
 
 	Queue* get_queue(QueueType type);
@@ -67,6 +70,11 @@ public:
 
 	LogInterface* get_logger();
 
+	void begin_rendering(VkCommandBuffer cmd_buf, VkRenderingInfoKHR const& info);
+	void end_rendering(VkCommandBuffer cmd_buf);
+	void pipeline_barrier2(VkCommandBuffer cmd_buf, VkDependencyInfoKHR const& info);
+	void queue_submit2(VkQueue queue, VkSubmitInfo2KHR const& info, VkFence fence);
+
 	VkInstance instance = nullptr;
 	VkDevice device = nullptr;
 	VmaAllocator allocator = nullptr;
@@ -79,6 +87,9 @@ public:
 
 	uint32_t const max_unbounded_array_size = 0;
 	uint32_t const max_frames_in_flight = 0;
+	// Resources in bindless_set_index are skipped during shader reflection if this is true.
+	bool const has_bindless_heap = false;
+	uint32_t const bindless_set_index = 0;
 private:
 	friend class FrameImpl;
 
@@ -87,6 +98,15 @@ private:
 	PFN_vkSetDebugUtilsObjectNameEXT set_debug_utils_name_fun;
 	VkDebugUtilsMessengerEXT debug_messenger = nullptr;
 	bool const has_validation = false;
+	bool const has_imageless_framebuffers = false;
+	bool const has_dynamic_rendering = false;
+	// Null if dynamic rendering is not enabled
+	PFN_vkCmdBeginRenderingKHR begin_rendering_fun = nullptr;
+	PFN_vkCmdEndRenderingKHR end_rendering_fun = nullptr;
+	bool const has_synchronization2 = false;
+	// Null if synchronization2 is not enabled
+	PFN_vkCmdPipelineBarrier2KHR pipeline_barrier2_fun = nullptr;
+	PFN_vkQueueSubmit2KHR queue_submit2_fun = nullptr;
 
 	uint32_t const num_threads = 0;
 	std::vector<PerThreadContext> ptcs{};
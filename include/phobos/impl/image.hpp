@@ -17,6 +17,8 @@ public:
 	RawImage create_image(ImageType type, VkExtent2D size, VkFormat format, uint32_t mips = 1);
     RawImage create_image(ImageType type, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, uint32_t mips = 1);
     RawImage create_image(ImageType type, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, uint32_t mips, uint32_t layers);
+    // Creates the image without binding any memory to it. destroy_image() does not free memory that was bound to it later.
+    RawImage create_unbound_image(ImageType type, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, uint32_t mips, uint32_t layers);
 	void destroy_image(RawImage& image);
 
 	ImageView create_image_view(RawImage const& target, ImageAspect aspect = ImageAspect::Color);
@@ -31,6 +33,9 @@ public:
 private:
 	ContextImpl* ctx;
 
+	RawImage describe_image(ImageType type, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, uint32_t mips, uint32_t layers) const;
+	VkImageCreateInfo get_image_create_info(RawImage const& image) const;
+
 	mutable std::mutex mutex{};
 
 	/**
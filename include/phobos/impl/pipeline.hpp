@@ -2,8 +2,74 @@
 
 #include <phobos/context.hpp>
 
+#include <cassert>
+#include <memory>
+#include <shared_mutex>
+
 namespace ph {
 namespace impl {
+
+// A registered pipeline along with the hash of its full state, so the pipeline cache does not have to hash the whole state on every lookup.
+// This is computed once on insertion and can never go stale, since the create info is immutable.
+template<typename CreateInfo>
+struct NamedPipeline {
+	CreateInfo info;
+	size_t state_hash = 0;
+};
+
+// Named pipelines, interned so they can be looked up by PipelineId as well as by name.
+// Entries are immutable once inserted. Redefining a pipeline swaps in a new entry, so command buffers recording on
+// other threads keep a consistent create info for as long as they hold the pointer returned by get().
+template<typename CreateInfo>
+class NamedPipelineTable {
+public:
+	// Replaces the pipeline if one with the same name exists already, keeping its id.
+	PipelineId insert(CreateInfo&& info) {
+		std::string name = info.name;
+		size_t const state_hash = std::hash<CreateInfo>{}(info);
+		auto shared = std::make_shared<NamedPipeline<CreateInfo> const>(NamedPipeline<CreateInfo>{ .info = std::move(info), .state_hash = state_hash });
+		std::unique_lock lock(mutex);
+		auto it = ids.find(name);
+		if (it != ids.end()) {
+			Entry& entry = entries[it->second.index];
+			// Swap instead of assigning to the entry, the old create info is freed when its last reader lets go of it.
+			entry.info.swap(shared);
+			entry.version += 1;
+			return it->second;
+		}
+		PipelineId id{ static_cast<uint32_t>(entries.size()) };
+		ids.emplace(std::move(name), id);
+		entries.push_back(Entry{ .info = std::move(shared), .version = 0 });
+		return id;
+	}
+
+	PipelineId get_id(std::string_view name) const {
+		std::shared_lock lock(mutex);
+		return ids.at(std::string(name));
+	}
+
+	std::shared_ptr<NamedPipeline<CreateInfo> const> get(PipelineId id) const {
+		std::shared_lock lock(mutex);
+		assert(id.index < entries.size() && "Invalid pipeline id");
+		return entries[id.index].info;
+	}
+
+	uint32_t version(PipelineId id) const {
+		std::shared_lock lock(mutex);
+		assert(id.index < entries.size() && "Invalid pipeline id");
+		return entries[id.index].version;
+	}
+
+private:
+	struct Entry {
+		std::shared_ptr<NamedPipeline<CreateInfo> const> info;
+		uint32_t version = 0;
+	};
+
+	std::unordered_map<std::string, PipelineId> ids;
+	std::vector<Entry> entries;
+	mutable std::shared_mutex mutex;
+};
 	
 class PipelineImpl {
 public:
@@ -15,8 +81,10 @@ public:
 	ShaderHandle create_shader(std::string_view path, std::string_view entry_point, ShaderStage stage);
 	void reflect_shaders(ph::PipelineCreateInfo& pci);
 	void reflect_shaders(ph::ComputePipelineCreateInfo& pci);
-	void create_named_pipeline(ph::PipelineCreateInfo pci);
-	void create_named_pipeline(ph::ComputePipelineCreateInfo pci);
+	PipelineId create_named_pipeline(ph::PipelineCreateInfo pci);
+	PipelineId create_named_pipeline(ph::ComputePipelineCreateInfo pci);
+	PipelineId get_pipeline_id(std::string_view name) const;
+	PipelineId get_compute_pipeline_id(std::string_view name) const;
 
 	ShaderMeta const& get_shader_meta(std::string_view pipeline_name);
 	ShaderMeta const& get_compute_shader_meta(std::string_view pipeline_name);
@@ -32,8 +100,13 @@ public:
 	// PRIVATE API
 
 	VkSampler basic_sampler = nullptr;
-	ph::PipelineCreateInfo& get_pipeline(std::string_view name);
-	ph::ComputePipelineCreateInfo& get_compute_pipeline(std::string_view name);
+	// The returned pipeline stays valid while the pointer is held, even if it is redefined in the meantime.
+	std::shared_ptr<NamedPipeline<ph::PipelineCreateInfo> const> get_pipeline(std::string_view name);
+	std::shared_ptr<NamedPipeline<ph::ComputePipelineCreateInfo> const> get_compute_pipeline(std::string_view name);
+	std::shared_ptr<NamedPipeline<ph::PipelineCreateInfo> const> get_pipeline(PipelineId id);
+	std::shared_ptr<NamedPipeline<ph::ComputePipelineCreateInfo> const> get_compute_pipeline(PipelineId id);
+	uint32_t get_pipeline_version(PipelineId id) const;
+	uint32_t get_compute_pipeline_version(PipelineId id) const;
 #if PHOBOS_ENABLE_RAY_TRACING
 	ph::RayTracingPipelineCreateInfo& get_ray_tracing_pipeline(std::string_view name);
 #endif
@@ -43,8 +116,12 @@ private:
 	CacheImpl* cache;
 	BufferImpl* buffer;
 
-	std::unordered_map<std::string, ph::PipelineCreateInfo> pipelines{};
-	std::unordered_map<std::string, ph::ComputePipelineCreateInfo> compute_pipelines;
+	// Shaders with identical code, entry point and stage share one handle. Keyed on a hash of these, the shaders are compared on a match.
+	std::unordered_multimap<size_t, ShaderHandle> shaders_by_content;
+	std::mutex shader_mutex;
+
+	NamedPipelineTable<ph::PipelineCreateInfo> pipelines{};
+	NamedPipelineTable<ph::ComputePipelineCreateInfo> compute_pipelines{};
 #if PHOBOS_ENABLE_RAY_TRACING
 	std::unordered_map<std::string, ph::RayTracingPipelineCreateInfo> rtx_pipelines;
 #endif
@@ -24,7 +24,11 @@ struct AccelerationStructure;
 
 class Context;
 
-enum class PipelineStage {
+template<typename Key>
+struct CacheKeyTraits;
+
+// Values are VkPipelineStageFlags2KHR, which has the same value for every stage that also exists in VkPipelineStageFlags.
+enum class PipelineStage : uint64_t {
     AllCommands = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
     TopOfPipe = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
     Transfer = VK_PIPELINE_STAGE_TRANSFER_BIT,
@@ -40,9 +44,21 @@ enum class PipelineStage {
     AccelerationStructureBuild = VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
     RayTracingShader = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
 #endif
-    BottomOfPipe = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
+    BottomOfPipe = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+
+    // These stages only exist with synchronization2. Without it, they are widened to the stage that contains them.
+    Copy = VK_PIPELINE_STAGE_2_COPY_BIT_KHR,
+    Resolve = VK_PIPELINE_STAGE_2_RESOLVE_BIT_KHR,
+    Blit = VK_PIPELINE_STAGE_2_BLIT_BIT_KHR,
+    Clear = VK_PIPELINE_STAGE_2_CLEAR_BIT_KHR,
+    IndexInput = VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT_KHR,
+    VertexAttributeInput = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT_KHR,
+    PreRasterizationShaders = VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT_KHR
 };
 
+// Replaces the synchronization2 stages that have no equivalent in VkPipelineStageFlags with the legacy stages that contain them.
+VkPipelineStageFlags get_legacy_stage_flags(VkPipelineStageFlags2KHR stages);
+
 enum class ShaderStage {
     Vertex = VK_SHADER_STAGE_VERTEX_BIT,
     Fragment = VK_SHADER_STAGE_FRAGMENT_BIT,
@@ -107,6 +123,9 @@ struct DescriptorSetLayoutCreateInfo {
     std::vector<VkDescriptorSetLayoutBinding> bindings;
     // Optional. Leave empty to use default flags
     std::vector<VkDescriptorBindingFlags> flags;
+    // Creates the layout with VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR. Sets with this layout are never allocated,
+    // their descriptors are pushed with CommandBuffer::push_descriptors() instead.
+    bool push_descriptor = false;
 };
 
 struct DescriptorSetBinding {
@@ -119,18 +138,37 @@ struct DescriptorSetBinding {
     VkDescriptorPool pool = nullptr;
 private:
     friend class impl::CacheImpl;
+    friend class DescriptorBuilder;
     friend struct std::hash<DescriptorSetBinding>;
+    friend struct CacheKeyTraits<DescriptorSetBinding>;
     VkDescriptorSetLayout set_layout = nullptr;
+    // Hash of bindings, computed by DescriptorBuilder while the bindings are added. If bindings is changed afterwards,
+    // the set is hashed as if it was not changed, which can only cause extra cache misses.
+    size_t bindings_hash = 0;
+    bool has_bindings_hash = false;
 };
 
 struct PipelineLayoutCreateInfo {
-    DescriptorSetLayoutCreateInfo set_layout;
+    // One set layout for every descriptor set index, as declared with layout(set = N) in the shaders.
+    std::vector<DescriptorSetLayoutCreateInfo> set_layouts;
     std::vector<VkPushConstantRange> push_constants;
 };
 
 struct PipelineLayout {
     VkPipelineLayout handle = nullptr;
-    VkDescriptorSetLayout set_layout = nullptr;
+    // Indexed by descriptor set index
+    std::vector<VkDescriptorSetLayout> set_layouts;
+};
+
+// Interned name of a pipeline, returned by Context::create_named_pipeline(). Binding a pipeline by id avoids looking up its name.
+// Graphics and compute pipelines have separate ids. The id stays the same when a pipeline with the same name is created again.
+struct PipelineId {
+    static constexpr uint32_t none = static_cast<uint32_t>(-1);
+
+    uint32_t index = none;
+
+    inline bool operator==(PipelineId const& rhs) const { return index == rhs.index; }
+    inline bool operator!=(PipelineId const& rhs) const { return index != rhs.index; }
 };
 
 struct Pipeline {
@@ -145,11 +183,19 @@ struct ShaderModuleCreateInfo {
     std::vector<uint32_t> code;
     std::string entry_point;
     ShaderStage stage;
+    // Hash of the SPIR-V code, filled in by Context::create_shader. Used to look up the shader module, together with the entry point.
+    size_t code_hash = 0;
 };
 
 struct PipelineCreateInfo {
     std::string name{};
     PipelineLayoutCreateInfo layout;
+    // Names of uniform and storage buffers that are reflected as dynamic buffers. Their offset is supplied when binding the descriptor set,
+    // so one descriptor set can be shared by every slice of the same buffer.
+    std::vector<std::string> dynamic_buffers{};
+    // If set, this set index is reflected as a push descriptor set. Requires AppSettings::enable_push_descriptors.
+    // Must be set before reflect().
+    std::optional<uint32_t> push_descriptor_set = std::nullopt;
 
     ShaderMeta meta{};
 
@@ -218,9 +264,25 @@ struct PipelineCreateInfo {
     bool blend_logic_op_enable = false;
 };
 
+// Attachment formats of a pass recorded with dynamic rendering. Graphics pipelines used in such a pass are compiled against these
+// formats instead of a render pass, see AppSettings::enable_dynamic_rendering.
+struct RenderingFormats {
+    std::vector<VkFormat> color_formats;
+    VkFormat depth_format = VK_FORMAT_UNDEFINED;
+    VkFormat stencil_format = VK_FORMAT_UNDEFINED;
+
+    bool operator==(RenderingFormats const& rhs) const = default;
+};
+
 struct ComputePipelineCreateInfo {
     std::string name{};
     PipelineLayoutCreateInfo layout{};
+    // Names of uniform and storage buffers that are reflected as dynamic buffers. Their offset is supplied when binding the descriptor set,
+    // so one descriptor set can be shared by every slice of the same buffer.
+    std::vector<std::string> dynamic_buffers{};
+    // If set, this set index is reflected as a push descriptor set. Requires AppSettings::enable_push_descriptors.
+    // Must be set before reflect().
+    std::optional<uint32_t> push_descriptor_set = std::nullopt;
     ShaderHandle shader;
 
     ShaderMeta meta{};
@@ -248,6 +310,9 @@ struct RayTracingShaderGroup {
 struct RayTracingPipelineCreateInfo {
     std::string name{};
     PipelineLayoutCreateInfo layout{};
+    // Names of uniform and storage buffers that are reflected as dynamic buffers. Their offset is supplied when binding the descriptor set,
+    // so one descriptor set can be shared by every slice of the same buffer.
+    std::vector<std::string> dynamic_buffers{};
 
     std::vector<ShaderHandle> shaders{};
     std::vector<RayTracingShaderGroup> shader_groups{};
@@ -285,9 +350,28 @@ struct ShaderBindingTable {
 
 #endif
 
+// Thread index of the main thread for descriptor sets. The main thread has its own descriptor pools and set cache,
+// so it never shares them with the thread indices passed to Context::begin_thread().
+inline constexpr uint32_t main_thread_index = 0xFFFFFFFF;
+
+// How long a descriptor set allocated by DescriptorBuilder::get() stays valid.
+enum class DescriptorLifetime {
+    // Freed when its frame is reused, which only waits on the fence of that frame. Only use this for sets that are
+    // used by command buffers submitted with Context::submit_frame_commands().
+    Frame,
+    // Freed in Context::end_thread() of the thread index. Use this for sets used by work that is synchronized with its own fence,
+    // like async compute submits, and only call end_thread() after that fence was signaled.
+    Thread
+};
+
 class DescriptorBuilder {
 public:
-    static DescriptorBuilder create(Context& ctx, Pipeline const& pipeline);
+    // set_index is the descriptor set to build, as declared with layout(set = N) in the shaders. Bindings added by name must be in this set.
+    // thread_index selects the descriptor pools and set cache to use. Like with Context::begin_thread(), 
+    // two threads must not use the same thread index at the same time. Leave it at main_thread_index on the main thread.
+    // Sets are frame sets by default, see DescriptorLifetime. Sets from a custom DescriptorSetBinding::pool are never freed by phobos.
+    static DescriptorBuilder create(Context& ctx, Pipeline const& pipeline, uint32_t set_index = 0, uint32_t thread_index = main_thread_index,
+                                    DescriptorLifetime lifetime = DescriptorLifetime::Frame);
 
     DescriptorBuilder& add_sampled_image(uint32_t binding, ImageView view, VkSampler sampler, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     DescriptorBuilder& add_sampled_image(ShaderMeta::Binding const& binding, ImageView view, VkSampler sampler, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -310,6 +394,12 @@ public:
     DescriptorBuilder& add_storage_buffer(ShaderMeta::Binding const& binding, BufferSlice buffer);
     DescriptorBuilder& add_storage_buffer(std::string_view binding, BufferSlice buffer);
 
+    // Only the buffer and range are part of the descriptor set. The offset of the slice must be passed to
+    // CommandBuffer::bind_descriptor_set, see get_dynamic_offsets(). The string and ShaderMeta::Binding overloads of
+    // add_uniform_buffer() and add_storage_buffer() call these automatically for bindings that were reflected as dynamic.
+    DescriptorBuilder& add_dynamic_uniform_buffer(uint32_t binding, BufferSlice buffer);
+    DescriptorBuilder& add_dynamic_storage_buffer(uint32_t binding, BufferSlice buffer);
+
 #if PHOBOS_ENABLE_RAY_TRACING
     DescriptorBuilder& add_acceleration_structure(std::string_view binding, AccelerationStructure const& as);
     DescriptorBuilder& add_acceleration_structure(uint32_t binding, VkAccelerationStructureKHR const& as);
@@ -320,11 +410,23 @@ public:
     DescriptorBuilder& add_pNext(void* p);
 
     VkDescriptorSet get();
+    // The bindings that were added, without allocating a descriptor set. Pass this to CommandBuffer::push_descriptors() for push descriptor sets.
+    DescriptorSetBinding const& get_set_binding() const;
+    // Offsets of all dynamic buffers that were added, sorted by binding as expected by vkCmdBindDescriptorSets.
+    std::vector<uint32_t> get_dynamic_offsets() const;
 private:
     Context* ctx = nullptr;
     Pipeline pipeline{};
+    // Binding and offset of every dynamic buffer
+    std::vector<std::pair<uint32_t, uint32_t>> dynamic_offsets{};
     DescriptorSetBinding info{};
     std::vector<void*> pNext_chain{};
+    uint32_t set_index = 0;
+    uint32_t thread_index = main_thread_index;
+    DescriptorLifetime lifetime = DescriptorLifetime::Frame;
+
+    // Adds the binding to info and mixes it into the hash of the bindings, so it does not need to be hashed again on lookup.
+    void add_binding(DescriptorBinding&& binding);
 };
 
 class PipelineBuilder {
@@ -336,6 +438,10 @@ public:
     PipelineBuilder& add_vertex_attribute(uint32_t binding, uint32_t location, VkFormat format);
     PipelineBuilder& add_shader(std::string_view path, std::string_view entry, ShaderStage stage);
     PipelineBuilder& add_shader(ShaderHandle shader);
+    // Reflects the uniform or storage buffer with this name as a dynamic buffer. Must be called before reflect().
+    PipelineBuilder& add_dynamic_buffer(std::string_view binding);
+    // Reflects this set as a push descriptor set. Must be called before reflect().
+    PipelineBuilder& set_push_descriptor_set(uint32_t set_index);
     PipelineBuilder& set_depth_test(bool test);
     PipelineBuilder& set_depth_write(bool write);
     PipelineBuilder& set_depth_op(VkCompareOp op);
@@ -370,6 +476,10 @@ public:
 
     ComputePipelineBuilder& set_shader(ShaderHandle shader);
     ComputePipelineBuilder& set_shader(std::string_view path, std::string_view entry);
+    // Reflects the uniform or storage buffer with this name as a dynamic buffer. Must be called before reflect().
+    ComputePipelineBuilder& add_dynamic_buffer(std::string_view binding);
+    // Reflects this set as a push descriptor set. Must be called before reflect().
+    ComputePipelineBuilder& set_push_descriptor_set(uint32_t set_index);
     ComputePipelineBuilder& reflect();
 
     ph::ComputePipelineCreateInfo get();
@@ -398,6 +508,8 @@ public:
         std::optional<ShaderHandle> anyhit_shader = std::nullopt);
     // Sets the maximum number level of recusion rays can have in this pipeline.
     RayTracingPipelineBuilder& set_recursion_depth(uint32_t depth);
+    // Reflects the uniform or storage buffer with this name as a dynamic buffer. Must be called before reflect().
+    RayTracingPipelineBuilder& add_dynamic_buffer(std::string_view binding);
 
     RayTracingPipelineBuilder& reflect();
 
@@ -64,6 +64,8 @@ public:
 
 	void submit(CommandBuffer& cmd_buf, VkFence signal_fence = nullptr, plib::bit_flag<ph::PipelineStage> wait_stage = {}, VkSemaphore wait_semaphore = nullptr, VkSemaphore signal_semaphore = nullptr);
 	void submit(VkSubmitInfo const& submit_info, VkFence signal_fence);
+	// Synchronization2 must be enabled in AppSettings.
+	void submit(VkSubmitInfo2KHR const& submit_info, VkFence signal_fence);
 
 	void present(VkPresentInfoKHR const& present_info);
 
@@ -2,13 +2,43 @@
 
 #include <phobos/context.hpp>
 #include <phobos/pass.hpp>
+#include <phobos/hash.hpp>
+
+#include <unordered_map>
 
 namespace ph {
 
+struct BarrierStats {
+	// Amount of barriers created for the passes, which is also the amount of vkCmdPipelineBarrier calls without batching.
+	uint32_t barriers = 0;
+	// Amount of barriers left after duplicates were merged
+	uint32_t merged_barriers = 0;
+	// Amount of vkCmdPipelineBarrier calls the graph is executed with
+	uint32_t barrier_calls = 0;
+};
+
+// A graph can be kept alive across frames: call reset() and add the passes of the new frame before building it again.
+// If the passes have the same structure as the last time the graph was built, build() keeps the layouts and barriers
+// it derived before and only updates the handles that changed, like the swapchain image.
+// build() drops passes whose results never reach an output of the graph. The swapchain, exported resources and resources
+// the graph reads before writing them (for example the history of a previous frame) are outputs.
 class RenderGraph {
 public:
 	void add_pass(Pass pass);
+	// Marks a resource as used after the graph executed, for example by another graph, a later frame or a readback on the CPU.
+	// Passes writing it are never culled, and its attachment contents are always stored. Exports are removed by reset().
+	void export_attachment(std::string_view name);
+	void export_image(ImageView view);
+	void export_buffer(BufferSlice slice);
 	void build(Context& ctx);
+	// Removes all passes and exports, but keeps the result of the last build so it can be reused.
+	void reset();
+	// Amount of passes removed by the last build() because their results were never used.
+	uint32_t get_culled_pass_count() const;
+	// Only valid after build()
+	BarrierStats get_barrier_stats() const;
+	// Memory used by the transient attachments in the graph. Only valid after build()
+	TransientMemoryStats get_transient_memory_stats() const;
 private:
 	friend class RenderGraphExecutor;
 
@@ -27,20 +57,148 @@ private:
 		BarrierType type;
 		plib::bit_flag<PipelineStage> src_stage;
 		plib::bit_flag<PipelineStage> dst_stage;
+		// Index of the resource in the pass this barrier was created for, used to update its handle when the graph is reused.
+		uint32_t resource = 0;
+		// Where the barrier ended up in the batches of its pass boundary, so a reused graph can patch its handle in place.
+		uint32_t batch = 0;
+		uint32_t batch_index = 0;
 	};
 
 	struct BuiltPass {
 		VkRenderPass handle = nullptr;
 		VkFramebuffer framebuf = nullptr;
+		std::vector<VkAttachmentDescription> attachments;
+		// Index in Pass::resources of every attachment, in render pass attachment order.
+		std::vector<uint32_t> attachment_resources;
+		// Views the framebuffer was created with. An imageless framebuffer gets them when the render pass begins instead.
+		std::vector<VkImageView> attachment_views;
+		bool imageless = false;
+		// Only used with dynamic rendering, in which case no render pass or framebuffer is created.
+		bool dynamic_rendering = false;
+		std::vector<VkRenderingAttachmentInfoKHR> color_attachments;
+		std::optional<VkRenderingAttachmentInfoKHR> depth_attachment;
+		RenderingFormats formats;
 		VkExtent2D render_area{};
+		// What the render pass and framebuffer were created from, so a reused pass can look them up again.
+		std::vector<VkAttachmentReference> color_refs;
+		std::optional<VkAttachmentReference> depth_ref;
+		std::vector<VkFramebufferAttachmentImageInfo> image_infos;
+		std::vector<VkFormat> view_formats;
 		// These barries will be executed BEFORE the renderpass;
 		std::vector<Barrier> pre_barriers;
 		// These barriers will be executed AFTER the renderpass.
 		std::vector<Barrier> post_barriers;
 	};
 
+	// Barriers recorded with a single vkCmdPipelineBarrier call.
+	struct BarrierBatch {
+		// Without synchronization2, the stage masks are the union of the stages of all barriers in the batch.
+		VkPipelineStageFlags src_stage{};
+		VkPipelineStageFlags dst_stage{};
+		std::vector<VkMemoryBarrier> memory;
+		std::vector<VkBufferMemoryBarrier> buffers;
+		std::vector<VkImageMemoryBarrier> images;
+		// With synchronization2, every barrier keeps its own stage masks.
+		std::vector<VkMemoryBarrier2KHR> memory2;
+		std::vector<VkBufferMemoryBarrier2KHR> buffers2;
+		std::vector<VkImageMemoryBarrier2KHR> images2;
+	};
+
+	// Everything the build is derived from, taken from the passes as they were added. Handles that change every frame are left out,
+	// so two graphs with the same structure can reuse each other's build. The hash is only used to skip the comparison.
+	struct GraphStructure {
+		std::vector<uint64_t> values;
+		// Pass and attachment names
+		std::vector<std::string> names;
+		size_t hash = 0;
+
+		bool operator==(GraphStructure const& rhs) const = default;
+	};
+
+	// A resource of a pass, by pass index and index in Pass::resources.
+	struct UsageRef {
+		uint32_t pass = 0;
+		uint32_t resource = 0;
+	};
+
+	// Every attachment, image and buffer in the graph gets an id, with a timeline of the resources that use it in pass order.
+	// This is rebuilt at the start of build(), so finding the previous or next usage of a resource does not need to search all passes.
+	struct ResourceTable {
+		// The names point into Pass::resources, so they are valid until the passes are modified.
+		std::unordered_map<std::string_view, uint32_t> attachment_ids;
+		std::unordered_map<VkImage, uint32_t> image_ids;
+		std::unordered_map<BufferSlice, uint32_t> buffer_ids;
+		// Indexed by attachment id, so the context is only asked once for every attachment.
+		std::vector<Attachment> attachments;
+		std::vector<std::vector<UsageRef>> attachment_usages;
+		std::vector<std::vector<UsageRef>> image_usages;
+		std::vector<std::vector<UsageRef>> buffer_usages;
+	};
+
 	std::vector<Pass> passes;
+	std::vector<std::string> exported_attachments;
+	std::vector<VkImage> exported_images;
+	std::vector<BufferSlice> exported_buffers;
+	uint32_t culled_passes = 0;
+	// Store op of every resource in every pass. Only used for output attachments.
+	std::vector<std::vector<VkAttachmentStoreOp>> store_ops;
 	std::vector<BuiltPass> built_passes;
+	ResourceTable resource_table;
+	// Batches to record before pass i. The post barriers of pass i - 1 are merged into these, the last entry is recorded after the last pass.
+	std::vector<std::vector<BarrierBatch>> barrier_batches;
+	BarrierStats barrier_stats{};
+	// Whether barrier_batches uses the synchronization2 barriers
+	bool synchronization2 = false;
+	TransientMemoryStats transient_stats{};
+	// Structure of the passes built_passes was created from
+	std::optional<GraphStructure> compiled_structure = std::nullopt;
+	// Filled by get_structure(). Swapped with compiled_structure after a full build, so neither allocates every frame.
+	GraphStructure current_structure{};
+	// Used by get_structure() to number the images and buffers in the graph.
+	std::unordered_map<VkImage, uint32_t> image_indices;
+	std::unordered_map<BufferSlice, uint32_t> buffer_indices;
+	// The view of every resource of every pass before culling, resolved by get_structure(). Empty for buffers.
+	std::vector<ImageView> resolved_views;
+	std::vector<size_t> resolved_view_offsets;
+	// What the last full build did to the passes, so a reused build can do the same without deriving it again.
+	// Indices of the passes that were not culled, and the attachment loads that were turned into LoadOp::DontCare.
+	std::vector<uint32_t> kept_passes;
+	std::vector<UsageRef> dont_care_loads;
+
+	void create_resource_table(Context& ctx);
+	// Removes the passes whose results are never used. Rebuilds the resource table if any pass was removed.
+	void cull_passes(Context& ctx);
+	// Doesn't load transient attachments that no earlier pass wrote to.
+	void infer_load_ops();
+	// Whether the contents of the resource are still used after the graph executed.
+	bool is_graph_output(Context& ctx, ResourceUsage const& resource);
+	// The timeline of the image or buffer the resource refers to.
+	std::vector<UsageRef> const& get_usage_timeline(ResourceUsage const& resource) const;
+	// Whether a pass after the usage reads what it wrote, before another pass overwrites it.
+	bool is_read_later(UsageRef usage, std::vector<bool> const& live);
+	// Places the transient attachments used in the graph in shared memory. Returns false if the graph has no transient attachments.
+	bool alias_transient_attachments(Context& ctx, std::vector<TransientAttachmentUsage>& usages);
+	// Makes the first pass that uses a transient attachment wait on the last pass that used its memory for another attachment.
+	void create_aliasing_barriers(std::vector<TransientAttachmentUsage> const& usages);
+	// Only valid for attachments used in the graph
+	Attachment const& get_attachment(std::string_view name) const;
+	// Attachments without a custom view use the view of the attachment
+	ImageView get_resource_view(ResourceUsage const& resource) const;
+	std::pair<ResourceUsage, Pass*> get_previous_usage(std::vector<UsageRef> const& timeline, Pass* current_pass);
+	std::pair<ResourceUsage, Pass*> get_next_usage(std::vector<UsageRef> const& timeline, Pass* current_pass);
+
+	// Also resolves the views of all resources, which is all a reused build needs from the context.
+	void get_structure(Context& ctx, GraphStructure& structure);
+	// Builds the graph from scratch.
+	void compile(Context& ctx);
+	// Applies the culling and load ops of the last build to the passes, then updates the handles in the build.
+	void reuse_build(Context& ctx);
+	// Points the barriers, framebuffer and rendering attachments of a reused pass at the current views and buffers.
+	void patch_pass(Context& ctx, uint32_t pass_index, ImageView const* views);
+	// Looks up the render pass and framebuffer for the attachment descriptions of the pass.
+	void create_render_pass(Context& ctx, Pass& pass, BuiltPass& build);
+	// Looks up the render pass and framebuffer of a pass that went through create_render_pass() before.
+	void lookup_render_pass(Context& ctx, Pass const& pass, BuiltPass& build);
 
 	std::vector<VkAttachmentDescription> get_attachment_descriptions(Context& ctx, Pass* pass);
 	VkImageLayout get_initial_layout(Context& ctx, Pass* pass, ResourceUsage const& resource);
@@ -60,13 +218,19 @@ private:
 	std::pair<ResourceUsage, Pass*> find_previous_usage(Pass* current_pass, BufferSlice const* buffer);
 	std::pair<ResourceUsage, Pass*> find_next_usage(Pass* current_pass, BufferSlice const* buffer);
 
-    // Compares by ImageView, since this is used for barriers.
+    // Compares by image, since this is used for barriers.
 	std::pair<ResourceUsage, Pass*> find_previous_usage(Context& ctx, Pass* current_pass, ImageView const* image);
 	std::pair<ResourceUsage, Pass*> find_next_usage(Context& ctx, Pass* current_pass, ImageView const* image);
 
 	AttachmentUsage get_attachment_usage(std::pair<ResourceUsage, Pass*> const& res_usage);
 
 	void create_pass_barriers(Context& ctx, Pass& pass, BuiltPass& result);
+	// Fills in the attachments of a pass recorded with dynamic rendering.
+	void build_rendering_pass(Context& ctx, Pass& pass, BuiltPass& result);
+	// Without a render pass, the attachment layout transitions of the render pass become barriers around the pass.
+	void create_rendering_barriers(Context& ctx, Pass& pass, BuiltPass& result);
+	// Merges the barriers at every pass boundary into as few batches as possible.
+	void create_barrier_batches(Context& ctx);
 };
 
 class RenderGraphExecutor {
@@ -75,6 +239,7 @@ public:
 	// Render graph must be built before calling this function.
 	void execute(ph::CommandBuffer& cmd_buf, RenderGraph& graph);
 private:
+	void record_barriers(ph::CommandBuffer& cmd_buf, RenderGraph const& graph, std::vector<RenderGraph::BarrierBatch> const& batches);
 
 };
 
@@ -15,6 +15,8 @@ public:
     struct Binding {
         uint32_t binding;
         VkDescriptorType type;
+        // Descriptor set index the binding was declared in
+        uint32_t set = 0;
     };
 
     Binding operator[](std::string_view name) const;
@@ -0,0 +1,219 @@
+#include <phobos/bindless_heap.hpp>
+#include <phobos/context.hpp>
+#include <phobos/hash.hpp>
+
+#include <cassert>
+
+namespace ph {
+
+BindlessHeap::BindlessHeap(Context& ctx, AppSettings const& settings) : ctx(&ctx), set_index(settings.bindless_set_index) {
+	sampled_images = HeapArray{ .binding = sampled_image_binding, .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .capacity = settings.bindless_sampled_images };
+	storage_images = HeapArray{ .binding = storage_image_binding, .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .capacity = settings.bindless_storage_images };
+	storage_buffers = HeapArray{ .binding = storage_buffer_binding, .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .capacity = settings.bindless_storage_buffers };
+	// A headless context has no frames in flight, synchronization is up to the user there.
+	// Otherwise, wait one extra frame since slots are retired before the fence of the reused frame is waited on.
+	retire_delay = ctx.is_headless() ? 0 : settings.max_frames_in_flight + 1;
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	std::vector<VkDescriptorPoolSize> pool_sizes;
+	for (HeapArray* array : { &sampled_images, &storage_images, &storage_buffers }) {
+		array->slot_resource.resize(array->capacity);
+		array->slot_refcount.resize(array->capacity);
+		if (array->capacity == 0) continue;
+		bindings.push_back(VkDescriptorSetLayoutBinding{
+			.binding = array->binding,
+			.descriptorType = array->type,
+			.descriptorCount = array->capacity,
+			.stageFlags = VK_SHADER_STAGE_ALL,
+			.pImmutableSamplers = nullptr
+		});
+		pool_sizes.push_back(VkDescriptorPoolSize{ array->type, array->capacity });
+	}
+	assert(!bindings.empty() && "Bindless heap created without any arrays");
+
+	// Not every slot is written, and slots are written while the set is bound in command buffers that are still pending.
+	std::vector<VkDescriptorBindingFlags> flags(bindings.size(),
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT);
+	VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+		.pNext = nullptr,
+		.bindingCount = (uint32_t)flags.size(),
+		.pBindingFlags = flags.data()
+	};
+	VkDescriptorSetLayoutCreateInfo layout_info{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = &flags_info,
+		.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+		.bindingCount = (uint32_t)bindings.size(),
+		.pBindings = bindings.data()
+	};
+	vkCreateDescriptorSetLayout(ctx.device(), &layout_info, nullptr, &set_layout);
+
+	VkDescriptorPoolCreateInfo pool_info{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+		.maxSets = 1,
+		.poolSizeCount = (uint32_t)pool_sizes.size(),
+		.pPoolSizes = pool_sizes.data()
+	};
+	vkCreateDescriptorPool(ctx.device(), &pool_info, nullptr, &pool);
+
+	VkDescriptorSetAllocateInfo alloc_info{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.pNext = nullptr,
+		.descriptorPool = pool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &set_layout
+	};
+	vkAllocateDescriptorSets(ctx.device(), &alloc_info, &set);
+}
+
+size_t BindlessHeap::ResourceKeyHash::operator()(ResourceKey const& key) const {
+	size_t h = 0;
+	hash_combine(h, key.view_id, key.sampler, key.layout, key.buffer, key.offset, key.range);
+	return h;
+}
+
+BindlessHeap::~BindlessHeap() {
+	vkDestroyDescriptorPool(ctx->device(), pool, nullptr);
+	vkDestroyDescriptorSetLayout(ctx->device(), set_layout, nullptr);
+}
+
+uint32_t BindlessHeap::add_sampled_image(ImageView view, VkSampler sampler, VkImageLayout layout) {
+	ResourceKey const resource{ .view_id = view.id, .sampler = sampler, .layout = layout };
+	std::lock_guard lock(mutex);
+	auto [index, is_new] = acquire_slot(sampled_images, resource);
+	if (is_new) {
+		VkDescriptorImageInfo info{ .sampler = sampler, .imageView = view.handle, .imageLayout = layout };
+		write(sampled_images, index, &info, nullptr);
+	}
+	return index;
+}
+
+uint32_t BindlessHeap::add_storage_image(ImageView view, VkImageLayout layout) {
+	ResourceKey const resource{ .view_id = view.id, .layout = layout };
+	std::lock_guard lock(mutex);
+	auto [index, is_new] = acquire_slot(storage_images, resource);
+	if (is_new) {
+		VkDescriptorImageInfo info{ .sampler = nullptr, .imageView = view.handle, .imageLayout = layout };
+		write(storage_images, index, &info, nullptr);
+	}
+	return index;
+}
+
+uint32_t BindlessHeap::add_storage_buffer(BufferSlice slice) {
+	ResourceKey const resource{ .buffer = slice.buffer, .offset = slice.offset, .range = slice.range };
+	std::lock_guard lock(mutex);
+	auto [index, is_new] = acquire_slot(storage_buffers, resource);
+	if (is_new) {
+		VkDescriptorBufferInfo info{ .buffer = slice.buffer, .offset = slice.offset, .range = slice.range };
+		write(storage_buffers, index, nullptr, &info);
+	}
+	return index;
+}
+
+void BindlessHeap::remove_sampled_image(uint32_t index) {
+	std::lock_guard lock(mutex);
+	release_slot(sampled_images, index);
+}
+
+void BindlessHeap::remove_storage_image(uint32_t index) {
+	std::lock_guard lock(mutex);
+	release_slot(storage_images, index);
+}
+
+void BindlessHeap::remove_storage_buffer(uint32_t index) {
+	std::lock_guard lock(mutex);
+	release_slot(storage_buffers, index);
+}
+
+VkDescriptorSetLayout BindlessHeap::get_set_layout() const {
+	return set_layout;
+}
+
+VkDescriptorSet BindlessHeap::get_set() const {
+	return set;
+}
+
+uint32_t BindlessHeap::get_set_index() const {
+	return set_index;
+}
+
+void BindlessHeap::next_frame() {
+	std::lock_guard lock(mutex);
+	retire_slots(sampled_images);
+	retire_slots(storage_images);
+	retire_slots(storage_buffers);
+}
+
+std::pair<uint32_t, bool> BindlessHeap::acquire_slot(HeapArray& array, ResourceKey const& resource) {
+	auto it = array.slot_by_resource.find(resource);
+	if (it != array.slot_by_resource.end()) {
+		array.slot_refcount[it->second] += 1;
+		return { it->second, false };
+	}
+
+	uint32_t index = invalid_index;
+	if (!array.free_slots.empty()) {
+		index = array.free_slots.back();
+		array.free_slots.pop_back();
+	}
+	else if (array.next_unused < array.capacity) {
+		index = array.next_unused++;
+	}
+	else {
+		ctx->logger()->write_fmt(LogSeverity::Error, "Bindless heap binding {} is full ({} descriptors).", array.binding, array.capacity);
+		return { invalid_index, false };
+	}
+
+	array.slot_by_resource[resource] = index;
+	array.slot_resource[index] = resource;
+	array.slot_refcount[index] = 1;
+	return { index, true };
+}
+
+void BindlessHeap::release_slot(HeapArray& array, uint32_t index) {
+	assert(index < array.capacity && array.slot_refcount[index] > 0 && "Removing bindless slot that is not in use");
+	array.slot_refcount[index] -= 1;
+	if (array.slot_refcount[index] > 0) return;
+
+	array.slot_by_resource.erase(array.slot_resource[index]);
+	if (retire_delay == 0) {
+		array.free_slots.push_back(index);
+	}
+	else {
+		array.retiring_slots.emplace_back(index, retire_delay);
+	}
+}
+
+void BindlessHeap::retire_slots(HeapArray& array) {
+	for (auto it = array.retiring_slots.begin(); it != array.retiring_slots.end();) {
+		it->second -= 1;
+		if (it->second == 0) {
+			array.free_slots.push_back(it->first);
+			it = array.retiring_slots.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void BindlessHeap::write(HeapArray const& array, uint32_t index, VkDescriptorImageInfo const* image, VkDescriptorBufferInfo const* buffer) {
+	VkWriteDescriptorSet write{
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.pNext = nullptr,
+		.dstSet = set,
+		.dstBinding = array.binding,
+		.dstArrayElement = index,
+		.descriptorCount = 1,
+		.descriptorType = array.type,
+		.pImageInfo = image,
+		.pBufferInfo = buffer,
+		.pTexelBufferView = nullptr
+	};
+	vkUpdateDescriptorSets(ctx->device(), 1, &write, 0, nullptr);
+}
+
+}
@@ -4,6 +4,8 @@
 
 #include <cassert>
 #include <array>
+#include <cstring>
+#include <algorithm>
 
 namespace ph {
 
@@ -20,6 +22,12 @@ CommandBuffer& CommandBuffer::begin(VkCommandBufferUsageFlags flags) {
 	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	begin_info.flags = flags;
 	vkBeginCommandBuffer(cmd_buf, &begin_info);
+	// A command buffer starts without any state
+	invalidate_state();
+	stats = {};
+	// Pipelines are only resolved once per recording, so their usage is still registered in the cache every frame.
+	resolved_pipelines.clear();
+	resolved_compute_pipelines.clear();
 	return *this;
 }
 
@@ -32,6 +40,7 @@ CommandBuffer& CommandBuffer::begin_renderpass(VkRenderPassBeginInfo const& info
 	vkCmdBeginRenderPass(cmd_buf, &info, VK_SUBPASS_CONTENTS_INLINE);
 	cur_renderpass = info.renderPass;
 	cur_render_area = info.renderArea;
+	reset_graphics_state();
 	return *this;
 }
 
@@ -41,32 +50,123 @@ CommandBuffer& CommandBuffer::end_renderpass() {
 	return *this;
 }
 
+CommandBuffer& CommandBuffer::begin_rendering(VkRenderingInfoKHR const& info, RenderingFormats const& formats) {
+	ctx->begin_rendering(cmd_buf, info);
+	in_dynamic_rendering = true;
+	cur_rendering_formats = formats;
+	cur_render_area = info.renderArea;
+	reset_graphics_state();
+	return *this;
+}
+
+CommandBuffer& CommandBuffer::end_rendering() {
+	ctx->end_rendering(cmd_buf);
+	in_dynamic_rendering = false;
+	return *this;
+}
+
 Pipeline const& CommandBuffer::get_bound_pipeline() const {
 	return cur_pipeline;
 }
 
+CommandBuffer& CommandBuffer::bind_pipeline(PipelineId id) {
+	assert((cur_renderpass || in_dynamic_rendering) && "bind_pipeline called without an active renderpass");
+	bind_pipeline_state(*resolve_pipeline(id, true));
+	return *this;
+}
+
 CommandBuffer& CommandBuffer::bind_pipeline(std::string_view name) {
-	assert(cur_renderpass && "bind_pipeline called without an active renderpass");
-	Pipeline pipeline = ctx->get_or_create_pipeline(name, cur_renderpass);
-	vkCmdBindPipeline(cmd_buf, static_cast<VkPipelineBindPoint>(pipeline.type), pipeline.handle);
-	cur_pipeline = pipeline;
+	return bind_pipeline(ctx->get_pipeline_id(name));
+}
+
+CommandBuffer& CommandBuffer::bind_compute_pipeline(PipelineId id) {
+	bind_pipeline_state(*resolve_compute_pipeline(id, true));
 	return *this;
 }
 
 CommandBuffer& CommandBuffer::bind_compute_pipeline(std::string_view name) {
-	Pipeline pipeline = ctx->get_or_create_compute_pipeline(name);
-	vkCmdBindPipeline(cmd_buf, static_cast<VkPipelineBindPoint>(pipeline.type), pipeline.handle);
-	cur_pipeline = pipeline;
+	return bind_compute_pipeline(ctx->get_compute_pipeline_id(name));
+}
+
+bool CommandBuffer::try_bind_pipeline(PipelineId id) {
+	assert((cur_renderpass || in_dynamic_rendering) && "try_bind_pipeline called without an active renderpass");
+	Pipeline const* pipeline = resolve_pipeline(id, false);
+	if (!pipeline) return false;
+	bind_pipeline_state(*pipeline);
+	return true;
+}
+
+bool CommandBuffer::try_bind_pipeline(std::string_view name) {
+	return try_bind_pipeline(ctx->get_pipeline_id(name));
+}
+
+bool CommandBuffer::try_bind_compute_pipeline(PipelineId id) {
+	Pipeline const* pipeline = resolve_compute_pipeline(id, false);
+	if (!pipeline) return false;
+	bind_pipeline_state(*pipeline);
+	return true;
+}
+
+bool CommandBuffer::try_bind_compute_pipeline(std::string_view name) {
+	return try_bind_compute_pipeline(ctx->get_compute_pipeline_id(name));
+}
+
+CommandBuffer& CommandBuffer::bind_descriptor_set(VkDescriptorSet set, uint32_t set_index) {
+	if (set_index < max_tracked_sets) {
+		VkDescriptorSet& bound = get_bind_point_state(cur_pipeline.type).sets[set_index];
+		if (!track(bound != set)) return *this;
+		bound = set;
+	}
+	else {
+		track(true);
+	}
+	vkCmdBindDescriptorSets(cmd_buf, static_cast<VkPipelineBindPoint>(cur_pipeline.type), cur_pipeline.layout.handle, set_index, 1, &set, 0, nullptr);
+	return *this;
+}
+
+CommandBuffer& CommandBuffer::bind_descriptor_set(VkDescriptorSet set, uint32_t set_index, std::span<uint32_t const> dynamic_offsets) {
+	// The offsets usually change with every bind, so these are not filtered.
+	forget_descriptor_set(set_index);
+	track(true);
+	vkCmdBindDescriptorSets(cmd_buf, static_cast<VkPipelineBindPoint>(cur_pipeline.type), cur_pipeline.layout.handle, set_index, 1, &set,
+		static_cast<uint32_t>(dynamic_offsets.size()), dynamic_offsets.data());
+	return *this;
+}
+
+CommandBuffer& CommandBuffer::push_descriptors(DescriptorSetBinding const& set_binding, uint32_t set_index) {
+	forget_descriptor_set(set_index);
+	track(true);
+	ctx->push_descriptor_set(cmd_buf, set_binding, cur_pipeline, set_index);
 	return *this;
 }
 
-CommandBuffer& CommandBuffer::bind_descriptor_set(VkDescriptorSet set) {
-	vkCmdBindDescriptorSets(cmd_buf, static_cast<VkPipelineBindPoint>(cur_pipeline.type), cur_pipeline.layout.handle, 0, 1, &set, 0, nullptr);
+CommandBuffer& CommandBuffer::bind_bindless_heap() {
+	BindlessHeap* heap = ctx->get_bindless_heap();
+	assert(heap && "bind_bindless_heap called without a bindless heap");
+	VkDescriptorSet set = heap->get_set();
+	uint32_t const set_index = heap->get_set_index();
+	if (set_index < max_tracked_sets) {
+		VkDescriptorSet& bound = get_bind_point_state(cur_pipeline.type).sets[set_index];
+		if (!track(bound != set)) return *this;
+		bound = set;
+	}
+	else {
+		track(true);
+	}
+	vkCmdBindDescriptorSets(cmd_buf, static_cast<VkPipelineBindPoint>(cur_pipeline.type), cur_pipeline.layout.handle, set_index, 1, &set, 0, nullptr);
 	return *this;
 }
 
 CommandBuffer& CommandBuffer::bind_vertex_buffer(uint32_t first_binding, VkBuffer buffer, VkDeviceSize offset) {
-	assert(cur_renderpass && "bind_vertex_buffer called without an active renderpass");
+	assert((cur_renderpass || in_dynamic_rendering) && "bind_vertex_buffer called without an active renderpass");
+	if (first_binding < max_tracked_vertex_buffers) {
+		VertexBufferState& bound = vertex_buffers[first_binding];
+		if (!track(bound.buffer != buffer || bound.offset != offset)) return *this;
+		bound = VertexBufferState{ .buffer = buffer, .offset = offset };
+	}
+	else {
+		track(true);
+	}
 	vkCmdBindVertexBuffers(cmd_buf, first_binding, 1, &buffer, &offset);
 	return *this;
 }
@@ -76,13 +176,25 @@ CommandBuffer& CommandBuffer::bind_vertex_buffer(uint32_t first_binding, BufferS
 }
 
 CommandBuffer& CommandBuffer::bind_index_buffer(BufferSlice slice, VkIndexType type) {
-	assert(cur_renderpass && "bind_index_buffer called without an active renderpass");
+	assert((cur_renderpass || in_dynamic_rendering) && "bind_index_buffer called without an active renderpass");
+	if (!track(index_buffer.buffer != slice.buffer || index_buffer.offset != slice.offset || index_buffer.type != type)) return *this;
+	index_buffer = IndexBufferState{ .buffer = slice.buffer, .offset = slice.offset, .type = type };
 	vkCmdBindIndexBuffer(cmd_buf, slice.buffer, slice.offset, type);
 	return *this;
 }
 
 CommandBuffer& CommandBuffer::push_constants(plib::bit_flag<ph::ShaderStage> stage, uint32_t offset, uint32_t size, void const* data) {
-	vkCmdPushConstants(cmd_buf, cur_pipeline.layout.handle, static_cast<VkShaderStageFlags>(stage.value()), offset, size, data);
+	VkShaderStageFlags const stages = static_cast<VkShaderStageFlags>(stage.value());
+	PushConstantState& last = push_constant_state;
+	bool const same = last.layout == cur_pipeline.layout.handle && last.stages == stages && last.offset == offset
+		&& last.data.size() == size && std::memcmp(last.data.data(), data, size) == 0;
+	if (!track(!same)) return *this;
+	last.layout = cur_pipeline.layout.handle;
+	last.stages = stages;
+	last.offset = offset;
+	last.data.resize(size);
+	std::memcpy(last.data.data(), data, size);
+	vkCmdPushConstants(cmd_buf, cur_pipeline.layout.handle, stages, offset, size, data);
 	return *this;
 }
 
@@ -94,17 +206,31 @@ CommandBuffer& CommandBuffer::auto_viewport_scissor() {
 	vp.y = 0;
 	vp.minDepth = 0.0f;
 	vp.maxDepth = 1.0f;
-	vkCmdSetViewport(cmd_buf, 0, 1, &vp);
-	vkCmdSetScissor(cmd_buf, 0, 1, &cur_render_area);
+	set_viewport(vp);
+	set_scissor(cur_render_area);
 	return *this;
 }
 
+static bool same_viewport(VkViewport const& lhs, VkViewport const& rhs) {
+	return lhs.x == rhs.x && lhs.y == rhs.y && lhs.width == rhs.width && lhs.height == rhs.height
+		&& lhs.minDepth == rhs.minDepth && lhs.maxDepth == rhs.maxDepth;
+}
+
+static bool same_rect(VkRect2D const& lhs, VkRect2D const& rhs) {
+	return lhs.offset.x == rhs.offset.x && lhs.offset.y == rhs.offset.y
+		&& lhs.extent.width == rhs.extent.width && lhs.extent.height == rhs.extent.height;
+}
+
 CommandBuffer& CommandBuffer::set_viewport(VkViewport vp) {
+	if (!track(!viewport || !same_viewport(*viewport, vp))) return *this;
+	viewport = vp;
 	vkCmdSetViewport(cmd_buf, 0, 1, &vp);
 	return *this;
 }
 
 CommandBuffer& CommandBuffer::set_scissor(VkRect2D scissor) {
+	if (!track(!this->scissor || !same_rect(*this->scissor, scissor))) return *this;
+	this->scissor = scissor;
 	vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
 	return *this;
 }
@@ -120,17 +246,29 @@ CommandBuffer& CommandBuffer::draw_indexed(uint32_t index_count, uint32_t instan
 }
 
 CommandBuffer& CommandBuffer::barrier(plib::bit_flag<ph::PipelineStage> src_stage, plib::bit_flag<ph::PipelineStage> dst_stage, VkBufferMemoryBarrier const& barrier, VkDependencyFlags dependency) {
-	vkCmdPipelineBarrier(cmd_buf, static_cast<VkPipelineStageFlags>(src_stage.value()), static_cast<VkPipelineStageFlags>(dst_stage.value()), dependency, 0, nullptr, 1, &barrier, 0, nullptr);
+	vkCmdPipelineBarrier(cmd_buf, get_legacy_stage_flags(src_stage.value()), get_legacy_stage_flags(dst_stage.value()), dependency, 0, nullptr, 1, &barrier, 0, nullptr);
 	return *this;
 }
 
 CommandBuffer& CommandBuffer::barrier(plib::bit_flag<ph::PipelineStage> src_stage, plib::bit_flag<ph::PipelineStage> dst_stage, VkImageMemoryBarrier const& barrier, VkDependencyFlags dependency) {
-	vkCmdPipelineBarrier(cmd_buf, static_cast<VkPipelineStageFlags>(src_stage.value()), static_cast<VkPipelineStageFlags>(dst_stage.value()), dependency, 0, nullptr, 0, nullptr, 1, &barrier);
+	vkCmdPipelineBarrier(cmd_buf, get_legacy_stage_flags(src_stage.value()), get_legacy_stage_flags(dst_stage.value()), dependency, 0, nullptr, 0, nullptr, 1, &barrier);
 	return *this;
 }
 
 CommandBuffer& CommandBuffer::barrier(plib::bit_flag<ph::PipelineStage> src_stage, plib::bit_flag<ph::PipelineStage> dst_stage, VkMemoryBarrier const& barrier, VkDependencyFlags dependency) {
-	vkCmdPipelineBarrier(cmd_buf, static_cast<VkPipelineStageFlags>(src_stage.value()), static_cast<VkPipelineStageFlags>(dst_stage.value()), dependency, 1, &barrier, 0, nullptr, 0, nullptr);
+	vkCmdPipelineBarrier(cmd_buf, get_legacy_stage_flags(src_stage.value()), get_legacy_stage_flags(dst_stage.value()), dependency, 1, &barrier, 0, nullptr, 0, nullptr);
+	return *this;
+}
+
+CommandBuffer& CommandBuffer::barriers(plib::bit_flag<ph::PipelineStage> src_stage, plib::bit_flag<ph::PipelineStage> dst_stage, std::span<VkMemoryBarrier const> memory,
+	std::span<VkBufferMemoryBarrier const> buffers, std::span<VkImageMemoryBarrier const> images, VkDependencyFlags dependency) {
+	vkCmdPipelineBarrier(cmd_buf, get_legacy_stage_flags(src_stage.value()), get_legacy_stage_flags(dst_stage.value()), dependency,
+		(uint32_t)memory.size(), memory.data(), (uint32_t)buffers.size(), buffers.data(), (uint32_t)images.size(), images.data());
+	return *this;
+}
+
+CommandBuffer& CommandBuffer::barriers(VkDependencyInfoKHR const& dependency) {
+	ctx->pipeline_barrier2(cmd_buf, dependency);
 	return *this;
 }
 
@@ -329,8 +467,7 @@ CommandBuffer &CommandBuffer::blit_image(const RawImage &src, VkImageLayout src_
 
 CommandBuffer& CommandBuffer::bind_ray_tracing_pipeline(std::string_view name) {
 	Pipeline pipeline = ctx->get_or_create_ray_tracing_pipeline(name);
-	vkCmdBindPipeline(cmd_buf, static_cast<VkPipelineBindPoint>(pipeline.type), pipeline.handle);
-	cur_pipeline = pipeline;
+	bind_pipeline_state(pipeline);
 	return *this;
 }
 
@@ -382,6 +519,128 @@ VkCommandBuffer CommandBuffer::handle() const {
 	return cmd_buf;
 }
 
+CommandBuffer& CommandBuffer::invalidate_state() {
+	bind_points = {};
+	vertex_buffers = {};
+	index_buffer = {};
+	push_constant_state.layout = nullptr;
+	viewport = std::nullopt;
+	scissor = std::nullopt;
+	return *this;
+}
+
+CommandBufferStats const& CommandBuffer::get_stats() const {
+	return stats;
+}
+
+void CommandBuffer::bind_pipeline_state(Pipeline const& pipeline) {
+	BindPointState& state = get_bind_point_state(pipeline.type);
+	if (cur_pipeline.handle != pipeline.handle) {
+		cur_pipeline = pipeline;
+	}
+	if (!track(state.pipeline != pipeline.handle)) return;
+	vkCmdBindPipeline(cmd_buf, static_cast<VkPipelineBindPoint>(pipeline.type), pipeline.handle);
+	state.pipeline = pipeline.handle;
+	if (state.layout != pipeline.layout.handle) {
+		// Sets stay bound for compatible layouts, but we do not track compatibility, so assume they were all disturbed.
+		state.layout = pipeline.layout.handle;
+		state.sets = {};
+	}
+	if (pipeline.type == PipelineType::Graphics) {
+		viewport = std::nullopt;
+		scissor = std::nullopt;
+	}
+}
+
+Pipeline const* CommandBuffer::resolve_pipeline(PipelineId id, bool wait) {
+	if (id.index >= resolved_pipelines.size()) {
+		resolved_pipelines.resize(id.index + 1);
+	}
+	std::vector<ResolvedPipeline>& variants = resolved_pipelines[id.index];
+	uint32_t const version = ctx->get_pipeline_version(id);
+	auto it = std::find_if(variants.begin(), variants.end(), [this](ResolvedPipeline const& resolved) {
+		if (in_dynamic_rendering) return !resolved.render_pass && resolved.formats == cur_rendering_formats;
+		return resolved.render_pass == cur_renderpass;
+	});
+	if (it != variants.end() && it->version == version) {
+		return &it->pipeline;
+	}
+
+	Pipeline pipeline{};
+	if (wait) {
+		pipeline = in_dynamic_rendering ? ctx->get_or_create_pipeline(id, cur_rendering_formats) : ctx->get_or_create_pipeline(id, cur_renderpass);
+	}
+	else {
+		std::optional<Pipeline> ready = in_dynamic_rendering ? ctx->get_pipeline_if_ready(id, cur_rendering_formats) : ctx->get_pipeline_if_ready(id, cur_renderpass);
+		if (!ready) return nullptr;
+		pipeline = std::move(*ready);
+	}
+	if (it == variants.end()) {
+		ResolvedPipeline resolved{};
+		if (in_dynamic_rendering) resolved.formats = cur_rendering_formats;
+		else resolved.render_pass = cur_renderpass;
+		it = variants.insert(variants.end(), std::move(resolved));
+	}
+	it->version = version;
+	it->pipeline = std::move(pipeline);
+	return &it->pipeline;
+}
+
+Pipeline const* CommandBuffer::resolve_compute_pipeline(PipelineId id, bool wait) {
+	if (id.index >= resolved_compute_pipelines.size()) {
+		resolved_compute_pipelines.resize(id.index + 1);
+	}
+	ResolvedPipeline& resolved = resolved_compute_pipelines[id.index];
+	uint32_t const version = ctx->get_compute_pipeline_version(id);
+	if (resolved.pipeline.handle && resolved.version == version) {
+		return &resolved.pipeline;
+	}
+
+	if (wait) {
+		resolved.pipeline = ctx->get_or_create_compute_pipeline(id);
+	}
+	else {
+		std::optional<Pipeline> ready = ctx->get_compute_pipeline_if_ready(id);
+		if (!ready) return nullptr;
+		resolved.pipeline = std::move(*ready);
+	}
+	resolved.version = version;
+	return &resolved.pipeline;
+}
+
+void CommandBuffer::reset_graphics_state() {
+	// Graphics pipelines are compiled per render pass, so state from the previous render pass is not reused.
+	get_bind_point_state(PipelineType::Graphics) = BindPointState{};
+	vertex_buffers = {};
+	index_buffer = {};
+	push_constant_state.layout = nullptr;
+	viewport = std::nullopt;
+	scissor = std::nullopt;
+}
+
+CommandBuffer::BindPointState& CommandBuffer::get_bind_point_state(PipelineType type) {
+	switch (type) {
+	case PipelineType::Graphics:
+		return bind_points[0];
+	case PipelineType::Compute:
+		return bind_points[1];
+	default:
+		return bind_points[2];
+	}
+}
+
+void CommandBuffer::forget_descriptor_set(uint32_t set_index) {
+	if (set_index < max_tracked_sets) {
+		get_bind_point_state(cur_pipeline.type).sets[set_index] = nullptr;
+	}
+}
+
+bool CommandBuffer::track(bool changed) {
+	if (changed) stats.commands_emitted += 1;
+	else stats.commands_elided += 1;
+	return changed;
+}
+
 
 }
 
@@ -67,6 +67,18 @@ bool Context::validation_enabled() const {
 	return context_impl->validation_enabled();
 }
 
+bool Context::imageless_framebuffers_enabled() const {
+	return context_impl->imageless_framebuffers_enabled();
+}
+
+bool Context::dynamic_rendering_enabled() const {
+	return context_impl->dynamic_rendering_enabled();
+}
+
+bool Context::synchronization2_enabled() const {
+	return context_impl->synchronization2_enabled();
+}
+
 uint32_t Context::thread_count() const {
 	return context_impl->thread_count();
 }
@@ -151,6 +163,7 @@ void Context::name_object(VkAccelerationStructureKHR as, std::string const& name
 }
 void Context::end_thread(uint32_t thread_index) {
 	context_impl->end_thread(thread_index);
+	cache_impl->reset_thread_descriptor_sets(thread_index);
 }
 
 VkFence Context::create_fence() {
@@ -241,6 +254,14 @@ void Context::create_attachment(std::string_view name, VkExtent2D size, VkFormat
     attachment_impl->create_attachment(name, size,format, samples, layers, type);
 }
 
+void Context::create_transient_attachment(std::string_view name, VkExtent2D size, VkFormat format, ImageType type) {
+	attachment_impl->create_transient_attachment(name, size, format, VK_SAMPLE_COUNT_1_BIT, 1, type);
+}
+
+void Context::create_transient_attachment(std::string_view name, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, uint32_t layers, ImageType type) {
+	attachment_impl->create_transient_attachment(name, size, format, samples, layers, type);
+}
+
 void Context::resize_attachment(std::string_view name, VkExtent2D new_size) {
 	attachment_impl->resize_attachment(name, new_size);
 }
@@ -276,12 +297,20 @@ void Context::reflect_shaders(ph::ComputePipelineCreateInfo& pci) {
 }
 
 
-void Context::create_named_pipeline(ph::PipelineCreateInfo pci) {
-	pipeline_impl->create_named_pipeline(std::move(pci));
+PipelineId Context::create_named_pipeline(ph::PipelineCreateInfo pci) {
+	return pipeline_impl->create_named_pipeline(std::move(pci));
 }
 
-void Context::create_named_pipeline(ph::ComputePipelineCreateInfo pci) {
-	pipeline_impl->create_named_pipeline(std::move(pci));
+PipelineId Context::create_named_pipeline(ph::ComputePipelineCreateInfo pci) {
+	return pipeline_impl->create_named_pipeline(std::move(pci));
+}
+
+PipelineId Context::get_pipeline_id(std::string_view name) {
+	return pipeline_impl->get_pipeline_id(name);
+}
+
+PipelineId Context::get_compute_pipeline_id(std::string_view name) {
+	return pipeline_impl->get_compute_pipeline_id(name);
 }
 
 ShaderMeta const& Context::get_shader_meta(ph::Pipeline const& pipeline) {
@@ -306,6 +335,22 @@ VkSampler Context::basic_sampler() {
 	return pipeline_impl->basic_sampler;
 }
 
+void Context::save_pipeline_cache() {
+	cache_impl->save_pipeline_cache();
+}
+
+DescriptorPoolStats Context::get_descriptor_pool_stats() {
+	return cache_impl->last_frame_descriptor_stats;
+}
+
+CacheStatistics Context::get_cache_stats() {
+	return cache_impl->get_stats();
+}
+
+BindlessHeap* Context::get_bindless_heap() {
+	return cache_impl->bindless_heap.get();
+}
+
 #if PHOBOS_ENABLE_RAY_TRACING
 
 void Context::create_named_pipeline(ph::RayTracingPipelineCreateInfo pci) {
@@ -426,16 +471,62 @@ VkDescriptorSetLayout Context::get_or_create(DescriptorSetLayoutCreateInfo const
 	return cache_impl->get_or_create_descriptor_set_layout(dslci);
 }
 
-PipelineLayout Context::get_or_create(PipelineLayoutCreateInfo const& plci, VkDescriptorSetLayout set_layout) {
-	return cache_impl->get_or_create_pipeline_layout(plci, set_layout);
+PipelineLayout Context::get_or_create(PipelineLayoutCreateInfo const& plci) {
+	return cache_impl->get_or_create_pipeline_layout(plci);
 }
 
 Pipeline Context::get_or_create_pipeline(std::string_view name, VkRenderPass render_pass) {
-	return cache_impl->get_or_create_pipeline(pipeline_impl->get_pipeline(name), render_pass);
+	auto pipeline = pipeline_impl->get_pipeline(name);
+	return cache_impl->get_or_create_pipeline(pipeline->info, pipeline->state_hash, impl::PipelineTarget{ .render_pass = render_pass });
 }
 
 Pipeline Context::get_or_create_compute_pipeline(std::string_view name) {
-	return cache_impl->get_or_create_compute_pipeline(pipeline_impl->get_compute_pipeline(name));
+	return cache_impl->get_or_create_compute_pipeline(pipeline_impl->get_compute_pipeline(name)->info);
+}
+
+std::optional<Pipeline> Context::get_pipeline_if_ready(std::string_view name, VkRenderPass render_pass) {
+	auto pipeline = pipeline_impl->get_pipeline(name);
+	return cache_impl->get_pipeline_if_ready(pipeline->info, pipeline->state_hash, impl::PipelineTarget{ .render_pass = render_pass });
+}
+
+std::optional<Pipeline> Context::get_compute_pipeline_if_ready(std::string_view name) {
+	return cache_impl->get_compute_pipeline_if_ready(pipeline_impl->get_compute_pipeline(name)->info);
+}
+
+Pipeline Context::get_or_create_pipeline(PipelineId id, VkRenderPass render_pass) {
+	auto pipeline = pipeline_impl->get_pipeline(id);
+	return cache_impl->get_or_create_pipeline(pipeline->info, pipeline->state_hash, impl::PipelineTarget{ .render_pass = render_pass });
+}
+
+Pipeline Context::get_or_create_compute_pipeline(PipelineId id) {
+	return cache_impl->get_or_create_compute_pipeline(pipeline_impl->get_compute_pipeline(id)->info);
+}
+
+std::optional<Pipeline> Context::get_pipeline_if_ready(PipelineId id, VkRenderPass render_pass) {
+	auto pipeline = pipeline_impl->get_pipeline(id);
+	return cache_impl->get_pipeline_if_ready(pipeline->info, pipeline->state_hash, impl::PipelineTarget{ .render_pass = render_pass });
+}
+
+Pipeline Context::get_or_create_pipeline(PipelineId id, RenderingFormats const& formats) {
+	auto pipeline = pipeline_impl->get_pipeline(id);
+	return cache_impl->get_or_create_pipeline(pipeline->info, pipeline->state_hash, impl::PipelineTarget{ .render_pass = nullptr, .formats = formats });
+}
+
+std::optional<Pipeline> Context::get_pipeline_if_ready(PipelineId id, RenderingFormats const& formats) {
+	auto pipeline = pipeline_impl->get_pipeline(id);
+	return cache_impl->get_pipeline_if_ready(pipeline->info, pipeline->state_hash, impl::PipelineTarget{ .render_pass = nullptr, .formats = formats });
+}
+
+std::optional<Pipeline> Context::get_compute_pipeline_if_ready(PipelineId id) {
+	return cache_impl->get_compute_pipeline_if_ready(pipeline_impl->get_compute_pipeline(id)->info);
+}
+
+uint32_t Context::get_pipeline_version(PipelineId id) {
+	return pipeline_impl->get_pipeline_version(id);
+}
+
+uint32_t Context::get_compute_pipeline_version(PipelineId id) {
+	return pipeline_impl->get_compute_pipeline_version(id);
 }
 
 #if PHOBOS_ENABLE_RAY_TRACING
@@ -446,8 +537,33 @@ Pipeline Context::get_or_create_ray_tracing_pipeline(std::string_view name) {
 
 #endif
 
-VkDescriptorSet Context::get_or_create(DescriptorSetBinding const& set_binding, Pipeline const& pipeline, void* pNext) {
-	return cache_impl->get_or_create_descriptor_set(set_binding, pipeline, pNext);
+VkDescriptorSet Context::get_or_create(DescriptorSetBinding const& set_binding, Pipeline const& pipeline, uint32_t set_index, void* pNext, uint32_t thread_index,
+	DescriptorLifetime lifetime) {
+	return cache_impl->get_or_create_descriptor_set(set_binding, pipeline, set_index, pNext, thread_index, lifetime);
+}
+
+void Context::push_descriptor_set(VkCommandBuffer cmd_buf, DescriptorSetBinding const& set_binding, Pipeline const& pipeline, uint32_t set_index) {
+	cache_impl->push_descriptor_set(cmd_buf, set_binding, pipeline, set_index);
+}
+
+void Context::begin_rendering(VkCommandBuffer cmd_buf, VkRenderingInfoKHR const& info) {
+	context_impl->begin_rendering(cmd_buf, info);
+}
+
+void Context::end_rendering(VkCommandBuffer cmd_buf) {
+	context_impl->end_rendering(cmd_buf);
+}
+
+void Context::pipeline_barrier2(VkCommandBuffer cmd_buf, VkDependencyInfoKHR const& info) {
+	context_impl->pipeline_barrier2(cmd_buf, info);
+}
+
+void Context::queue_submit2(VkQueue queue, VkSubmitInfo2KHR const& info, VkFence fence) {
+	context_impl->queue_submit2(queue, info, fence);
+}
+
+TransientMemoryStats Context::alias_transient_attachments(std::vector<TransientAttachmentUsage>& usages) {
+	return attachment_impl->alias_transient_attachments(usages);
 }
 
 #if PHOBOS_ENABLE_RAY_TRACING
@@ -0,0 +1,157 @@
+#include <phobos/descriptor_allocator.hpp>
+
+#include <cassert>
+#include <algorithm>
+
+namespace ph {
+
+DescriptorPoolAllocator::DescriptorPoolAllocator(VkDevice device, uint32_t sets_per_pool)
+	: device(device), sets_per_pool(sets_per_pool) {
+
+}
+
+DescriptorPoolAllocator::DescriptorPoolAllocator(DescriptorPoolAllocator&& rhs) noexcept {
+	*this = std::move(rhs);
+}
+
+DescriptorPoolAllocator& DescriptorPoolAllocator::operator=(DescriptorPoolAllocator&& rhs) noexcept {
+	if (this != &rhs) {
+		destroy_pools();
+		device = rhs.device;
+		sets_per_pool = rhs.sets_per_pool;
+		pools = std::move(rhs.pools);
+		idle_resets = std::move(rhs.idle_resets);
+		current_pool = rhs.current_pool;
+		sets_allocated = rhs.sets_allocated;
+		pools_evicted = rhs.pools_evicted;
+		pools_recreated = rhs.pools_recreated;
+		total_sets = rhs.total_sets;
+		total_descriptors = std::move(rhs.total_descriptors);
+
+		rhs.device = nullptr;
+		rhs.pools.clear();
+		rhs.idle_resets.clear();
+		rhs.current_pool = 0;
+		rhs.sets_allocated = 0;
+		rhs.total_sets = 0;
+	}
+	return *this;
+}
+
+DescriptorPoolAllocator::~DescriptorPoolAllocator() {
+	destroy_pools();
+}
+
+VkDescriptorSet DescriptorPoolAllocator::allocate(VkDescriptorSetLayout layout, std::vector<VkDescriptorPoolSize> const& layout_sizes, void* pNext) {
+	total_sets += 1;
+	for (VkDescriptorPoolSize const& size : layout_sizes) {
+		total_descriptors[size.type] += size.descriptorCount;
+	}
+
+	while (true) {
+		bool const new_pool = current_pool == pools.size();
+		if (new_pool) {
+			pools.push_back(create_pool(layout_sizes));
+			idle_resets.push_back(0);
+			// Every pool created after one was evicted counts as a recreation, until all evicted pools are made up for.
+			if (pools_recreated < pools_evicted) {
+				pools_recreated += 1;
+			}
+		}
+
+		VkDescriptorSetAllocateInfo info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.pNext = pNext,
+			.descriptorPool = pools[current_pool],
+			.descriptorSetCount = 1,
+			.pSetLayouts = &layout
+		};
+		VkDescriptorSet set = nullptr;
+		VkResult result = vkAllocateDescriptorSets(device, &info, &set);
+		if (result == VK_SUCCESS) {
+			sets_allocated += 1;
+			return set;
+		}
+
+		// A pool that was just created for this layout should always have room for it.
+		if (new_pool || (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL)) {
+			assert(false && "Failed to allocate descriptor set");
+			return nullptr;
+		}
+		// This pool is full, move on to the next one in the chain
+		current_pool += 1;
+	}
+}
+
+void DescriptorPoolAllocator::reset(uint32_t max_pools) {
+	for (size_t i = 0; i < pools.size(); ++i) {
+		if (i <= current_pool) {
+			vkResetDescriptorPool(device, pools[i], {});
+		}
+		bool const used = sets_allocated != 0 && i <= current_pool;
+		idle_resets[i] = used ? 0 : idle_resets[i] + 1;
+	}
+	current_pool = 0;
+	sets_allocated = 0;
+
+	// Pools are used in chain order, so the last pools are always the ones that have been idle the longest.
+	while (max_pools != 0 && pools.size() > max_pools && idle_resets.back() >= idle_resets_before_trim) {
+		vkDestroyDescriptorPool(device, pools.back(), nullptr);
+		pools.pop_back();
+		idle_resets.pop_back();
+		pools_evicted += 1;
+	}
+}
+
+DescriptorPoolStats DescriptorPoolAllocator::get_stats() const {
+	DescriptorPoolStats stats;
+	stats.pools_in_use = sets_allocated == 0 ? 0 : static_cast<uint32_t>(current_pool + 1);
+	stats.pool_count = static_cast<uint32_t>(pools.size());
+	stats.sets_allocated = sets_allocated;
+	stats.pools_evicted = pools_evicted;
+	stats.pools_recreated = pools_recreated;
+	return stats;
+}
+
+VkDescriptorPool DescriptorPoolAllocator::create_pool(std::vector<VkDescriptorPoolSize> const& layout_sizes) {
+	std::vector<VkDescriptorPoolSize> pool_sizes;
+	for (auto const& [type, count] : total_descriptors) {
+		// Round up, so types that only show up in a few layouts still get some room
+		uint64_t const per_set = (count + total_sets - 1) / total_sets;
+		uint32_t pool_count = static_cast<uint32_t>(per_set * sets_per_pool);
+		// The pool must at least be able to hold the set we are allocating right now
+		for (VkDescriptorPoolSize const& size : layout_sizes) {
+			if (size.type == type) pool_count = std::max(pool_count, size.descriptorCount);
+		}
+		if (pool_count > 0) {
+			pool_sizes.push_back(VkDescriptorPoolSize{ type, pool_count });
+		}
+	}
+
+	// vkCreateDescriptorPool requires at least one pool size, even if the layouts are empty.
+	if (pool_sizes.empty()) {
+		pool_sizes.push_back(VkDescriptorPoolSize{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 });
+	}
+
+	VkDescriptorPoolCreateInfo dpci{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = {},
+		.maxSets = sets_per_pool,
+		.poolSizeCount = (uint32_t)pool_sizes.size(),
+		.pPoolSizes = pool_sizes.data()
+	};
+	VkDescriptorPool pool = nullptr;
+	vkCreateDescriptorPool(device, &dpci, nullptr, &pool);
+	return pool;
+}
+
+void DescriptorPoolAllocator::destroy_pools() {
+	for (VkDescriptorPool pool : pools) {
+		vkDestroyDescriptorPool(device, pool, nullptr);
+	}
+	pools.clear();
+	idle_resets.clear();
+}
+
+}
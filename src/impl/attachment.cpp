@@ -25,13 +25,27 @@ AttachmentImpl::~AttachmentImpl() {
 			}
 		}
 	}
+	// Old images may still be bound to memory that is waiting to be freed, so they go first.
+	for (DeferredDelete& deferred : deferred_delete) {
+		img->destroy_image_view(deferred.attachment.view);
+		img->destroy_image(*deferred.attachment.image);
+	}
+	for (DeferredFree& deferred : deferred_free) {
+		vmaFreeMemory(ctx->allocator, deferred.memory);
+	}
+	// Transient attachments don't own their memory
+	for (TransientGroup& group : transient_groups) {
+		for (TransientBlock& block : group.blocks) {
+			vmaFreeMemory(ctx->allocator, block.memory);
+		}
+	}
 }
 
 
 Attachment AttachmentImpl::get_attachment(std::string_view name) {
 	std::string key{ name };
 	if (auto it = attachments.find(key); it != attachments.end()) {
-		return { it->second.view, it->second.image };
+		return { it->second.view, it->second.image, it->second.transient };
 	}
 	return {};
 }
@@ -71,6 +85,204 @@ void AttachmentImpl::create_attachment(std::string_view name, VkExtent2D size, V
     ctx->name_object(attachment.view, name.data() + " - view"s);
 }
 
+void AttachmentImpl::create_transient_attachment(std::string_view name, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, uint32_t layers, ImageType type) {
+	// The attachment gets its own memory until a render graph places it in a shared block.
+	create_attachment(name, size, format, samples, layers, type);
+	attachments.at(std::string{ name }).transient = true;
+}
+
+bool AttachmentImpl::is_transient_placement_valid(TransientGroup const& group, std::vector<TransientAttachmentUsage> const& usages) const {
+	if (usages.size() != group.usages.size()) return false;
+	for (size_t i = 0; i < usages.size(); ++i) {
+		TransientPlacement const& placement = group.usages[i];
+		if (usages[i].name != placement.name || usages[i].first_pass != placement.first_pass || usages[i].last_pass != placement.last_pass) {
+			return false;
+		}
+	}
+	// Transient attachments that were created or resized since then have their own memory and must be placed again.
+	return std::all_of(group.usages.begin(), group.usages.end(), [this](TransientPlacement const& placement) {
+		auto it = attachments.find(placement.name);
+		return it != attachments.end() && it->second.transient && it->second.image->memory == nullptr;
+	});
+}
+
+void AttachmentImpl::restore_own_memory(std::string const& name, InternalAttachment& attachment) {
+	// The old image may still be in use by frames in flight.
+	deferred_delete.push_back({ .attachment = attachment, .frames_left = ctx->max_frames_in_flight + 2 });
+	RawImage const old = *attachment.image;
+	attachment.image = img->create_image(old.type, old.size, old.format, old.samples, old.mip_levels, old.layers);
+	attachment.view = img->create_image_view(*attachment.image, is_depth_format(old.format) ? ImageAspect::Depth : ImageAspect::Color);
+
+	ctx->name_object(attachment.image->handle, name + " - image");
+	ctx->name_object(attachment.view, name + " - view");
+}
+
+TransientMemoryStats AttachmentImpl::alias_transient_attachments(std::vector<TransientAttachmentUsage>& usages) {
+	for (TransientGroup const& group : transient_groups) {
+		if (is_transient_placement_valid(group, usages)) {
+			for (size_t i = 0; i < usages.size(); ++i) {
+				usages[i].aliases = group.usages[i].aliases;
+			}
+			return group.stats;
+		}
+	}
+
+	auto is_used = [&usages](std::string const& name) {
+		return std::any_of(usages.begin(), usages.end(), [&name](TransientAttachmentUsage const& usage) { return usage.name == name; });
+	};
+	// Earlier placements of these attachments are replaced. Their other attachments no longer have a known lifetime relative to
+	// the rest of the block, so they get their own memory again instead of sharing it.
+	for (auto group = transient_groups.begin(); group != transient_groups.end();) {
+		bool const replaced = std::any_of(group->usages.begin(), group->usages.end(), [&is_used](TransientPlacement const& placement) {
+			return is_used(placement.name);
+		});
+		if (!replaced) {
+			++group;
+			continue;
+		}
+		for (TransientPlacement const& placement : group->usages) {
+			if (is_used(placement.name)) continue;
+			auto it = attachments.find(placement.name);
+			// Attachments that were resized already have their own memory
+			if (it == attachments.end() || it->second.image->memory != nullptr) continue;
+			restore_own_memory(it->first, it->second);
+		}
+		for (TransientBlock& block : group->blocks) {
+			deferred_free.push_back({ .memory = block.memory, .frames_left = ctx->max_frames_in_flight + 2 });
+		}
+		group = transient_groups.erase(group);
+	}
+
+	struct Candidate {
+		std::string const* name = nullptr;
+		InternalAttachment* attachment = nullptr;
+		// Index into usages
+		uint32_t usage = 0;
+		RawImage image{};
+		VkMemoryRequirements requirements{};
+	};
+
+	// An image can only be bound to memory once, so every placed attachment gets a new image.
+	// Only attachments used by the graph are placed, the others keep the memory they have.
+	std::vector<Candidate> candidates;
+	for (uint32_t i = 0; i < usages.size(); ++i) {
+		auto it = attachments.find(std::string{ usages[i].name });
+		if (it == attachments.end() || !it->second.transient) continue;
+		Candidate candidate{ .name = &it->first, .attachment = &it->second, .usage = i };
+		RawImage const& old = *it->second.image;
+		candidate.image = img->create_unbound_image(old.type, old.size, old.format, old.samples, old.mip_levels, old.layers);
+		vkGetImageMemoryRequirements(ctx->device, candidate.image.handle, &candidate.requirements);
+		candidates.push_back(candidate);
+	}
+	// Placing the largest attachments first keeps blocks from growing.
+	std::sort(candidates.begin(), candidates.end(), [](Candidate const& a, Candidate const& b) {
+		return a.requirements.size > b.requirements.size;
+	});
+
+	auto overlaps = [&usages](uint32_t a, uint32_t b) {
+		return usages[a].first_pass <= usages[b].last_pass && usages[b].first_pass <= usages[a].last_pass;
+	};
+
+	// Every attachment is placed at the start of the first block it fits in.
+	TransientGroup group{};
+	std::vector<TransientBlock>& blocks = group.blocks;
+	std::vector<size_t> candidate_blocks(candidates.size());
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		Candidate const& candidate = candidates[i];
+		auto fits = [&candidate, &overlaps](TransientBlock const& block) {
+			if ((block.requirements.memoryTypeBits & candidate.requirements.memoryTypeBits) == 0) return false;
+			return std::none_of(block.residents.begin(), block.residents.end(), [&candidate, &overlaps](uint32_t resident) {
+				return overlaps(resident, candidate.usage);
+			});
+		};
+		auto block = std::find_if(blocks.begin(), blocks.end(), fits);
+		if (block == blocks.end()) {
+			block = blocks.insert(blocks.end(), TransientBlock{ .memory = nullptr, .requirements = candidate.requirements, .residents = {} });
+		}
+		else {
+			block->requirements.size = std::max(block->requirements.size, candidate.requirements.size);
+			block->requirements.alignment = std::max(block->requirements.alignment, candidate.requirements.alignment);
+			block->requirements.memoryTypeBits &= candidate.requirements.memoryTypeBits;
+		}
+		block->residents.push_back(candidate.usage);
+		candidate_blocks[i] = static_cast<size_t>(block - blocks.begin());
+	}
+
+	VmaAllocationCreateInfo alloc_info{};
+	alloc_info.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
+	alloc_info.flags = VmaAllocationCreateFlagBits::VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT;
+	bool allocated = true;
+	for (TransientBlock& block : blocks) {
+		if (vmaAllocateMemory(ctx->allocator, &block.requirements, &alloc_info, &block.memory, nullptr) != VK_SUCCESS) {
+			block.memory = nullptr;
+			allocated = false;
+		}
+	}
+	// Without the shared memory, every attachment keeps or gets back its own memory and nothing is aliased.
+	if (!allocated) {
+		ctx->log(ph::LogSeverity::Warning, "Failed to allocate memory for transient attachments, they will not share memory");
+		for (TransientBlock& block : blocks) {
+			if (block.memory) vmaFreeMemory(ctx->allocator, block.memory);
+		}
+		for (Candidate& candidate : candidates) {
+			img->destroy_image(candidate.image);
+			// Attachments of a replaced placement still use memory that is about to be freed
+			if (candidate.attachment->image->memory == nullptr) {
+				restore_own_memory(*candidate.name, *candidate.attachment);
+			}
+		}
+		for (TransientAttachmentUsage& usage : usages) {
+			usage.aliases = std::nullopt;
+		}
+		return TransientMemoryStats{};
+	}
+
+	// The old images may still be in use by frames in flight.
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		Candidate& candidate = candidates[i];
+		InternalAttachment& attachment = *candidate.attachment;
+		deferred_delete.push_back({ .attachment = attachment, .frames_left = ctx->max_frames_in_flight + 2 });
+		vmaBindImageMemory(ctx->allocator, blocks[candidate_blocks[i]].memory, candidate.image.handle);
+		attachment.image = candidate.image;
+		attachment.view = img->create_image_view(*attachment.image, is_depth_format(candidate.image.format) ? ImageAspect::Depth : ImageAspect::Color);
+
+		ctx->name_object(attachment.image->handle, *candidate.name + " - image");
+		ctx->name_object(attachment.view, *candidate.name + " - view");
+	}
+
+	for (TransientAttachmentUsage& usage : usages) {
+		usage.aliases = std::nullopt;
+	}
+	for (TransientBlock& block : blocks) {
+		// An attachment that has a block to itself does not alias anything.
+		if (block.residents.size() < 2) continue;
+		std::sort(block.residents.begin(), block.residents.end(), [&usages](uint32_t a, uint32_t b) {
+			return usages[a].first_pass < usages[b].first_pass;
+		});
+		for (size_t i = 0; i < block.residents.size(); ++i) {
+			// The first attachment in the block follows the last one of the previous frame.
+			size_t const previous = i == 0 ? block.residents.size() - 1 : i - 1;
+			usages[block.residents[i]].aliases = block.residents[previous];
+		}
+	}
+
+	group.stats = TransientMemoryStats{ .attachments = static_cast<uint32_t>(candidates.size()), .memory_blocks = static_cast<uint32_t>(blocks.size()) };
+	for (Candidate const& candidate : candidates) {
+		group.stats.required_bytes += candidate.requirements.size;
+	}
+	for (TransientBlock const& block : blocks) {
+		group.stats.allocated_bytes += block.requirements.size;
+	}
+	group.stats.saved_bytes = group.stats.required_bytes - group.stats.allocated_bytes;
+
+	for (TransientAttachmentUsage const& usage : usages) {
+		group.usages.push_back(TransientPlacement{ .name = std::string{ usage.name }, .first_pass = usage.first_pass, .last_pass = usage.last_pass, .aliases = usage.aliases });
+	}
+	TransientMemoryStats const stats = group.stats;
+	transient_groups.push_back(std::move(group));
+	return stats;
+}
+
 void AttachmentImpl::resize_attachment(std::string_view name, VkExtent2D new_size) {
 	Attachment att = get_attachment(name);
 	if (!att) {
@@ -108,7 +320,7 @@ std::string AttachmentImpl::get_swapchain_attachment_name() const {
 
 
 void AttachmentImpl::new_frame(ImageView& swapchain_view) {
-	attachments[swapchain_attachment_name] = InternalAttachment{ .view = swapchain_view , std::nullopt };
+	attachments[swapchain_attachment_name] = InternalAttachment{ .view = swapchain_view, .image = std::nullopt };
 
 	// Update deferred deletion list
 	for (auto& deferred : deferred_delete) {
@@ -127,6 +339,19 @@ void AttachmentImpl::new_frame(ImageView& swapchain_view) {
 				return entry.frames_left == 0; 
 			}), 
 		deferred_delete.end());
+
+	for (auto& deferred : deferred_free) {
+		deferred.frames_left -= 1;
+		if (deferred.frames_left == 0) {
+			vmaFreeMemory(ctx->allocator, deferred.memory);
+		}
+	}
+	deferred_free.erase(
+		std::remove_if(deferred_free.begin(), deferred_free.end(),
+			[](DeferredFree const& entry) {
+				return entry.frames_left == 0;
+			}),
+		deferred_free.end());
 }
 
 } // namespace impl
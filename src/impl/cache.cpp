@@ -5,48 +5,177 @@
 #include <phobos/impl/cache.hpp>
 #include <phobos/impl/context.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
 
 namespace ph {
 namespace impl {
 
+// Phobos prepends this to the cache data on disk. The driver version is not part of the vulkan cache header, 
+// so we store it here to be able to discard caches from older drivers.
+struct PipelineCacheFileHeader {
+	static constexpr uint32_t magic_value = 0x50484243; // 'PHBC'
+
+	uint32_t magic = magic_value;
+	uint32_t driver_version = 0;
+	uint64_t data_size = 0;
+};
+
+static std::vector<char> load_pipeline_cache_data(Context& ctx, std::string const& path) {
+	if (path.empty()) return {};
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return {};
+
+	std::vector<char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	PipelineCacheFileHeader file_header;
+	if (contents.size() < sizeof(PipelineCacheFileHeader) + sizeof(VkPipelineCacheHeaderVersionOne)) {
+		ctx.logger()->write_fmt(LogSeverity::Warning, "Pipeline cache file {} is too small, ignoring it.", path);
+		return {};
+	}
+	std::memcpy(&file_header, contents.data(), sizeof(PipelineCacheFileHeader));
+	if (file_header.magic != PipelineCacheFileHeader::magic_value || file_header.data_size != contents.size() - sizeof(PipelineCacheFileHeader)) {
+		ctx.logger()->write_fmt(LogSeverity::Warning, "Pipeline cache file {} is corrupted, ignoring it.", path);
+		return {};
+	}
+
+	VkPipelineCacheHeaderVersionOne vk_header;
+	std::memcpy(&vk_header, contents.data() + sizeof(PipelineCacheFileHeader), sizeof(VkPipelineCacheHeaderVersionOne));
+	VkPhysicalDeviceProperties const& properties = ctx.get_physical_device().properties;
+	if (vk_header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		|| vk_header.vendorID != properties.vendorID
+		|| vk_header.deviceID != properties.deviceID
+		|| file_header.driver_version != properties.driverVersion
+		|| std::memcmp(vk_header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+		ctx.logger()->write_fmt(LogSeverity::Info, "Pipeline cache file {} was created by a different device or driver, ignoring it.", path);
+		return {};
+	}
+
+	contents.erase(contents.begin(), contents.begin() + sizeof(PipelineCacheFileHeader));
+	return contents;
+}
+
+RenderPassCompatibility RenderPassCompatibility::from_render_pass(VkRenderPassCreateInfo const& info) {
+	RenderPassCompatibility compatibility{};
+	for (uint32_t i = 0; i < info.attachmentCount; ++i) {
+		compatibility.formats.push_back(info.pAttachments[i].format);
+		compatibility.samples.push_back(info.pAttachments[i].samples);
+	}
+	auto references = [](uint32_t count, VkAttachmentReference const* refs) {
+		std::vector<uint32_t> attachments;
+		for (uint32_t i = 0; refs && i < count; ++i) {
+			attachments.push_back(refs[i].attachment);
+		}
+		return attachments;
+	};
+	for (uint32_t i = 0; i < info.subpassCount; ++i) {
+		VkSubpassDescription const& subpass = info.pSubpasses[i];
+		compatibility.subpasses.push_back(Subpass{
+			.colors = references(subpass.colorAttachmentCount, subpass.pColorAttachments),
+			.inputs = references(subpass.inputAttachmentCount, subpass.pInputAttachments),
+			.resolves = references(subpass.colorAttachmentCount, subpass.pResolveAttachments),
+			.depth_stencil = subpass.pDepthStencilAttachment ? std::optional(subpass.pDepthStencilAttachment->attachment) : std::nullopt
+		});
+	}
+
+	size_t& h = compatibility.hash;
+	hash_combine(h, compatibility.formats, compatibility.samples, compatibility.subpasses.size());
+	for (Subpass const& subpass : compatibility.subpasses) {
+		hash_combine(h, subpass.colors, subpass.inputs, subpass.resolves, subpass.depth_stencil.value_or(VK_ATTACHMENT_UNUSED));
+	}
+	return compatibility;
+}
+
+RenderPassCompatibility RenderPassCompatibility::from_formats(RenderingFormats const& formats) {
+	RenderPassCompatibility compatibility{};
+	compatibility.rendering_formats = formats;
+	// Tagged so a format class never hashes like a render pass class
+	hash_combine(compatibility.hash, VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR, formats);
+	return compatibility;
+}
+
+RenderPassCompatibility RenderPassCompatibility::from_foreign_render_pass(VkRenderPass pass) {
+	RenderPassCompatibility compatibility{};
+	compatibility.foreign_render_pass = pass;
+	hash_combine(compatibility.hash, pass);
+	return compatibility;
+}
+
 CacheImpl::CacheImpl(Context& ctx, AppSettings const& settings) : ctx(&ctx),
-	framebuffer(settings.max_frames_in_flight + 2),
-	renderpass(settings.max_frames_in_flight + 2),
-	set_layout(settings.max_frames_in_flight + 2),
-	pipeline_layout(settings.max_frames_in_flight + 2),
-	pipeline(settings.max_frames_in_flight + 2),
-	compute_pipeline(settings.max_frames_in_flight + 2),
-#if PHOBOS_ENABLE_RAY_TRACING
-	rtx_pipeline(settings.max_frames_in_flight + 2),
-#endif
-	shader(settings.max_frames_in_flight + 2) {
-
-	VkDescriptorPoolCreateInfo dpci{};
-	dpci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	dpci.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-	dpci.pNext = nullptr;
-	VkDescriptorPoolSize pool_sizes[]{
-		VkDescriptorPoolSize{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, sets_per_type },
-		VkDescriptorPoolSize{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, sets_per_type },
-		VkDescriptorPoolSize{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, sets_per_type },
-		VkDescriptorPoolSize{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, sets_per_type },
+	framebuffer(settings.cache_retention.framebuffers, settings.max_frames_in_flight + 2),
+	renderpass(settings.cache_retention.render_passes, settings.max_frames_in_flight + 2),
+	set_layout(settings.cache_retention.pipelines, settings.max_frames_in_flight + 2),
+	pipeline_layout(settings.cache_retention.pipelines, settings.max_frames_in_flight + 2),
+	pipeline(settings.cache_retention.pipelines, settings.max_frames_in_flight + 2),
+	compute_pipeline(settings.cache_retention.pipelines, settings.max_frames_in_flight + 2),
 #if PHOBOS_ENABLE_RAY_TRACING
-		VkDescriptorPoolSize{VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, sets_per_type },
+	rtx_pipeline(settings.cache_retention.pipelines, settings.max_frames_in_flight + 2),
 #endif
+	shader(settings.max_frames_in_flight + 2),
+	shader_module(settings.cache_retention.shader_modules, settings.max_frames_in_flight + 2),
+	pipeline_cache_path(settings.pipeline_cache_path),
+	max_descriptor_pools(settings.cache_retention.max_descriptor_pools) {
+
+	descriptor_shards = RingBuffer<std::vector<DescriptorShard>>{ settings.max_frames_in_flight };
+	// One shard per thread index, plus one for the main thread
+	uint32_t const shard_count = ctx.thread_count() + 1;
+	for (size_t i = 0; i < descriptor_shards.size(); ++i) {
+		std::vector<DescriptorShard> shards;
+		shards.reserve(shard_count);
+		for (uint32_t thread = 0; thread < shard_count; ++thread) {
+			shards.push_back(DescriptorShard{ .sets = {}, .allocator = DescriptorPoolAllocator(ctx.device(), sets_per_pool) });
+		}
+		descriptor_shards.set(i, std::move(shards));
+	}
+	// The main thread never calls end_thread(), so it has no thread shard.
+	thread_descriptor_shards.reserve(ctx.thread_count());
+	for (uint32_t thread = 0; thread < ctx.thread_count(); ++thread) {
+		thread_descriptor_shards.push_back(DescriptorShard{ .sets = {}, .allocator = DescriptorPoolAllocator(ctx.device(), sets_per_pool) });
+	}
+
+	if (settings.bindless_sampled_images > 0 || settings.bindless_storage_images > 0 || settings.bindless_storage_buffers > 0) {
+		bindless_heap = std::make_unique<BindlessHeap>(ctx, settings);
+	}
+
+	if (settings.enable_push_descriptors) {
+		push_descriptor_fun = reinterpret_cast<PFN_vkCmdPushDescriptorSetKHR>(vkGetDeviceProcAddr(ctx.device(), "vkCmdPushDescriptorSetKHR"));
+	}
+
+	std::vector<char> cache_data = load_pipeline_cache_data(ctx, pipeline_cache_path);
+	VkPipelineCacheCreateInfo pcci{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = {},
+		.initialDataSize = cache_data.size(),
+		.pInitialData = cache_data.empty() ? nullptr : cache_data.data()
 	};
-	dpci.maxSets = sets_per_type * sizeof(pool_sizes) / sizeof(VkDescriptorPoolSize);
-	dpci.poolSizeCount = sizeof(pool_sizes) / sizeof(VkDescriptorPoolSize);
-	dpci.pPoolSizes = pool_sizes;
-	vkCreateDescriptorPool(ctx.device(), &dpci, nullptr, &descr_pool);
+	VkResult result = vkCreatePipelineCache(ctx.device(), &pcci, nullptr, &pipeline_cache);
+	if (result != VK_SUCCESS && !cache_data.empty()) {
+		// The driver rejected our data, start from an empty cache instead
+		pcci.initialDataSize = 0;
+		pcci.pInitialData = nullptr;
+		vkCreatePipelineCache(ctx.device(), &pcci, nullptr, &pipeline_cache);
+	}
 
-	descriptor_set = RingBuffer<Cache<DescriptorSetBinding, VkDescriptorSet>>{ settings.max_frames_in_flight };
-	for (auto& set_cache : descriptor_set) {
-		set_cache.set_max_frames(settings.max_frames_in_flight + 2);
+	for (uint32_t i = 0; i < settings.pipeline_compile_threads; ++i) {
+		compile_workers.emplace_back([this]() { compile_worker(); });
 	}
 }
 
 CacheImpl::~CacheImpl() {
+	// Stop compile workers before destroying anything they might be using. Jobs that were not started yet are dropped.
+	{
+		std::lock_guard lock(compile_mutex);
+		stop_compile_workers = true;
+	}
+	compile_queue_cv.notify_all();
+	for (std::thread& worker : compile_workers) {
+		worker.join();
+	}
+
 	// Clear out all caches
 	framebuffer.foreach([this](VkFramebuffer framebuf) {
 		vkDestroyFramebuffer(ctx->device(), framebuf, nullptr);
@@ -57,6 +186,11 @@ CacheImpl::~CacheImpl() {
 	set_layout.foreach([this](VkDescriptorSetLayout set_layout) {
 		vkDestroyDescriptorSetLayout(ctx->device(), set_layout, nullptr);
 	});
+	for (auto const& [_, layout_info] : set_layout_info) {
+		if (layout_info.update_template) {
+			vkDestroyDescriptorUpdateTemplate(ctx->device(), layout_info.update_template, nullptr);
+		}
+	}
 	pipeline_layout.foreach([this](ph::PipelineLayout ppl_layout) {
 		vkDestroyPipelineLayout(ctx->device(), ppl_layout.handle, nullptr);
 	});
@@ -71,7 +205,123 @@ CacheImpl::~CacheImpl() {
 		vkDestroyPipeline(ctx->device(), pipeline.handle, nullptr);
 	});
 #endif
-	vkDestroyDescriptorPool(ctx->device(), descr_pool, nullptr);
+	shader_module.foreach([this](VkShaderModule module) {
+		vkDestroyShaderModule(ctx->device(), module, nullptr);
+	});
+	save_pipeline_cache();
+	vkDestroyPipelineCache(ctx->device(), pipeline_cache, nullptr);
+}
+
+void CacheImpl::save_pipeline_cache() {
+	if (pipeline_cache_path.empty() || !pipeline_cache) return;
+
+	size_t size = 0;
+	vkGetPipelineCacheData(ctx->device(), pipeline_cache, &size, nullptr);
+	std::vector<char> data(sizeof(PipelineCacheFileHeader) + size);
+	VkResult result = vkGetPipelineCacheData(ctx->device(), pipeline_cache, &size, data.data() + sizeof(PipelineCacheFileHeader));
+	if (result != VK_SUCCESS) {
+		ctx->logger()->write(LogSeverity::Warning, "Failed to retrieve pipeline cache data.");
+		return;
+	}
+
+	PipelineCacheFileHeader file_header;
+	file_header.driver_version = ctx->get_physical_device().properties.driverVersion;
+	file_header.data_size = size;
+	std::memcpy(data.data(), &file_header, sizeof(PipelineCacheFileHeader));
+
+	// Write to a temporary file first and then rename it, so a crash halfway through writing never leaves a broken cache behind.
+	std::string const tmp_path = pipeline_cache_path + ".tmp";
+	std::error_code error;
+	{
+		std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+		file.write(data.data(), sizeof(PipelineCacheFileHeader) + size);
+		// Close before checking, so a failed flush is caught and the file can be removed afterwards.
+		file.close();
+		if (!file) {
+			ctx->logger()->write_fmt(LogSeverity::Warning, "Failed to write pipeline cache to {}.", tmp_path);
+			std::filesystem::remove(tmp_path, error);
+			return;
+		}
+	}
+	std::filesystem::rename(tmp_path, pipeline_cache_path, error);
+	if (error) {
+		std::string const reason = error.message();
+		ctx->logger()->write_fmt(LogSeverity::Warning, "Failed to move pipeline cache to {}: {}", pipeline_cache_path, reason);
+		// Don't leave the temporary file behind, it would never be read or cleaned up.
+		std::filesystem::remove(tmp_path, error);
+	}
+}
+
+void CacheImpl::compile_worker() {
+	while (true) {
+		std::pair<std::shared_ptr<CompileClaim>, std::function<void()>> job;
+		{
+			std::unique_lock lock(compile_mutex);
+			compile_queue_cv.wait(lock, [this]() { return stop_compile_workers || !compile_queue.empty(); });
+			if (stop_compile_workers) return;
+			job = std::move(compile_queue.front());
+			compile_queue.pop_front();
+			job.first->started = true;
+		}
+
+		job.second();
+		release_compile(job.first);
+	}
+}
+
+template<typename Key>
+void CacheImpl::enqueue_compile(CompileClaims<Key>& claims, Key const& key, std::function<void()> job) {
+	{
+		std::lock_guard lock(compile_mutex);
+		if (claims.find(key)) return;
+		compile_queue.emplace_back(claims.claim(key, false), std::move(job));
+	}
+	compile_queue_cv.notify_one();
+}
+
+void CacheImpl::release_compile(std::shared_ptr<CompileClaim> const& claim) {
+	{
+		std::lock_guard lock(compile_mutex);
+		claim->done = true;
+	}
+	compile_done_cv.notify_all();
+}
+
+template<typename Key, typename Create>
+Pipeline CacheImpl::find_or_compile(Cache<Key, ph::Pipeline>& cache, CompileClaims<Key>& claims, Key const& key, PipelineLayoutCreateInfo const& plci, Create&& create) {
+	while (true) {
+		// Also registers usage for set and pipeline layout if found
+		if (std::optional<Pipeline> pipeline = find_pipeline(cache, key, plci)) {
+			return *pipeline;
+		}
+
+		std::shared_ptr<CompileClaim> claim;
+		{
+			std::unique_lock lock(compile_mutex);
+			claim = claims.find(key);
+			if (claim && claim->started) {
+				// Waiting for the other compile is cheaper than compiling the pipeline a second time.
+				compile_done_cv.wait(lock, [&claim]() { return claim->done; });
+				continue;
+			}
+			if (claim) {
+				// No worker picked up the job yet, take it out of the queue.
+				claim->started = true;
+				std::erase_if(compile_queue, [&claim](auto const& job) { return job.first == claim; });
+			}
+			else {
+				claim = claims.claim(key, true);
+			}
+		}
+
+		// The pipeline may have been inserted between the lookup and the claim
+		std::optional<Pipeline> pipeline = find_pipeline(cache, key, plci);
+		if (!pipeline) {
+			pipeline = create();
+		}
+		release_compile(claim);
+		return *pipeline;
+	}
 }
 
 VkFramebuffer CacheImpl::get_or_create_framebuffer(VkFramebufferCreateInfo const& info, std::string const& name) {
@@ -82,7 +332,12 @@ VkFramebuffer CacheImpl::get_or_create_framebuffer(VkFramebufferCreateInfo const
 
 	VkFramebuffer framebuf = nullptr;
 	vkCreateFramebuffer(ctx->device(), &info, nullptr, &framebuf);
-	framebuffer.insert(info, framebuf);
+	auto const [stored, inserted] = framebuffer.insert(info, framebuf);
+	if (!inserted) {
+		// Another thread created the same framebuffer in the meantime
+		vkDestroyFramebuffer(ctx->device(), framebuf, nullptr);
+		return *stored;
+	}
 	ctx->name_object(framebuf, name);
 	return framebuf;
 }
@@ -95,17 +350,30 @@ VkRenderPass CacheImpl::get_or_create_renderpass(VkRenderPassCreateInfo const& i
 
 	VkRenderPass pass = nullptr;
 	vkCreateRenderPass(ctx->device(), &info, nullptr, &pass);
-	renderpass.insert(info, pass);
+	auto const [stored, inserted] = renderpass.insert(info, pass);
+	if (!inserted) {
+		// Another thread created the same render pass in the meantime
+		vkDestroyRenderPass(ctx->device(), pass, nullptr);
+		return *stored;
+	}
+	{
+		std::lock_guard lock(variant_mutex);
+		renderpass_class[pass] = std::make_shared<RenderPassCompatibility const>(RenderPassCompatibility::from_render_pass(info));
+	}
 	ctx->name_object(pass, name);
 	return pass;
 }
 
 VkDescriptorSetLayout CacheImpl::get_or_create_descriptor_set_layout(DescriptorSetLayoutCreateInfo const& dslci) {
+	std::lock_guard lock(layout_mutex);
 	auto set_layout_opt = set_layout.get(dslci);
 	if (!set_layout_opt) {
 		// We have to create the descriptor set layout here
 		VkDescriptorSetLayoutCreateInfo set_layout_info{ };
 		set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		if (dslci.push_descriptor) {
+			set_layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+		}
 		set_layout_info.bindingCount = dslci.bindings.size();
 		set_layout_info.pBindings = dslci.bindings.data();
 		VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info{};
@@ -118,6 +386,67 @@ VkDescriptorSetLayout CacheImpl::get_or_create_descriptor_set_layout(DescriptorS
 		}
 		VkDescriptorSetLayout set_layout = nullptr;
 		vkCreateDescriptorSetLayout(ctx->device(), &set_layout_info, nullptr, &set_layout);
+
+		SetLayoutInfo& layout_info = this->set_layout_info[set_layout];
+		layout_info.push_descriptor = dslci.push_descriptor;
+		for (size_t i = 0; i < dslci.bindings.size(); ++i) {
+			VkDescriptorSetLayoutBinding const& binding = dslci.bindings[i];
+			if (!dslci.flags.empty() && (dslci.flags[i] & VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT)) {
+				layout_info.has_variable_count = true;
+				layout_info.variable_count_type = binding.descriptorType;
+				continue;
+			}
+			auto it = std::find_if(layout_info.sizes.begin(), layout_info.sizes.end(), [&binding](VkDescriptorPoolSize const& size) {
+				return size.type == binding.descriptorType;
+			});
+			if (it != layout_info.sizes.end()) it->descriptorCount += binding.descriptorCount;
+			else layout_info.sizes.push_back(VkDescriptorPoolSize{ binding.descriptorType, binding.descriptorCount });
+		}
+
+		// Create an update template for the reflected layout. The amount of descriptors written to variable or partially bound bindings
+		// is only known when writing, so sets with these layouts are written with vkUpdateDescriptorSets instead.
+		// Push descriptor sets are never allocated, so they do not need a template either.
+		bool const can_use_template = !dslci.push_descriptor && std::none_of(dslci.flags.begin(), dslci.flags.end(), [](VkDescriptorBindingFlags flags) {
+			return (flags & (VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT)) != 0;
+		});
+		if (can_use_template) {
+			// Pack the template in binding order, which is the order DescriptorBuilder keeps the bindings of a set in.
+			std::vector<VkDescriptorSetLayoutBinding> sorted_bindings = dslci.bindings;
+			std::sort(sorted_bindings.begin(), sorted_bindings.end(), [](VkDescriptorSetLayoutBinding const& lhs, VkDescriptorSetLayoutBinding const& rhs) {
+				return lhs.binding < rhs.binding;
+			});
+			std::vector<VkDescriptorUpdateTemplateEntry> entries;
+			entries.reserve(sorted_bindings.size());
+			for (VkDescriptorSetLayoutBinding const& binding : sorted_bindings) {
+				if (binding.descriptorCount == 0) continue;
+				entries.push_back(VkDescriptorUpdateTemplateEntry{
+					.dstBinding = binding.binding,
+					.dstArrayElement = 0,
+					.descriptorCount = binding.descriptorCount,
+					.descriptorType = binding.descriptorType,
+					.offset = layout_info.template_descriptor_count * sizeof(DescriptorTemplateEntry),
+					.stride = sizeof(DescriptorTemplateEntry)
+				});
+				layout_info.template_bindings.push_back(binding);
+				layout_info.template_descriptor_count += binding.descriptorCount;
+			}
+			if (!entries.empty()) {
+				VkDescriptorUpdateTemplateCreateInfo template_info{
+					.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO,
+					.pNext = nullptr,
+					.flags = {},
+					.descriptorUpdateEntryCount = (uint32_t)entries.size(),
+					.pDescriptorUpdateEntries = entries.data(),
+					.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET,
+					.descriptorSetLayout = set_layout,
+					// The fields below are ignored for descriptor set templates
+					.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+					.pipelineLayout = nullptr,
+					.set = 0
+				};
+				vkCreateDescriptorUpdateTemplate(ctx->device(), &template_info, nullptr, &layout_info.update_template);
+			}
+		}
 		// Store for further use when creating the pipeline layout
 		this->set_layout.insert(dslci, set_layout);
 		return set_layout;
@@ -127,31 +456,103 @@ VkDescriptorSetLayout CacheImpl::get_or_create_descriptor_set_layout(DescriptorS
 	}
 }
 
-PipelineLayout CacheImpl::get_or_create_pipeline_layout(PipelineLayoutCreateInfo const& plci, VkDescriptorSetLayout set_layout) {
-	// Create or get pipeline layout from cache
-	auto pipeline_layout_opt = pipeline_layout.get(plci);
-	if (!pipeline_layout_opt) {
-		// We have to create a new pipeline layout
-		VkPipelineLayoutCreateInfo layout_create_info{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-			.pNext = nullptr,
-			.flags = {},
-			.setLayoutCount = 1,
-			.pSetLayouts = &set_layout,
-			.pushConstantRangeCount = (uint32_t)plci.push_constants.size(),
-			.pPushConstantRanges = plci.push_constants.data(),
-		};
-		VkPipelineLayout vk_layout = nullptr;
-		vkCreatePipelineLayout(ctx->device(), &layout_create_info, nullptr, &vk_layout);
-		PipelineLayout layout;
-		layout.handle = vk_layout;
-		layout.set_layout = set_layout;
-		this->pipeline_layout.insert(plci, layout);
-		return layout;
+PipelineLayout CacheImpl::get_or_create_pipeline_layout(PipelineLayoutCreateInfo const& plci) {
+	{
+		std::lock_guard lock(layout_mutex);
+		auto pipeline_layout_opt = pipeline_layout.get(plci);
+		if (pipeline_layout_opt) {
+			return *pipeline_layout_opt;
+		}
 	}
-	else {
+
+	// Get the set layouts first, since that takes the layout lock as well.
+	// Identical sets share a VkDescriptorSetLayout, so pipeline layouts with matching sets stay compatible for those sets.
+	std::vector<VkDescriptorSetLayout> set_layouts;
+	set_layouts.reserve(plci.set_layouts.size() + 1);
+	for (uint32_t set = 0; set < plci.set_layouts.size(); ++set) {
+		if (bindless_heap && set == bindless_heap->get_set_index()) {
+			set_layouts.push_back(bindless_heap->get_set_layout());
+		}
+		else {
+			set_layouts.push_back(get_or_create_descriptor_set_layout(plci.set_layouts[set]));
+		}
+	}
+	if (bindless_heap && set_layouts.size() <= bindless_heap->get_set_index()) {
+		// Sets below the heap that are not used by the shaders still need a (empty) layout
+		while (set_layouts.size() < bindless_heap->get_set_index()) {
+			set_layouts.push_back(get_or_create_descriptor_set_layout(DescriptorSetLayoutCreateInfo{}));
+		}
+		set_layouts.push_back(bindless_heap->get_set_layout());
+	}
+
+	std::lock_guard lock(layout_mutex);
+	// Another thread may have created this layout in the meantime
+	auto pipeline_layout_opt = pipeline_layout.get(plci);
+	if (pipeline_layout_opt) {
 		return *pipeline_layout_opt;
 	}
+	VkPipelineLayoutCreateInfo layout_create_info{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.pNext = nullptr,
+		.flags = {},
+		.setLayoutCount = (uint32_t)set_layouts.size(),
+		.pSetLayouts = set_layouts.data(),
+		.pushConstantRangeCount = (uint32_t)plci.push_constants.size(),
+		.pPushConstantRanges = plci.push_constants.data(),
+	};
+	VkPipelineLayout vk_layout = nullptr;
+	vkCreatePipelineLayout(ctx->device(), &layout_create_info, nullptr, &vk_layout);
+	PipelineLayout layout;
+	layout.handle = vk_layout;
+	layout.set_layouts = std::move(set_layouts);
+	this->pipeline_layout.insert(plci, layout);
+	return layout;
+}
+
+void CacheImpl::mark_layouts_used(PipelineLayoutCreateInfo const& plci) {
+	for (DescriptorSetLayoutCreateInfo const& dslci : plci.set_layouts) {
+		this->set_layout.get(dslci);
+	}
+	this->pipeline_layout.get(plci);
+}
+
+void CacheImpl::pin_layouts(PipelineLayoutCreateInfo const& plci) {
+	for (DescriptorSetLayoutCreateInfo const& dslci : plci.set_layouts) {
+		this->set_layout.pin(dslci);
+	}
+	this->pipeline_layout.pin(plci);
+}
+
+void CacheImpl::unpin_layouts(PipelineLayoutCreateInfo const& plci) {
+	for (DescriptorSetLayoutCreateInfo const& dslci : plci.set_layouts) {
+		this->set_layout.unpin(dslci);
+	}
+	this->pipeline_layout.unpin(plci);
+}
+
+template<typename Key>
+std::optional<Pipeline> CacheImpl::find_pipeline(Cache<Key, ph::Pipeline>& cache, Key const& key, PipelineLayoutCreateInfo const& plci) {
+	bool first_use = false;
+	Pipeline* pipeline = cache.get(key, first_use);
+	if (!pipeline) return std::nullopt;
+	mark_layouts_used(plci);
+	if (first_use) {
+		unpin_layouts(plci);
+	}
+	return *pipeline;
+}
+
+std::shared_ptr<void> CacheImpl::pin_render_pass(VkRenderPass pass) {
+	if (!pass) return nullptr;
+	std::lock_guard lock(variant_mutex);
+	renderpass_pins[pass] += 1;
+	return std::shared_ptr<void>(pass, [this](VkRenderPass pass) {
+		std::lock_guard lock(variant_mutex);
+		auto it = renderpass_pins.find(pass);
+		if (--it->second == 0) {
+			renderpass_pins.erase(it);
+		}
+	});
 }
 
 
@@ -166,25 +567,116 @@ static VkShaderModule create_shader_module(VkDevice device, ph::ShaderModuleCrea
 	return module;
 }
 
-Pipeline CacheImpl::get_or_create_pipeline(ph::PipelineCreateInfo& pci, VkRenderPass render_pass) {
+VkShaderModule CacheImpl::get_or_create_shader_module(ph::ShaderModuleCreateInfo const& info) {
+	// Lock so two compile workers using the same shader don't both create a module for it
+	std::lock_guard lock(shader_module_mutex);
+	VkShaderModule* module = shader_module.get(info);
+	if (module) { return *module; }
+
+	VkShaderModule new_module = create_shader_module(ctx->device(), info);
+	shader_module.insert(info, new_module);
+	return new_module;
+}
+
+PipelineVariantKey CacheImpl::get_variant_key(ph::PipelineCreateInfo const& pci, size_t state_hash, PipelineTarget const& target) {
+	PipelineVariantKey key;
+	key.state = &pci;
+	key.state_hash = state_hash;
+	if (!target.render_pass) {
+		key.compatibility = std::make_shared<RenderPassCompatibility const>(RenderPassCompatibility::from_formats(target.formats));
+		return key;
+	}
+	std::lock_guard lock(variant_mutex);
+	auto it = renderpass_class.find(target.render_pass);
+	if (it != renderpass_class.end()) {
+		key.compatibility = it->second;
+	}
+	else {
+		key.compatibility = std::make_shared<RenderPassCompatibility const>(RenderPassCompatibility::from_foreign_render_pass(target.render_pass));
+	}
+	return key;
+}
+
+Pipeline CacheImpl::get_or_create_pipeline(ph::PipelineCreateInfo const& pci, size_t state_hash, PipelineTarget const& target) {
+	PipelineVariantKey const key = get_variant_key(pci, state_hash, target);
+	return find_or_compile(this->pipeline, graphics_compiles, key, pci.layout, [&]() {
+		return create_pipeline(pci, target, key, false);
+	});
+}
+
+std::optional<Pipeline> CacheImpl::get_pipeline_if_ready(ph::PipelineCreateInfo const& pci, size_t state_hash, PipelineTarget const& target) {
+	if (compile_workers.empty()) {
+		return get_or_create_pipeline(pci, state_hash, target);
+	}
+
+	if (std::optional<Pipeline> pipeline = find_pipeline(this->pipeline, get_variant_key(pci, state_hash, target), pci.layout)) {
+		return pipeline;
+	}
+
+	request_pipeline_compile(pci, state_hash, target);
+	return std::nullopt;
+}
+
+void CacheImpl::request_pipeline_compile(ph::PipelineCreateInfo const& pci, size_t state_hash, PipelineTarget const& target) {
+	if (compile_workers.empty()) return;
+
+	PipelineVariantKey const key = get_variant_key(pci, state_hash, target);
+	// The render pass may go unused until the job runs, so it must not be evicted before the job is done.
+	std::shared_ptr<void> pin = pin_render_pass(target.render_pass);
+	// The key points to the caller's create info, so the job builds its own from its copy.
+	enqueue_compile(graphics_compiles, key, [this, pci, target, compatibility = key.compatibility, state_hash = key.state_hash, pin]() {
+		PipelineVariantKey const key{ .state = &pci, .state_hash = state_hash, .compatibility = compatibility };
+		// The pipeline may have been inserted between the cache lookup of the caller and the time this job was queued
+		if (!this->pipeline.contains(key)) {
+			create_pipeline(pci, target, key, true);
+		}
+	});
+}
+
+void CacheImpl::request_pipeline_variants(ph::PipelineCreateInfo const& pci, size_t state_hash) {
+	std::vector<PipelineTarget> targets;
 	{
-		Pipeline* pipeline = this->pipeline.get(pci);
-		// Also register usage for set and pipeline layout if found
-		if (pipeline) {
-			this->set_layout.get(pci.layout.set_layout);
-			this->pipeline_layout.get(pci.layout);
-			return *pipeline;
+		std::lock_guard lock(variant_mutex);
+		auto variants = pipeline_variants.find(pci.name);
+		if (variants == pipeline_variants.end()) return;
+		for (PipelineVariant const& variant : variants->second) {
+			PipelineTarget const& target = variant.target;
+			// Formats never expire
+			if (!target.render_pass) {
+				targets.push_back(target);
+				continue;
+			}
+			// Skip render passes that were evicted in the meantime. The handle may have been reused by a different render pass.
+			auto it = renderpass_class.find(target.render_pass);
+			if (it != renderpass_class.end() && *it->second == *variant.compatibility) {
+				targets.push_back(target);
+			}
 		}
 	}
 
+	for (PipelineTarget const& target : targets) {
+		request_pipeline_compile(pci, state_hash, target);
+	}
+}
+
+Pipeline CacheImpl::create_pipeline(ph::PipelineCreateInfo const& pci, PipelineTarget const& target, PipelineVariantKey const& key, bool precompiled) {
 	// Set up pipeline create info
 	VkGraphicsPipelineCreateInfo gpci{};
-	VkDescriptorSetLayout set_layout = get_or_create_descriptor_set_layout(pci.layout.set_layout);
-	ph::PipelineLayout layout = get_or_create_pipeline_layout(pci.layout, set_layout);
+	ph::PipelineLayout layout = get_or_create_pipeline_layout(pci.layout);
 	gpci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	gpci.layout = layout.handle;
-	gpci.renderPass = render_pass;
+	gpci.renderPass = target.render_pass;
 	gpci.subpass = 0;
+	// Without a render pass, the attachment formats are supplied through the pNext chain.
+	VkPipelineRenderingCreateInfoKHR rendering_info{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+		.pNext = nullptr,
+		.viewMask = 0,
+		.colorAttachmentCount = (uint32_t)target.formats.color_formats.size(),
+		.pColorAttachmentFormats = target.formats.color_formats.data(),
+		.depthAttachmentFormat = target.formats.depth_format,
+		.stencilAttachmentFormat = target.formats.stencil_format
+	};
 	VkPipelineColorBlendStateCreateInfo blend_info{
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
 		.pNext = nullptr,
@@ -207,7 +699,7 @@ Pipeline CacheImpl::get_or_create_pipeline(ph::PipelineCreateInfo& pci, VkRender
 	gpci.pDynamicState = &dynamic_state;
 	gpci.pInputAssemblyState = &pci.input_assembly;
 	gpci.pMultisampleState = &pci.multisample;
-	gpci.pNext = nullptr;
+	gpci.pNext = target.render_pass ? nullptr : &rendering_info;
 	gpci.pRasterizationState = &pci.rasterizer;
 	VkPipelineVertexInputStateCreateInfo vertex_input{
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
@@ -240,7 +732,7 @@ Pipeline CacheImpl::get_or_create_pipeline(ph::PipelineCreateInfo& pci, VkRender
 			.pNext = nullptr,
 			.flags = {},
 			.stage = static_cast<VkShaderStageFlagBits>(shader_info->stage),
-			.module = create_shader_module(ctx->device(), *shader_info),
+			.module = get_or_create_shader_module(*shader_info),
 			.pName = shader_info->entry_point.c_str(),
 			.pSpecializationInfo = nullptr
 		};
@@ -250,37 +742,71 @@ Pipeline CacheImpl::get_or_create_pipeline(ph::PipelineCreateInfo& pci, VkRender
 	gpci.pStages = shader_infos.data();
 
 	Pipeline pipeline;
-	vkCreateGraphicsPipelines(ctx->device(), nullptr, 1, &gpci, nullptr, &pipeline.handle);
+	vkCreateGraphicsPipelines(ctx->device(), pipeline_cache, 1, &gpci, nullptr, &pipeline.handle);
 	pipeline.name = pci.name;
 	pipeline.layout = layout;
 	pipeline.type = PipelineType::Graphics;
 
 	ctx->name_object(pipeline, "[Gfx Pipeline] " + pci.name);
 
-	// Delete the creates shader modules. We might want to cache these (TODO)
-	for (auto& ssci : shader_infos) {
-		vkDestroyShaderModule(ctx->device(), ssci.module, nullptr);
+	auto const [stored, inserted] = precompiled ? this->pipeline.insert_unused(key, pipeline) : this->pipeline.insert(key, pipeline);
+	if (!inserted) {
+		// Compiled by another thread in the meantime. Keep the pipeline that is already in the cache.
+		vkDestroyPipeline(ctx->device(), pipeline.handle, nullptr);
+		pipeline = *stored;
+	}
+	else if (precompiled) {
+		pin_layouts(pci.layout);
+	}
+	{
+		std::lock_guard lock(variant_mutex);
+		std::vector<PipelineVariant>& variants = pipeline_variants[pci.name];
+		auto it = std::find_if(variants.begin(), variants.end(), [&key](PipelineVariant const& variant) {
+			return *variant.compatibility == *key.compatibility;
+		});
+		if (it != variants.end()) {
+			it->target = target;
+		}
+		else {
+			variants.push_back(PipelineVariant{ .compatibility = key.compatibility, .target = target });
+		}
 	}
-
-	this->pipeline.insert(pci, pipeline);
 
 	return pipeline;
 }
 
-Pipeline CacheImpl::get_or_create_compute_pipeline(ph::ComputePipelineCreateInfo& pci) {
-	{
-		Pipeline* pipeline = this->compute_pipeline.get(pci);
-		// Also register usage for set and pipeline layout if found
-		if (pipeline) { 
-			this->set_layout.get(pci.layout.set_layout);
-			this->pipeline_layout.get(pci.layout);
-			return *pipeline; 
-		}
+Pipeline CacheImpl::get_or_create_compute_pipeline(ph::ComputePipelineCreateInfo const& pci) {
+	return find_or_compile(this->compute_pipeline, compute_compiles, pci, pci.layout, [&]() {
+		return create_compute_pipeline(pci, false);
+	});
+}
+
+std::optional<Pipeline> CacheImpl::get_compute_pipeline_if_ready(ph::ComputePipelineCreateInfo const& pci) {
+	if (compile_workers.empty()) {
+		return get_or_create_compute_pipeline(pci);
+	}
+
+	if (std::optional<Pipeline> pipeline = find_pipeline(this->compute_pipeline, pci, pci.layout)) {
+		return pipeline;
 	}
 
+	request_compute_pipeline_compile(pci);
+	return std::nullopt;
+}
+
+void CacheImpl::request_compute_pipeline_compile(ph::ComputePipelineCreateInfo const& pci) {
+	if (compile_workers.empty()) return;
+
+	enqueue_compile(compute_compiles, pci, [this, pci]() {
+		if (!this->compute_pipeline.contains(pci)) {
+			create_compute_pipeline(pci, true);
+		}
+	});
+}
+
+Pipeline CacheImpl::create_compute_pipeline(ph::ComputePipelineCreateInfo const& pci, bool precompiled) {
 	VkComputePipelineCreateInfo cpci{};
-	VkDescriptorSetLayout set_layout = get_or_create_descriptor_set_layout(pci.layout.set_layout);
-	ph::PipelineLayout layout = get_or_create_pipeline_layout(pci.layout, set_layout);
+	ph::PipelineLayout layout = get_or_create_pipeline_layout(pci.layout);
 	cpci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
 	// Create shader modules
 	ph::ShaderModuleCreateInfo* shader_info = this->shader.get(pci.shader);
@@ -290,21 +816,28 @@ Pipeline CacheImpl::get_or_create_compute_pipeline(ph::ComputePipelineCreateInfo
 		.pNext = nullptr,
 		.flags = {},
 		.stage = VK_SHADER_STAGE_COMPUTE_BIT,
-		.module = create_shader_module(ctx->device(), *shader_info),
+		.module = get_or_create_shader_module(*shader_info),
 		.pName = shader_info->entry_point.c_str(),
 		.pSpecializationInfo = nullptr
 	};
 	cpci.stage = ssci;
 	cpci.layout = layout.handle;
 	Pipeline pipeline;
-	vkCreateComputePipelines(ctx->device(), nullptr, 1, &cpci, nullptr, &pipeline.handle);
+	vkCreateComputePipelines(ctx->device(), pipeline_cache, 1, &cpci, nullptr, &pipeline.handle);
 	pipeline.name = pci.name;
 	pipeline.layout = layout;
 	pipeline.type = PipelineType::Compute;
 	ctx->name_object(pipeline, "[Compute Pipeline] " + pci.name);
-	vkDestroyShaderModule(ctx->device(), ssci.module, nullptr);
 
-	this->compute_pipeline.insert(pci, pipeline);
+	auto const [stored, inserted] = precompiled ? this->compute_pipeline.insert_unused(pci, pipeline) : this->compute_pipeline.insert(pci, pipeline);
+	if (!inserted) {
+		// Compiled by another thread in the meantime. Keep the pipeline that is already in the cache.
+		vkDestroyPipeline(ctx->device(), pipeline.handle, nullptr);
+		pipeline = *stored;
+	}
+	else if (precompiled) {
+		pin_layouts(pci.layout);
+	}
 
 	return pipeline;
 }
@@ -314,20 +847,25 @@ Pipeline CacheImpl::get_or_create_compute_pipeline(ph::ComputePipelineCreateInfo
 #define PH_RTX_CALL(func, ...) ctx->rtx_fun._##func(__VA_ARGS__)
 
 Pipeline CacheImpl::get_or_create_ray_tracing_pipeline(ph::RayTracingPipelineCreateInfo& pci) {
-	{
-		Pipeline* pipeline = this->rtx_pipeline.get(pci);
-		// Also register usage for set and pipeline layout if found
-		if (pipeline) {
-			this->set_layout.get(pci.layout.set_layout);
-			this->pipeline_layout.get(pci.layout);
-			return *pipeline;
+	return find_or_compile(this->rtx_pipeline, rtx_compiles, pci, pci.layout, [&]() {
+		return create_ray_tracing_pipeline(pci, false);
+	});
+}
+
+void CacheImpl::request_ray_tracing_pipeline_compile(ph::RayTracingPipelineCreateInfo const& pci) {
+	if (compile_workers.empty()) return;
+
+	enqueue_compile(rtx_compiles, pci, [this, pci]() {
+		if (!this->rtx_pipeline.contains(pci)) {
+			create_ray_tracing_pipeline(pci, true);
 		}
-	}
+	});
+}
 
+Pipeline CacheImpl::create_ray_tracing_pipeline(ph::RayTracingPipelineCreateInfo const& pci, bool precompiled) {
 	VkRayTracingPipelineCreateInfoKHR rtpci{};
 	rtpci.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR;
-	VkDescriptorSetLayout set_layout = get_or_create_descriptor_set_layout(pci.layout.set_layout);
-	ph::PipelineLayout layout = get_or_create_pipeline_layout(pci.layout, set_layout);
+	ph::PipelineLayout layout = get_or_create_pipeline_layout(pci.layout);
 	rtpci.layout = layout.handle;
 
 	std::vector<VkPipelineShaderStageCreateInfo> sscis{};
@@ -344,14 +882,14 @@ Pipeline CacheImpl::get_or_create_ray_tracing_pipeline(ph::RayTracingPipelineCre
 			.pNext = nullptr,
 			.flags = {},
 			.stage = static_cast<VkShaderStageFlagBits>(shader->stage),
-			.module = create_shader_module(ctx->device(), *shader),
+			.module = get_or_create_shader_module(*shader),
 			.pName = shader->entry_point.c_str()
 		});
 	}
 
 	// Now we create the shader groups
 	std::vector<VkRayTracingShaderGroupCreateInfoKHR> groups;
-	for (RayTracingShaderGroup& group : pci.shader_groups) {
+	for (RayTracingShaderGroup const& group : pci.shader_groups) {
 		VkRayTracingShaderGroupTypeKHR type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
 		if (group.type == RayTracingShaderGroupType::RayHit) type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
 		groups.push_back(VkRayTracingShaderGroupCreateInfoKHR{
@@ -373,52 +911,170 @@ Pipeline CacheImpl::get_or_create_ray_tracing_pipeline(ph::RayTracingPipelineCre
 	rtpci.pGroups = groups.data();
 
 	Pipeline pipeline;
-	PH_RTX_CALL(vkCreateRayTracingPipelinesKHR, ctx->device(), {}, {}, 1, &rtpci, nullptr, &pipeline.handle);
+	PH_RTX_CALL(vkCreateRayTracingPipelinesKHR, ctx->device(), {}, pipeline_cache, 1, &rtpci, nullptr, &pipeline.handle);
 	pipeline.name = pci.name;
 	pipeline.type = ph::PipelineType::RayTracing;
 	pipeline.layout = layout;
 	ctx->name_object(pipeline, "[Raytracing Pipeline] " + pci.name);
-	// Destroy shader modules
-	for (auto& shader : sscis) {
-		vkDestroyShaderModule(ctx->device(), shader.module, nullptr);
+	auto const [stored, inserted] = precompiled ? this->rtx_pipeline.insert_unused(pci, pipeline) : this->rtx_pipeline.insert(pci, pipeline);
+	if (!inserted) {
+		// Compiled by another thread in the meantime. Keep the pipeline that is already in the cache.
+		vkDestroyPipeline(ctx->device(), pipeline.handle, nullptr);
+		pipeline = *stored;
+	}
+	else if (precompiled) {
+		pin_layouts(pci.layout);
 	}
-	this->rtx_pipeline.insert(pci, pipeline);
 
 	return pipeline;
 }
 
 #endif
 
-VkDescriptorSet CacheImpl::get_or_create_descriptor_set(DescriptorSetBinding const& sb, Pipeline const& pipeline, void* pNext) {
+// Returns the variable descriptor count from a VkDescriptorSetVariableDescriptorCountAllocateInfo in the pNext chain, or zero if there is none.
+static uint32_t get_variable_descriptor_count(void const* pNext) {
+	auto const* next = static_cast<VkBaseInStructure const*>(pNext);
+	while (next) {
+		if (next->sType == VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO) {
+			auto const* info = reinterpret_cast<VkDescriptorSetVariableDescriptorCountAllocateInfo const*>(next);
+			return info->descriptorSetCount > 0 ? info->pDescriptorCounts[0] : 0;
+		}
+		next = next->pNext;
+	}
+	return 0;
+}
+
+VkDescriptorSet CacheImpl::get_or_create_descriptor_set(DescriptorSetBinding const& sb, Pipeline const& pipeline, uint32_t set_index, void* pNext, uint32_t thread_index,
+	DescriptorLifetime lifetime) {
+	assert(set_index < pipeline.layout.set_layouts.size() && "Pipeline layout has no descriptor set with this index");
+	assert(!(bindless_heap && set_index == bindless_heap->get_set_index()) && "The set of the bindless heap cannot be allocated from");
     auto set_binding = sb;
-	set_binding.set_layout = pipeline.layout.set_layout;
-	auto set_opt = this->descriptor_set.current().get(set_binding);
+	set_binding.set_layout = pipeline.layout.set_layouts[set_index];
+	assert(!(lifetime == DescriptorLifetime::Thread && thread_index == main_thread_index) && "Thread sets need a thread index passed to begin_thread()");
+	std::vector<DescriptorShard>& shards = lifetime == DescriptorLifetime::Thread ? thread_descriptor_shards : descriptor_shards.current();
+	size_t const shard_index = lifetime == DescriptorLifetime::Thread ? thread_index : frame_shard_index(thread_index);
+	assert(shard_index < shards.size() && "Thread index out of range");
+	DescriptorShard& shard = shards[shard_index];
+	auto set_opt = shard.sets.get(set_binding);
 	if (set_opt) {
 		return *set_opt;
 	}
-	// Create descriptor set layout and issue writes
-	VkDescriptorSetAllocateInfo alloc_info;
-	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	alloc_info.pSetLayouts = &set_binding.set_layout;
-	// add default descriptor pool if no custom one was specified
-	if (!set_binding.pool) { set_binding.pool = descr_pool; };
-	alloc_info.descriptorPool = set_binding.pool;
-	alloc_info.descriptorSetCount = 1;
-	alloc_info.pNext = pNext;
+	// Sets that are shared between threads may already have been created by another thread this frame.
+	// These are fully written before being inserted, so they can be used as-is.
+	// Thread sets of other thread indices can be freed at any time, so those are never shared.
+	if (lifetime == DescriptorLifetime::Frame) {
+		for (uint32_t i = 0; i < shards.size(); ++i) {
+			if (i == shard_index) continue;
+			set_opt = shards[i].sets.get(set_binding);
+			if (set_opt) {
+				return *set_opt;
+			}
+		}
+	}
+	SetLayoutInfo const* layout_info = nullptr;
+	{
+		std::lock_guard lock(layout_mutex);
+		auto it = set_layout_info.find(set_binding.set_layout);
+		if (it != set_layout_info.end()) layout_info = &it->second;
+	}
+	assert(layout_info && "Descriptor set layout was not created through the cache");
+	assert(!layout_info->push_descriptor && "Push descriptor sets cannot be allocated, use CommandBuffer::push_descriptors instead");
 
 	VkDescriptorSet set = nullptr;
-	vkAllocateDescriptorSets(ctx->device(), &alloc_info, &set);
+	if (set_binding.pool) {
+		// Allocate from the custom descriptor pool
+		VkDescriptorSetAllocateInfo alloc_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.pNext = pNext,
+			.descriptorPool = set_binding.pool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &set_binding.set_layout
+		};
+		vkAllocateDescriptorSets(ctx->device(), &alloc_info, &set);
+	}
+	// Only this thread index allocates from this shard, so no lock is needed.
+	else if (layout_info->has_variable_count) {
+		std::vector<VkDescriptorPoolSize> pool_sizes = layout_info->sizes;
+		pool_sizes.push_back(VkDescriptorPoolSize{ layout_info->variable_count_type, get_variable_descriptor_count(pNext) });
+		set = shard.allocator.allocate(set_binding.set_layout, pool_sizes, pNext);
+	}
+	else {
+		set = shard.allocator.allocate(set_binding.set_layout, layout_info->sizes, pNext);
+	}
 
 	// Now we have the set we need to write the requested data to it
-	std::vector<VkWriteDescriptorSet> writes;
-	struct DescriptorWriteInfo {
-		std::vector<VkDescriptorBufferInfo> buffer_infos;
-		std::vector<VkDescriptorImageInfo> image_infos;
+	if (!write_descriptor_set_with_template(set, set_binding, *layout_info, shard.template_data)) {
+		write_descriptor_set(set, set_binding);
+	}
+	shard.sets.insert(set_binding, set);
+	return set;
+}
+
+bool CacheImpl::write_descriptor_set_with_template(VkDescriptorSet set, DescriptorSetBinding const& set_binding, SetLayoutInfo const& layout_info, std::vector<DescriptorTemplateEntry>& data) {
+	if (!layout_info.update_template) return false;
+	// The template writes every binding in the layout, so all of them need to be supplied with the exact amount of descriptors in the layout.
+	if (set_binding.bindings.size() != layout_info.template_bindings.size()) return false;
+
+	// Both are sorted on binding number, so they are walked in lockstep. Sets that were not built with DescriptorBuilder
+	// may have their bindings in a different order, these are written without the template.
+	data.resize(layout_info.template_descriptor_count);
+	size_t index = 0;
+	for (size_t i = 0; i < layout_info.template_bindings.size(); ++i) {
+		VkDescriptorSetLayoutBinding const& layout_binding = layout_info.template_bindings[i];
+		DescriptorBinding const& binding = set_binding.bindings[i];
+		if (binding.binding != layout_binding.binding || binding.type != layout_binding.descriptorType || binding.descriptors.size() != layout_binding.descriptorCount) {
+			return false;
+		}
+		for (auto const& descriptor : binding.descriptors) {
+			DescriptorTemplateEntry& entry = data[index++];
+			switch (binding.type) {
+			case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+			case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+			case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE: {
+				entry.image = VkDescriptorImageInfo{
+					.sampler = descriptor.image.sampler,
+					.imageView = descriptor.image.view.handle,
+					.imageLayout = descriptor.image.layout
+				};
+			} break;
 #if PHOBOS_ENABLE_RAY_TRACING
-		std::vector<VkWriteDescriptorSetAccelerationStructureKHR> accel_infos;
+			case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR: {
+				entry.accel_structure = descriptor.accel_structure.structure;
+			} break;
 #endif
-	};
+			default: {
+				entry.buffer = VkDescriptorBufferInfo{
+					.buffer = descriptor.buffer.buffer,
+					.offset = descriptor.buffer.offset,
+					.range = descriptor.buffer.range
+				};
+			} break;
+			}
+		}
+	}
+
+	vkUpdateDescriptorSetWithTemplate(ctx->device(), set, layout_info.update_template, data.data());
+	return true;
+}
+
+void CacheImpl::write_descriptor_set(VkDescriptorSet set, DescriptorSetBinding const& set_binding) {
+	std::vector<VkWriteDescriptorSet> writes;
+	std::vector<DescriptorWriteInfo> write_infos;
+	fill_descriptor_writes(set, set_binding, writes, write_infos);
+	vkUpdateDescriptorSets(ctx->device(), writes.size(), writes.data(), 0, nullptr);
+}
+
+void CacheImpl::push_descriptor_set(VkCommandBuffer cmd_buf, DescriptorSetBinding const& set_binding, Pipeline const& pipeline, uint32_t set_index) {
+	assert(push_descriptor_fun && "Push descriptors used without AppSettings::enable_push_descriptors");
+	assert(set_index < pipeline.layout.set_layouts.size() && "Pipeline layout has no descriptor set with this index");
+	std::vector<VkWriteDescriptorSet> writes;
 	std::vector<DescriptorWriteInfo> write_infos;
+	// dstSet is ignored for push descriptors
+	fill_descriptor_writes(nullptr, set_binding, writes, write_infos);
+	push_descriptor_fun(cmd_buf, static_cast<VkPipelineBindPoint>(pipeline.type), pipeline.layout.handle, set_index, writes.size(), writes.data());
+}
+
+void CacheImpl::fill_descriptor_writes(VkDescriptorSet set, DescriptorSetBinding const& set_binding, std::vector<VkWriteDescriptorSet>& writes, std::vector<DescriptorWriteInfo>& write_infos) {
 	writes.reserve(set_binding.bindings.size());
 	for (auto const& binding : set_binding.bindings) {
 		if (binding.descriptors.empty()) continue;
@@ -501,27 +1157,93 @@ VkDescriptorSet CacheImpl::get_or_create_descriptor_set(DescriptorSetBinding con
 		} break;
 		}
 	}
+}
 
-	vkUpdateDescriptorSets(ctx->device(), writes.size(), writes.data(), 0, nullptr);
-	this->descriptor_set.current().insert(set_binding, set);
-	return set;
+size_t CacheImpl::frame_shard_index(uint32_t thread_index) const {
+	return thread_index == main_thread_index ? ctx->thread_count() : thread_index;
+}
+
+void CacheImpl::reset_frame_descriptor_sets() {
+	// Sets from custom pools are owned by the user, so we only forget about them here.
+	for (DescriptorShard& shard : descriptor_shards.current()) {
+		shard.sets.clear();
+		shard.allocator.reset(max_descriptor_pools);
+	}
+}
+
+void CacheImpl::reset_thread_descriptor_sets(uint32_t thread_index) {
+	assert(thread_index < thread_descriptor_shards.size() && "Thread index out of range");
+	DescriptorShard& shard = thread_descriptor_shards[thread_index];
+	shard.sets.clear();
+	shard.allocator.reset(max_descriptor_pools);
+}
+
+CacheStatistics CacheImpl::get_stats() {
+	CacheStatistics stats{
+		.framebuffers = framebuffer.get_stats(),
+		.render_passes = renderpass.get_stats(),
+		.set_layouts = set_layout.get_stats(),
+		.pipeline_layouts = pipeline_layout.get_stats(),
+		.pipelines = pipeline.get_stats(),
+		.compute_pipelines = compute_pipeline.get_stats(),
+#if PHOBOS_ENABLE_RAY_TRACING
+		.ray_tracing_pipelines = rtx_pipeline.get_stats(),
+#endif
+		.shader_modules = shader_module.get_stats()
+	};
+	for (std::vector<DescriptorShard>& shards : descriptor_shards) {
+		for (DescriptorShard const& shard : shards) {
+			DescriptorPoolStats const pool_stats = shard.allocator.get_stats();
+			stats.descriptor_pools.entries += pool_stats.pool_count;
+			stats.descriptor_pools.evictions += pool_stats.pools_evicted;
+			stats.descriptor_pools.recreations += pool_stats.pools_recreated;
+		}
+	}
+	for (DescriptorShard const& shard : thread_descriptor_shards) {
+		DescriptorPoolStats const pool_stats = shard.allocator.get_stats();
+		stats.descriptor_pools.entries += pool_stats.pool_count;
+		stats.descriptor_pools.evictions += pool_stats.pools_evicted;
+		stats.descriptor_pools.recreations += pool_stats.pools_recreated;
+	}
+	return stats;
 }
 
 void CacheImpl::next_frame() {
+	if (bindless_heap) {
+		bindless_heap->next_frame();
+	}
 
 	auto update_cache = [this](auto& cache, auto delete_fun) {
 		cache.next_frame();
-		cache.foreach_unused(delete_fun);
-		cache.erase_unused();
+		cache.evict_unused(delete_fun);
 	};
 
 	update_cache(framebuffer, [this](VkFramebuffer fbuf) {
 		vkDestroyFramebuffer(ctx->device(), fbuf, nullptr);
 	});
-	update_cache(renderpass, [this](VkRenderPass pass) {
+	renderpass.next_frame();
+	renderpass.evict_unused([this](VkRenderPass pass) {
+		{
+			std::lock_guard lock(variant_mutex);
+			renderpass_class.erase(pass);
+		}
 		vkDestroyRenderPass(ctx->device(), pass, nullptr);
+	}, [this](VkRenderPass pass) {
+		// Queued compile jobs still need this render pass
+		std::lock_guard lock(variant_mutex);
+		return renderpass_pins.contains(pass);
 	});
 	update_cache(set_layout, [this](VkDescriptorSetLayout layout) {
+		{
+			std::lock_guard lock(layout_mutex);
+			auto it = set_layout_info.find(layout);
+			if (it != set_layout_info.end()) {
+				if (it->second.update_template) {
+					vkDestroyDescriptorUpdateTemplate(ctx->device(), it->second.update_template, nullptr);
+				}
+				set_layout_info.erase(it);
+			}
+		}
 		vkDestroyDescriptorSetLayout(ctx->device(), layout, nullptr);
 	});
 	update_cache(pipeline_layout, [this](ph::PipelineLayout layout) {
@@ -538,11 +1260,19 @@ void CacheImpl::next_frame() {
 		vkDestroyPipeline(ctx->device(), pipeline.handle, nullptr);
 	});
 #endif
-	update_cache(descriptor_set.current(), [this](VkDescriptorSet set) {
-		vkFreeDescriptorSets(ctx->device(), descr_pool, 1, &set);
+	update_cache(shader_module, [this](VkShaderModule module) {
+		vkDestroyShaderModule(ctx->device(), module, nullptr);
 	});
+	DescriptorPoolStats stats{};
+	for (DescriptorShard const& shard : descriptor_shards.current()) {
+		DescriptorPoolStats const shard_stats = shard.allocator.get_stats();
+		stats.pools_in_use += shard_stats.pools_in_use;
+		stats.pool_count += shard_stats.pool_count;
+		stats.sets_allocated += shard_stats.sets_allocated;
+	}
+	last_frame_descriptor_stats = stats;
 
-	this->descriptor_set.next();
+	this->descriptor_shards.next();
 }
 
 }
@@ -219,14 +219,45 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL vk_debug_callback(
 ContextImpl::ContextImpl(AppSettings const& s)
 	: max_unbounded_array_size(s.max_unbounded_array_size),
 	max_frames_in_flight(s.max_frames_in_flight),
-	num_threads(s.num_threads),
-	has_validation(s.enable_validation) {
+	has_bindless_heap(s.bindless_sampled_images > 0 || s.bindless_storage_images > 0 || s.bindless_storage_buffers > 0),
+	bindless_set_index(s.bindless_set_index),
+	has_validation(s.enable_validation),
+	has_imageless_framebuffers(s.enable_imageless_framebuffers),
+	has_dynamic_rendering(s.enable_dynamic_rendering),
+	has_synchronization2(s.enable_synchronization2),
+	num_threads(s.num_threads) {
     AppSettings settings = s;
 	if (!settings.create_headless) {
 		wsi = settings.wsi;
 	}
 	logger = settings.logger;
 
+	if (settings.enable_push_descriptors) {
+		settings.gpu_requirements.device_extensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+	}
+
+	if (settings.enable_imageless_framebuffers) {
+		settings.gpu_requirements.features_1_2.imagelessFramebuffer = true;
+	}
+
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering_features{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+		.pNext = nullptr,
+		.dynamicRendering = true
+	};
+	if (settings.enable_dynamic_rendering) {
+		settings.gpu_requirements.device_extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+	}
+
+	VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2_features{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR,
+		.pNext = nullptr,
+		.synchronization2 = true
+	};
+	if (settings.enable_synchronization2) {
+		settings.gpu_requirements.device_extensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+	}
+
 #if PHOBOS_ENABLE_RAY_TRACING
 	// If ray tracing is enabled, add the required extensions for it
 	settings.gpu_requirements.device_extensions.push_back(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME);
@@ -356,6 +387,14 @@ ContextImpl::ContextImpl(AppSettings const& s)
 #if PHOBOS_ENABLE_RAY_TRACING
 		settings.gpu_requirements.features_1_2.pNext = &rtx_features;
 #endif
+		if (settings.enable_dynamic_rendering) {
+			dynamic_rendering_features.pNext = settings.gpu_requirements.features_1_2.pNext;
+			settings.gpu_requirements.features_1_2.pNext = &dynamic_rendering_features;
+		}
+		if (settings.enable_synchronization2) {
+			synchronization2_features.pNext = settings.gpu_requirements.features_1_2.pNext;
+			settings.gpu_requirements.features_1_2.pNext = &synchronization2_features;
+		}
 
 		// If we have a pNext chain both supplied by the user and in the features pNext chain we need to
 		// chain them together.
@@ -400,6 +439,16 @@ ContextImpl::ContextImpl(AppSettings const& s)
 
 	// Grab debug utils naming function
 	set_debug_utils_name_fun = reinterpret_cast<PFN_vkSetDebugUtilsObjectNameEXT>(vkGetDeviceProcAddr(device, "vkSetDebugUtilsObjectNameEXT"));
+
+	if (has_dynamic_rendering) {
+		begin_rendering_fun = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(vkGetDeviceProcAddr(device, "vkCmdBeginRenderingKHR"));
+		end_rendering_fun = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(vkGetDeviceProcAddr(device, "vkCmdEndRenderingKHR"));
+	}
+
+	if (has_synchronization2) {
+		pipeline_barrier2_fun = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(vkGetDeviceProcAddr(device, "vkCmdPipelineBarrier2KHR"));
+		queue_submit2_fun = reinterpret_cast<PFN_vkQueueSubmit2KHR>(vkGetDeviceProcAddr(device, "vkQueueSubmit2KHR"));
+	}
 }
 
 void ContextImpl::post_init(Context& ctx, ImageImpl& image_impl, AppSettings const& settings) {
@@ -466,7 +515,8 @@ void ContextImpl::post_init(Context& ctx, ImageImpl& image_impl, AppSettings con
 				.samples = VK_SAMPLE_COUNT_1_BIT,
 				.current_layout = VK_IMAGE_LAYOUT_UNDEFINED,
 				.handle = images[i],
-				.memory = nullptr
+				.memory = nullptr,
+				.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
 			};
 
 			data.view = img->create_image_view(data.image, ph::ImageAspect::Color);
@@ -530,6 +580,18 @@ bool ContextImpl::validation_enabled() const {
 	return has_validation;
 }
 
+bool ContextImpl::imageless_framebuffers_enabled() const {
+	return has_imageless_framebuffers;
+}
+
+bool ContextImpl::dynamic_rendering_enabled() const {
+	return has_dynamic_rendering;
+}
+
+bool ContextImpl::synchronization2_enabled() const {
+	return has_synchronization2;
+}
+
 uint32_t ContextImpl::thread_count() const {
 	return num_threads;
 }
@@ -729,6 +791,26 @@ LogInterface* ContextImpl::get_logger() {
 	return logger;
 }
 
+void ContextImpl::begin_rendering(VkCommandBuffer cmd_buf, VkRenderingInfoKHR const& info) {
+	assert(begin_rendering_fun && "Dynamic rendering is not enabled");
+	begin_rendering_fun(cmd_buf, &info);
+}
+
+void ContextImpl::end_rendering(VkCommandBuffer cmd_buf) {
+	assert(end_rendering_fun && "Dynamic rendering is not enabled");
+	end_rendering_fun(cmd_buf);
+}
+
+void ContextImpl::pipeline_barrier2(VkCommandBuffer cmd_buf, VkDependencyInfoKHR const& info) {
+	assert(pipeline_barrier2_fun && "Synchronization2 is not enabled");
+	pipeline_barrier2_fun(cmd_buf, &info);
+}
+
+void ContextImpl::queue_submit2(VkQueue queue, VkSubmitInfo2KHR const& info, VkFence fence) {
+	assert(queue_submit2_fun && "Synchronization2 is not enabled");
+	queue_submit2_fun(queue, 1, &info, fence);
+}
+
 std::vector<uint32_t> const& ContextImpl::queue_family_indices() const {
 	return family_indices;
 }
@@ -139,6 +139,8 @@ uint32_t FrameImpl::max_frames_in_flight() const {
 	frame_data.ibo_allocator.reset();
 	frame_data.ubo_allocator.reset();
 	frame_data.ssbo_allocator.reset();
+	// The fence for this frame was signaled, so the descriptor sets allocated for it can be released in bulk.
+	cache->reset_frame_descriptor_sets();
 	return InFlightContext(frame_data.cmd_buf, frame_data.vbo_allocator, frame_data.ibo_allocator, frame_data.ubo_allocator, frame_data.ssbo_allocator);
 }
 
@@ -148,13 +150,58 @@ void FrameImpl::submit_frame_commands(Queue& queue, CommandBuffer& cmd_buf, std:
 	// Reset our fence from last time, so we can use it again now
 	vkResetFences(ctx->device, 1, &frame_data.fence);
 
+    if (ctx->synchronization2_enabled()) {
+        std::vector<VkSemaphoreSubmitInfoKHR> wait_infos;
+        auto add_wait = [&wait_infos](VkSemaphore semaphore, VkPipelineStageFlags2KHR stages) {
+            wait_infos.push_back(VkSemaphoreSubmitInfoKHR{
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR,
+                .pNext = nullptr,
+                .semaphore = semaphore,
+                .value = 0,
+                .stageMask = stages,
+                .deviceIndex = 0
+            });
+        };
+        add_wait(frame_data.image_ready, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR);
+        for (auto const& sem : wait_semaphores) {
+            add_wait(sem.handle, sem.stage_flags.value());
+        }
+        VkCommandBufferSubmitInfoKHR cmd_buf_info{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR,
+            .pNext = nullptr,
+            .commandBuffer = cmd_buf.handle(),
+            .deviceMask = 0
+        };
+        VkSemaphoreSubmitInfoKHR signal_info{
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR,
+            .pNext = nullptr,
+            .semaphore = frame_data.gpu_finished,
+            .value = 0,
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR,
+            .deviceIndex = 0
+        };
+        VkSubmitInfo2KHR info{
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR,
+            .pNext = nullptr,
+            .flags = {},
+            .waitSemaphoreInfoCount = (uint32_t)wait_infos.size(),
+            .pWaitSemaphoreInfos = wait_infos.data(),
+            .commandBufferInfoCount = 1,
+            .pCommandBufferInfos = &cmd_buf_info,
+            .signalSemaphoreInfoCount = 1,
+            .pSignalSemaphoreInfos = &signal_info
+        };
+        queue.submit(info, frame_data.fence);
+        return;
+    }
+
     std::vector<VkSemaphore> semaphores { frame_data.image_ready };
     std::vector<VkPipelineStageFlags> wait_stages { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 
     // Fill user-supplied semaphores
     for (auto const& sem : wait_semaphores) {
         semaphores.push_back(sem.handle);
-        wait_stages.push_back(sem.stage_flags.value());
+        wait_stages.push_back(get_legacy_stage_flags(sem.stage_flags.value()));
     }
 
     VkSubmitInfo info{};
@@ -259,7 +306,8 @@ Swapchain FrameImpl::resize_swapchain() {
 			.samples = VK_SAMPLE_COUNT_1_BIT,
 			.current_layout = VK_IMAGE_LAYOUT_UNDEFINED,
 			.handle = images[i],
-			.memory = nullptr
+			.memory = nullptr,
+			.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
 		};
 
 		data.view = ctx->img->create_image_view(data.image, ph::ImageAspect::Color);
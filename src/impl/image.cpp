@@ -94,6 +94,26 @@ RawImage ImageImpl::create_image(ImageType type, VkExtent2D size, VkFormat forma
 }
 
 RawImage ImageImpl::create_image(ImageType type, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, uint32_t mips, uint32_t layers) {
+    RawImage image = describe_image(type, size, format, samples, mips, layers);
+    VkImageCreateInfo info = get_image_create_info(image);
+
+    VmaAllocationCreateInfo alloc_info{};
+    alloc_info.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
+    alloc_info.flags = VmaAllocationCreateFlagBits::VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT;
+    vmaCreateImage(ctx->allocator, reinterpret_cast<VkImageCreateInfo const*>(&info), &alloc_info,
+                   reinterpret_cast<VkImage*>(&image.handle), &image.memory, nullptr);
+
+    return image;
+}
+
+RawImage ImageImpl::create_unbound_image(ImageType type, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, uint32_t mips, uint32_t layers) {
+    RawImage image = describe_image(type, size, format, samples, mips, layers);
+    VkImageCreateInfo info = get_image_create_info(image);
+    vkCreateImage(ctx->device, &info, nullptr, &image.handle);
+    return image;
+}
+
+RawImage ImageImpl::describe_image(ImageType type, VkExtent2D size, VkFormat format, VkSampleCountFlagBits samples, uint32_t mips, uint32_t layers) const {
     RawImage image;
     image.size = size;
     image.format = format;
@@ -101,20 +121,25 @@ RawImage ImageImpl::create_image(ImageType type, VkExtent2D size, VkFormat forma
     image.layers = layers;
     image.mip_levels = mips;
     image.samples = samples;
+    image.usage = get_image_usage(type);
+    image.flags = get_image_flags(type);
+    return image;
+}
 
+VkImageCreateInfo ImageImpl::get_image_create_info(RawImage const& image) const {
     VkImageCreateInfo info{
             .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
             .pNext = nullptr,
-            .flags = get_image_flags(type),
+            .flags = image.flags,
             .imageType = VK_IMAGE_TYPE_2D,
-            .format = format,
-            .extent = VkExtent3D{size.width, size.height, 1},
-            .mipLevels = mips,
+            .format = image.format,
+            .extent = VkExtent3D{image.size.width, image.size.height, 1},
+            .mipLevels = image.mip_levels,
             .arrayLayers = image.layers,
-            .samples = samples,
-            .tiling = get_image_tiling(type),
-            .usage = get_image_usage(type),
-            .sharingMode = get_sharing_mode(type),
+            .samples = image.samples,
+            .tiling = get_image_tiling(image.type),
+            .usage = image.usage,
+            .sharingMode = get_sharing_mode(image.type),
             .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
     };
 
@@ -123,14 +148,7 @@ RawImage ImageImpl::create_image(ImageType type, VkExtent2D size, VkFormat forma
         info.queueFamilyIndexCount = queues.size();
         info.pQueueFamilyIndices = queues.data();
     }
-
-    VmaAllocationCreateInfo alloc_info{};
-    alloc_info.usage = VmaMemoryUsage::VMA_MEMORY_USAGE_GPU_ONLY;
-    alloc_info.flags = VmaAllocationCreateFlagBits::VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT;
-    vmaCreateImage(ctx->allocator, reinterpret_cast<VkImageCreateInfo const*>(&info), &alloc_info,
-                   reinterpret_cast<VkImage*>(&image.handle), &image.memory, nullptr);
-
-    return image;
+    return info;
 }
 
 void ImageImpl::destroy_image(RawImage& image) {
@@ -93,40 +93,86 @@ namespace ph {
 		return final;
 	}
 
-	static void find_uniform_buffers(ShaderMeta& info, spirv_cross::Compiler& refl, DescriptorSetLayoutCreateInfo& dslci) {
+	// Whether a resource of this type at this binding is one of the arrays of the bindless heap.
+	static bool is_bindless_heap_binding(uint32_t binding, VkDescriptorType type) {
+		switch (binding) {
+		case BindlessHeap::sampled_image_binding: return type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		case BindlessHeap::storage_image_binding: return type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		case BindlessHeap::storage_buffer_binding: return type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		default: return false;
+		}
+	}
+
+	// Returns the layout of the set the resource was declared in with layout(set = N), or nullptr if it is in the set of the bindless heap.
+	// The bindless heap has its own layout, so its resources are not reflected. type is the descriptor type the resource is reflected as.
+	static DescriptorSetLayoutCreateInfo* get_resource_set(impl::ContextImpl& ctx, spirv_cross::Compiler& refl, spirv_cross::Resource const& resource, 
+		VkDescriptorType type, std::vector<DescriptorSetLayoutCreateInfo>& sets, uint32_t& set_index) {
+		set_index = refl.get_decoration(resource.id, spv::DecorationDescriptorSet);
+		if (ctx.has_bindless_heap && set_index == ctx.bindless_set_index) {
+			// Anything else in this set would silently have no descriptor bound.
+			uint32_t const binding = refl.get_decoration(resource.id, spv::DecorationBinding);
+			if (!is_bindless_heap_binding(binding, type)) {
+				ctx.log(LogSeverity::Error, "Shader resource {} (set = {}, binding = {}) is declared in the set of the bindless heap, but is not one of its arrays. "
+					"Move it to another set, or change AppSettings::bindless_set_index.", refl.get_name(resource.id), set_index, binding);
+				assert(false && "Non-bindless resource declared in the set of the bindless heap");
+			}
+			return nullptr;
+		}
+		if (set_index >= sets.size()) {
+			sets.resize(set_index + 1);
+		}
+		return &sets[set_index];
+	}
+
+	static bool is_dynamic_buffer(spirv_cross::Compiler& refl, spirv_cross::Resource const& resource, std::vector<std::string> const& dynamic_buffers) {
+		return std::find(dynamic_buffers.begin(), dynamic_buffers.end(), refl.get_name(resource.id)) != dynamic_buffers.end();
+	}
+
+	static void find_uniform_buffers(impl::ContextImpl& ctx, ShaderMeta& info, spirv_cross::Compiler& refl, std::vector<DescriptorSetLayoutCreateInfo>& sets,
+		std::vector<std::string> const& dynamic_buffers) {
 		VkShaderStageFlags const stage = static_cast<VkShaderStageFlagBits>(get_shader_stage(refl));
 		spirv_cross::ShaderResources res = refl.get_shader_resources();
 		for (auto& ubo : res.uniform_buffers) {
+			uint32_t set_index = 0;
+			DescriptorSetLayoutCreateInfo* dslci = get_resource_set(ctx, refl, ubo, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, sets, set_index);
+			if (!dslci) continue;
 			VkDescriptorSetLayoutBinding binding{};
 			binding.binding = refl.get_decoration(ubo.id, spv::DecorationBinding);
-			binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			binding.descriptorType = is_dynamic_buffer(refl, ubo, dynamic_buffers) ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 			binding.descriptorCount = 1;
 			binding.stageFlags = stage;
-			dslci.bindings.push_back(binding);
+			dslci->bindings.push_back(binding);
 
-			info.add_binding(refl.get_name(ubo.id), { binding.binding, binding.descriptorType });
+			info.add_binding(refl.get_name(ubo.id), { binding.binding, binding.descriptorType, set_index });
 		}
 	}
 
-	static void find_shader_storage_buffers(ShaderMeta& info, spirv_cross::Compiler& refl, DescriptorSetLayoutCreateInfo& dslci) {
+	static void find_shader_storage_buffers(impl::ContextImpl& ctx, ShaderMeta& info, spirv_cross::Compiler& refl, std::vector<DescriptorSetLayoutCreateInfo>& sets,
+		std::vector<std::string> const& dynamic_buffers) {
 		VkShaderStageFlags const stage = static_cast<VkShaderStageFlagBits>(get_shader_stage(refl));
 		spirv_cross::ShaderResources res = refl.get_shader_resources();
 		for (auto& ssbo : res.storage_buffers) {
+			uint32_t set_index = 0;
+			DescriptorSetLayoutCreateInfo* dslci = get_resource_set(ctx, refl, ssbo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, sets, set_index);
+			if (!dslci) continue;
 			VkDescriptorSetLayoutBinding binding{};
 			binding.binding = refl.get_decoration(ssbo.id, spv::DecorationBinding);
-			binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			binding.descriptorType = is_dynamic_buffer(refl, ssbo, dynamic_buffers) ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 			binding.descriptorCount = 1;
 			binding.stageFlags = stage;
-			dslci.bindings.push_back(binding);
+			dslci->bindings.push_back(binding);
 
-			info.add_binding(refl.get_name(ssbo.id), { binding.binding, binding.descriptorType });
+			info.add_binding(refl.get_name(ssbo.id), { binding.binding, binding.descriptorType, set_index });
 		}
 	}
 
-	static void find_sampled_images(impl::ContextImpl& ctx, ShaderMeta& info, spirv_cross::Compiler& refl, DescriptorSetLayoutCreateInfo& dslci) {
+	static void find_sampled_images(impl::ContextImpl& ctx, ShaderMeta& info, spirv_cross::Compiler& refl, std::vector<DescriptorSetLayoutCreateInfo>& sets) {
 		VkShaderStageFlags const stage = static_cast<VkShaderStageFlagBits>(get_shader_stage(refl));
 		spirv_cross::ShaderResources res = refl.get_shader_resources();
 		for (auto& si : res.sampled_images) {
+			uint32_t set_index = 0;
+			DescriptorSetLayoutCreateInfo* dslci = get_resource_set(ctx, refl, si, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, sets, set_index);
+			if (!dslci) continue;
 			VkDescriptorSetLayoutBinding binding{};
 			binding.binding = refl.get_decoration(si.id, spv::DecorationBinding);
 			binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -143,14 +189,14 @@ namespace ph {
 					// flags for this binding
 
 					// Reserve enough space to hold all flags and this one
-					dslci.flags.resize(dslci.bindings.size() + 1);
-					dslci.flags.back() = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+					dslci->flags.resize(dslci->bindings.size() + 1);
+					dslci->flags.back() = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
 				}
 				else {
 					binding.descriptorCount = type.array[0];
                     // Always add PartiallyBound flag for arrays.
-                    dslci.flags.resize(dslci.bindings.size() + 1);
-                    dslci.flags.back() = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+                    dslci->flags.resize(dslci->bindings.size() + 1);
+                    dslci->flags.back() = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
 				}
 			}
 			else {
@@ -158,39 +204,45 @@ namespace ph {
 				binding.descriptorCount = 1;
 			}
 
-			info.add_binding(refl.get_name(si.id), { binding.binding, binding.descriptorType });
-			dslci.bindings.push_back(binding);
+			info.add_binding(refl.get_name(si.id), { binding.binding, binding.descriptorType, set_index });
+			dslci->bindings.push_back(binding);
 		}
 	}
 
-	static void find_storage_images(ShaderMeta& info, spirv_cross::Compiler& refl, DescriptorSetLayoutCreateInfo& dslci) {
+	static void find_storage_images(impl::ContextImpl& ctx, ShaderMeta& info, spirv_cross::Compiler& refl, std::vector<DescriptorSetLayoutCreateInfo>& sets) {
 		VkShaderStageFlags const stage = static_cast<VkShaderStageFlagBits>(get_shader_stage(refl));
 		spirv_cross::ShaderResources res = refl.get_shader_resources();
 
 		for (auto& si : res.storage_images) {
+			uint32_t set_index = 0;
+			DescriptorSetLayoutCreateInfo* dslci = get_resource_set(ctx, refl, si, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, sets, set_index);
+			if (!dslci) continue;
 			VkDescriptorSetLayoutBinding binding{};
 			binding.binding = refl.get_decoration(si.id, spv::DecorationBinding);
 			binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 			binding.stageFlags = stage;
 			binding.descriptorCount = 1;
-			info.add_binding(refl.get_name(si.id), { binding.binding, binding.descriptorType });
-			dslci.bindings.push_back(binding);
+			info.add_binding(refl.get_name(si.id), { binding.binding, binding.descriptorType, set_index });
+			dslci->bindings.push_back(binding);
 		}
 	}
 
 #if PHOBOS_ENABLE_RAY_TRACING
-	static void find_acceleration_structures(ShaderMeta& info, spirv_cross::Compiler& refl, DescriptorSetLayoutCreateInfo& dslci) {
+	static void find_acceleration_structures(impl::ContextImpl& ctx, ShaderMeta& info, spirv_cross::Compiler& refl, std::vector<DescriptorSetLayoutCreateInfo>& sets) {
 		VkShaderStageFlags const stage = static_cast<VkShaderStageFlagBits>(get_shader_stage(refl));
 		spirv_cross::ShaderResources res = refl.get_shader_resources();
 
 		for (auto& as : res.acceleration_structures) {
+			uint32_t set_index = 0;
+			DescriptorSetLayoutCreateInfo* dslci = get_resource_set(ctx, refl, as, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, sets, set_index);
+			if (!dslci) continue;
 			VkDescriptorSetLayoutBinding binding{};
 			binding.binding = refl.get_decoration(as.id, spv::DecorationBinding);
 			binding.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
 			binding.stageFlags = stage;
 			binding.descriptorCount = 1;
-			info.add_binding(refl.get_name(as.id), { binding.binding, binding.descriptorType });
-			dslci.bindings.push_back(binding);
+			info.add_binding(refl.get_name(as.id), { binding.binding, binding.descriptorType, set_index });
+			dslci->bindings.push_back(binding);
 		}
 	}
 #endif
@@ -231,26 +283,43 @@ namespace ph {
 		info.flags = final_flags;
 	}
 
-	static DescriptorSetLayoutCreateInfo get_descriptor_set_layout(impl::ContextImpl& ctx, ShaderMeta& info, std::vector<std::unique_ptr<spirv_cross::Compiler>>& reflected_shaders) {
-		DescriptorSetLayoutCreateInfo dslci;
+	static std::vector<DescriptorSetLayoutCreateInfo> get_descriptor_set_layouts(impl::ContextImpl& ctx, ShaderMeta& info, std::vector<std::unique_ptr<spirv_cross::Compiler>>& reflected_shaders,
+		std::vector<std::string> const& dynamic_buffers) {
+		// Always create at least one set, even if the pipeline has no descriptors
+		std::vector<DescriptorSetLayoutCreateInfo> sets(1);
 		for (auto& refl : reflected_shaders) {
-			find_uniform_buffers(info, *refl, dslci);
-			find_shader_storage_buffers(info, *refl, dslci);
-			find_sampled_images(ctx, info, *refl, dslci);
-			find_storage_images(info, *refl, dslci);
+			find_uniform_buffers(ctx, info, *refl, sets, dynamic_buffers);
+			find_shader_storage_buffers(ctx, info, *refl, sets, dynamic_buffers);
+			find_sampled_images(ctx, info, *refl, sets);
+			find_storage_images(ctx, info, *refl, sets);
 #if PHOBOS_ENABLE_RAY_TRACING
-			find_acceleration_structures(info, *refl, dslci);
+			find_acceleration_structures(ctx, info, *refl, sets);
 #endif
 		}
-        dslci.flags.resize(dslci.bindings.size()); // Make sure size matches so we don't index out of bounds.
-		collapse_bindings(dslci);
-		return dslci;
+		for (DescriptorSetLayoutCreateInfo& dslci : sets) {
+			dslci.flags.resize(dslci.bindings.size()); // Make sure size matches so we don't index out of bounds.
+			collapse_bindings(dslci);
+		}
+		return sets;
 	}
 
-	static PipelineLayoutCreateInfo make_pipeline_layout(impl::ContextImpl& ctx, std::vector<std::unique_ptr<spirv_cross::Compiler>>& reflected_shaders, ShaderMeta& shader_info) {
+	static PipelineLayoutCreateInfo make_pipeline_layout(impl::ContextImpl& ctx, std::vector<std::unique_ptr<spirv_cross::Compiler>>& reflected_shaders, ShaderMeta& shader_info,
+		std::vector<std::string> const& dynamic_buffers, std::optional<uint32_t> push_descriptor_set = std::nullopt) {
 		PipelineLayoutCreateInfo layout;
 		layout.push_constants = get_push_constants(reflected_shaders);
-		layout.set_layout = get_descriptor_set_layout(ctx, shader_info, reflected_shaders);
+		layout.set_layouts = get_descriptor_set_layouts(ctx, shader_info, reflected_shaders, dynamic_buffers);
+		if (push_descriptor_set) {
+			assert(!(ctx.has_bindless_heap && *push_descriptor_set == ctx.bindless_set_index) && "The bindless heap set cannot be a push descriptor set");
+			if (*push_descriptor_set >= layout.set_layouts.size()) {
+				layout.set_layouts.resize(*push_descriptor_set + 1);
+			}
+			DescriptorSetLayoutCreateInfo& dslci = layout.set_layouts[*push_descriptor_set];
+			// Dynamic buffers are not allowed in push descriptor set layouts.
+			assert(std::none_of(dslci.bindings.begin(), dslci.bindings.end(), [](VkDescriptorSetLayoutBinding const& binding) {
+				return binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC || binding.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+			}) && "Push descriptor set cannot contain dynamic buffers");
+			dslci.push_descriptor = true;
+		}
 		return layout;
 	}
 }
@@ -299,33 +368,60 @@ namespace {
 }
 
 ShaderHandle PipelineImpl::create_shader(std::string_view path, std::string_view entry_point, ShaderStage stage) {
-	uint32_t id = ShaderHandleId::next();
-
 	ph::ShaderModuleCreateInfo info;
 	info.code = load_shader_code(path);
 	info.entry_point = entry_point;
 	info.stage = stage;
+	info.code_hash = std::hash<std::vector<uint32_t>>{}(info.code);
 
-	cache->shader.insert(ShaderHandle{ id }, std::move(info));
+	size_t content_hash = 0;
+	hash_combine(content_hash, info.code_hash, info.entry_point, info.stage);
 
-	return ShaderHandle{ id };
+	std::lock_guard lock(shader_mutex);
+	auto [begin, end] = shaders_by_content.equal_range(content_hash);
+	for (auto it = begin; it != end; ++it) {
+		ph::ShaderModuleCreateInfo const* existing = cache->shader.get(it->second);
+		if (existing && existing->stage == info.stage && existing->entry_point == info.entry_point && existing->code == info.code) {
+			return it->second;
+		}
+	}
+
+	ShaderHandle handle{ ShaderHandleId::next() };
+	cache->shader.insert(handle, std::move(info));
+	shaders_by_content.emplace(content_hash, handle);
+	return handle;
 }
 
 
-void PipelineImpl::create_named_pipeline(ph::PipelineCreateInfo pci) {
-	pipelines[pci.name] = std::move(pci);
+PipelineId PipelineImpl::create_named_pipeline(ph::PipelineCreateInfo pci) {
+	PipelineId id = pipelines.insert(std::move(pci));
+	// If a pipeline with this name existed before, recompile it for the render passes it was used in.
+	auto pipeline = pipelines.get(id);
+	cache->request_pipeline_variants(pipeline->info, pipeline->state_hash);
+	return id;
+}
+
+PipelineId PipelineImpl::create_named_pipeline(ph::ComputePipelineCreateInfo pci) {
+	PipelineId id = compute_pipelines.insert(std::move(pci));
+	// Compute pipelines do not depend on a renderpass, so we can start compiling right away.
+	cache->request_compute_pipeline_compile(compute_pipelines.get(id)->info);
+	return id;
 }
 
-void PipelineImpl::create_named_pipeline(ph::ComputePipelineCreateInfo pci) {
-	compute_pipelines[pci.name] = std::move(pci);
+PipelineId PipelineImpl::get_pipeline_id(std::string_view name) const {
+	return pipelines.get_id(name);
+}
+
+PipelineId PipelineImpl::get_compute_pipeline_id(std::string_view name) const {
+	return compute_pipelines.get_id(name);
 }
 
 ShaderMeta const& PipelineImpl::get_shader_meta(std::string_view pipeline_name) {
-	return get_pipeline(pipeline_name).meta;
+	return get_pipeline(pipeline_name)->info.meta;
 }
 
 ShaderMeta const& PipelineImpl::get_compute_shader_meta(std::string_view pipeline_name) {
-	return get_compute_pipeline(pipeline_name).meta;
+	return get_compute_pipeline(pipeline_name)->info.meta;
 }
 
 
@@ -336,7 +432,7 @@ void PipelineImpl::reflect_shaders(ph::PipelineCreateInfo& pci) {
 		assert(shader && "Invalid shader");
 		reflected_shaders.push_back(reflect::reflect_shader_stage(*shader));
 	}
-	pci.layout = reflect::make_pipeline_layout(*ctx, reflected_shaders, pci.meta);
+	pci.layout = reflect::make_pipeline_layout(*ctx, reflected_shaders, pci.meta, pci.dynamic_buffers, pci.push_descriptor_set);
 }
 
 void PipelineImpl::reflect_shaders(ph::ComputePipelineCreateInfo& pci) {
@@ -344,16 +440,32 @@ void PipelineImpl::reflect_shaders(ph::ComputePipelineCreateInfo& pci) {
 	ph::ShaderModuleCreateInfo* shader = cache->shader.get(pci.shader);
 	assert(shader && "Invalid shader");
 	reflected_shaders.push_back(reflect::reflect_shader_stage(*shader));
-	pci.layout = reflect::make_pipeline_layout(*ctx, reflected_shaders, pci.meta);
+	pci.layout = reflect::make_pipeline_layout(*ctx, reflected_shaders, pci.meta, pci.dynamic_buffers, pci.push_descriptor_set);
+}
+
+
+std::shared_ptr<NamedPipeline<ph::PipelineCreateInfo> const> PipelineImpl::get_pipeline(std::string_view name) {
+	return pipelines.get(pipelines.get_id(name));
+}
+
+std::shared_ptr<NamedPipeline<ph::ComputePipelineCreateInfo> const> PipelineImpl::get_compute_pipeline(std::string_view name) {
+	return compute_pipelines.get(compute_pipelines.get_id(name));
 }
 
+std::shared_ptr<NamedPipeline<ph::PipelineCreateInfo> const> PipelineImpl::get_pipeline(PipelineId id) {
+	return pipelines.get(id);
+}
+
+std::shared_ptr<NamedPipeline<ph::ComputePipelineCreateInfo> const> PipelineImpl::get_compute_pipeline(PipelineId id) {
+	return compute_pipelines.get(id);
+}
 
-ph::PipelineCreateInfo& PipelineImpl::get_pipeline(std::string_view name) {
-	return pipelines.at(std::string(name));
+uint32_t PipelineImpl::get_pipeline_version(PipelineId id) const {
+	return pipelines.version(id);
 }
 
-ph::ComputePipelineCreateInfo& PipelineImpl::get_compute_pipeline(std::string_view name) {
-	return compute_pipelines.at(std::string(name));
+uint32_t PipelineImpl::get_compute_pipeline_version(PipelineId id) const {
+	return compute_pipelines.version(id);
 }
 
 #if PHOBOS_ENABLE_RAY_TRACING
@@ -365,11 +477,13 @@ void PipelineImpl::reflect_shaders(ph::RayTracingPipelineCreateInfo& pci) {
 		assert(shader && "Invalid shader");
 		reflected_shaders.push_back(reflect::reflect_shader_stage(*shader));
 	}
-	pci.layout = reflect::make_pipeline_layout(*ctx, reflected_shaders, pci.meta);
+	pci.layout = reflect::make_pipeline_layout(*ctx, reflected_shaders, pci.meta, pci.dynamic_buffers);
 }
 
 void PipelineImpl::create_named_pipeline(ph::RayTracingPipelineCreateInfo pci) {
-	rtx_pipelines[pci.name] = std::move(pci);
+	std::string name = pci.name;
+	rtx_pipelines[name] = std::move(pci);
+	cache->request_ray_tracing_pipeline_compile(rtx_pipelines[name]);
 }
 
 ShaderMeta const& PipelineImpl::get_ray_tracing_shader_meta(std::string_view pipeline_name) {
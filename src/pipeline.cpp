@@ -1,18 +1,41 @@
 #include <phobos/pipeline.hpp>
 #include <phobos/context.hpp>
 #include <phobos/memory.hpp>
+#include <phobos/hash.hpp>
+
+#include <cassert>
 
 #if PHOBOS_ENABLE_RAY_TRACING
 #include <phobos/acceleration_structure.hpp>
-#include <algorithm> // std::sort
 #endif
 
+#include <algorithm>
+
 namespace ph {
 
-DescriptorBuilder DescriptorBuilder::create(Context& ctx, Pipeline const& pipeline) {
+VkPipelineStageFlags get_legacy_stage_flags(VkPipelineStageFlags2KHR stages) {
+	VkPipelineStageFlags result = static_cast<VkPipelineStageFlags>(stages & 0xFFFFFFFFull);
+	if (stages & (VK_PIPELINE_STAGE_2_COPY_BIT_KHR | VK_PIPELINE_STAGE_2_RESOLVE_BIT_KHR | VK_PIPELINE_STAGE_2_BLIT_BIT_KHR | VK_PIPELINE_STAGE_2_CLEAR_BIT_KHR)) {
+		result |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+	}
+	if (stages & (VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT_KHR | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT_KHR)) {
+		result |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+	}
+	// Graphics pipelines only have a vertex shader before rasterization.
+	if (stages & VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT_KHR) {
+		result |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+	}
+	return result;
+}
+
+DescriptorBuilder DescriptorBuilder::create(Context& ctx, Pipeline const& pipeline, uint32_t set_index, uint32_t thread_index, DescriptorLifetime lifetime) {
 	DescriptorBuilder builder{};
 	builder.ctx = &ctx;
 	builder.pipeline = pipeline;
+	builder.set_index = set_index;
+	builder.thread_index = thread_index;
+	builder.lifetime = lifetime;
+	builder.info.has_bindings_hash = true;
 	return builder;
 }
 
@@ -31,11 +54,12 @@ DescriptorBuilder& DescriptorBuilder::add_sampled_image(uint32_t binding, ImageV
 		.view = view,
 		.layout = layout
 	};
-	info.bindings.push_back(std::move(descr));
+	add_binding(std::move(descr));
 	return *this;
 }
 
 DescriptorBuilder& DescriptorBuilder::add_sampled_image(ShaderMeta::Binding const& binding, ImageView view, VkSampler sampler, VkImageLayout layout) {
+	assert(binding.set == set_index && "Binding is not part of this descriptor set");
 	return add_sampled_image(binding.binding, view, sampler, layout);
 }
 
@@ -55,11 +79,12 @@ DescriptorBuilder& DescriptorBuilder::add_sampled_image_array(uint32_t binding,
             .layout = layout
         };
     }
-    info.bindings.push_back(std::move(descr));
+    add_binding(std::move(descr));
     return *this;
 }
 
 DescriptorBuilder& DescriptorBuilder::add_sampled_image_array(ShaderMeta::Binding const& binding, std::span<const ImageView> views, VkSampler sampler, VkImageLayout layout) {
+    assert(binding.set == set_index && "Binding is not part of this descriptor set");
     return add_sampled_image_array(binding.binding, views, sampler, layout);
 }
 
@@ -76,11 +101,12 @@ DescriptorBuilder& DescriptorBuilder::add_storage_image(uint32_t binding, ImageV
 		.view = view,
 		.layout = layout
 	};
-	info.bindings.push_back(std::move(descr));
+	add_binding(std::move(descr));
 	return *this;
 }
 
 DescriptorBuilder& DescriptorBuilder::add_storage_image(ShaderMeta::Binding const& binding, ImageView view, VkImageLayout layout) {
+	assert(binding.set == set_index && "Binding is not part of this descriptor set");
 	return add_storage_image(binding.binding, view, layout);
 }
 
@@ -98,11 +124,15 @@ DescriptorBuilder& DescriptorBuilder::add_uniform_buffer(uint32_t binding, Buffe
 		.offset = buffer.offset,
 		.range = buffer.range
 	};
-	info.bindings.push_back(descr);
+	add_binding(std::move(descr));
 	return *this;
 }
 
 DescriptorBuilder& DescriptorBuilder::add_uniform_buffer(ShaderMeta::Binding const& binding, BufferSlice buffer) {
+	assert(binding.set == set_index && "Binding is not part of this descriptor set");
+	if (binding.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC) {
+		return add_dynamic_uniform_buffer(binding.binding, buffer);
+	}
 	return add_uniform_buffer(binding.binding, buffer);
 }
 
@@ -120,11 +150,15 @@ DescriptorBuilder& DescriptorBuilder::add_storage_buffer(uint32_t binding, Buffe
 		.offset = buffer.offset,
 		.range = buffer.range
 	};
-	info.bindings.push_back(descr);
+	add_binding(std::move(descr));
 	return *this;
 }
 
 DescriptorBuilder& DescriptorBuilder::add_storage_buffer(ShaderMeta::Binding const& binding, BufferSlice buffer) {
+	assert(binding.set == set_index && "Binding is not part of this descriptor set");
+	if (binding.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC) {
+		return add_dynamic_storage_buffer(binding.binding, buffer);
+	}
 	return add_storage_buffer(binding.binding, buffer);
 }
 
@@ -132,6 +166,37 @@ DescriptorBuilder& DescriptorBuilder::add_storage_buffer(std::string_view bindin
 	return add_storage_buffer(ctx->get_shader_meta(pipeline)[binding], buffer);
 }
 
+DescriptorBuilder& DescriptorBuilder::add_dynamic_uniform_buffer(uint32_t binding, BufferSlice buffer) {
+	DescriptorBinding descr{};
+	descr.binding = binding;
+	descr.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	auto& descriptor = descr.descriptors.emplace_back();
+	// Leave the offset out of the descriptor, so every slice of this buffer maps to the same descriptor set
+	descriptor.buffer = ph::DescriptorBufferInfo{
+		.buffer = buffer.buffer,
+		.offset = 0,
+		.range = buffer.range
+	};
+	add_binding(std::move(descr));
+	dynamic_offsets.emplace_back(binding, static_cast<uint32_t>(buffer.offset));
+	return *this;
+}
+
+DescriptorBuilder& DescriptorBuilder::add_dynamic_storage_buffer(uint32_t binding, BufferSlice buffer) {
+	DescriptorBinding descr{};
+	descr.binding = binding;
+	descr.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	auto& descriptor = descr.descriptors.emplace_back();
+	descriptor.buffer = ph::DescriptorBufferInfo{
+		.buffer = buffer.buffer,
+		.offset = 0,
+		.range = buffer.range
+	};
+	add_binding(std::move(descr));
+	dynamic_offsets.emplace_back(binding, static_cast<uint32_t>(buffer.offset));
+	return *this;
+}
+
 #if PHOBOS_ENABLE_RAY_TRACING
 
 DescriptorBuilder& DescriptorBuilder::add_acceleration_structure(uint32_t binding, VkAccelerationStructureKHR const& as) {
@@ -142,11 +207,12 @@ DescriptorBuilder& DescriptorBuilder::add_acceleration_structure(uint32_t bindin
     descriptor.accel_structure = ph::DescriptorAccelerationStructureInfo{
             .structure = as
     };
-    info.bindings.push_back(descr);
+    add_binding(std::move(descr));
     return *this;
 }
 
 DescriptorBuilder& DescriptorBuilder::add_acceleration_structure(ShaderMeta::Binding const& binding, VkAccelerationStructureKHR const& as) {
+    assert(binding.set == set_index && "Binding is not part of this descriptor set");
     return add_acceleration_structure(binding.binding, as);
 }
 
@@ -170,7 +236,37 @@ VkDescriptorSet DescriptorBuilder::get() {
 			cur = cur->pNext;
 		}
 	}
-	return ctx->get_or_create(info, pipeline, pNext);
+	return ctx->get_or_create(info, pipeline, set_index, pNext, thread_index, lifetime);
+}
+
+void DescriptorBuilder::add_binding(DescriptorBinding&& binding) {
+	// Bindings are kept sorted on binding number, so the cache can write them with the layout's update template in one pass.
+	if (info.bindings.empty() || info.bindings.back().binding < binding.binding) {
+		hash_combine(info.bindings_hash, binding);
+		info.bindings.push_back(std::move(binding));
+		return;
+	}
+	auto it = std::lower_bound(info.bindings.begin(), info.bindings.end(), binding.binding, [](DescriptorBinding const& existing, uint32_t index) {
+		return existing.binding < index;
+	});
+	info.bindings.insert(it, std::move(binding));
+	// The running hash assumes bindings are appended, let std::hash<DescriptorSetBinding> hash the sorted bindings instead.
+	info.has_bindings_hash = false;
+}
+
+DescriptorSetBinding const& DescriptorBuilder::get_set_binding() const {
+	return info;
+}
+
+std::vector<uint32_t> DescriptorBuilder::get_dynamic_offsets() const {
+	auto sorted = dynamic_offsets;
+	std::sort(sorted.begin(), sorted.end());
+	std::vector<uint32_t> offsets;
+	offsets.reserve(sorted.size());
+	for (auto const& [binding, offset] : sorted) {
+		offsets.push_back(offset);
+	}
+	return offsets;
 }
 
 PipelineBuilder PipelineBuilder::create(Context& ctx, std::string_view name) {
@@ -301,6 +397,16 @@ PipelineBuilder& PipelineBuilder::enable_blend_op(bool enable) {
 	return *this;
 }
 
+PipelineBuilder& PipelineBuilder::add_dynamic_buffer(std::string_view binding) {
+	pci.dynamic_buffers.emplace_back(binding);
+	return *this;
+}
+
+PipelineBuilder& PipelineBuilder::set_push_descriptor_set(uint32_t set_index) {
+	pci.push_descriptor_set = set_index;
+	return *this;
+}
+
 PipelineBuilder& PipelineBuilder::reflect() {
 	ctx->reflect_shaders(pci);
 	return *this;
@@ -326,6 +432,16 @@ ComputePipelineBuilder& ComputePipelineBuilder::set_shader(std::string_view path
 	return set_shader(ctx->create_shader(path, entry, ph::ShaderStage::Compute));
 }
 
+ComputePipelineBuilder& ComputePipelineBuilder::add_dynamic_buffer(std::string_view binding) {
+	pci.dynamic_buffers.emplace_back(binding);
+	return *this;
+}
+
+ComputePipelineBuilder& ComputePipelineBuilder::set_push_descriptor_set(uint32_t set_index) {
+	pci.push_descriptor_set = set_index;
+	return *this;
+}
+
 ComputePipelineBuilder& ComputePipelineBuilder::reflect() {
 	ctx->reflect_shaders(pci);
 	return *this;
@@ -387,6 +503,11 @@ RayTracingPipelineBuilder& RayTracingPipelineBuilder::set_recursion_depth(uint32
 	return *this;
 }
 
+RayTracingPipelineBuilder& RayTracingPipelineBuilder::add_dynamic_buffer(std::string_view binding) {
+	pci.dynamic_buffers.emplace_back(binding);
+	return *this;
+}
+
 RayTracingPipelineBuilder& RayTracingPipelineBuilder::reflect() {
 	ctx->reflect_shaders(pci);
 	return *this;
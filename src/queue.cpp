@@ -133,6 +133,44 @@ void Queue::free_single_time(CommandBuffer& cmd_buf, uint32_t thread) {
 }
 
 void Queue::submit(CommandBuffer& cmd_buf, VkFence signal_fence, plib::bit_flag<ph::PipelineStage> wait_stage, VkSemaphore wait_semaphore, VkSemaphore signal_semaphore) {
+	if (ctx->synchronization2_enabled()) {
+		VkCommandBufferSubmitInfoKHR cmd_buf_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR,
+			.pNext = nullptr,
+			.commandBuffer = cmd_buf.handle(),
+			.deviceMask = 0
+		};
+		VkSemaphoreSubmitInfoKHR wait_info{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR,
+			.pNext = nullptr,
+			.semaphore = wait_semaphore,
+			.value = 0,
+			.stageMask = wait_stage.value(),
+			.deviceIndex = 0
+		};
+		VkSemaphoreSubmitInfoKHR signal_info{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR,
+			.pNext = nullptr,
+			.semaphore = signal_semaphore,
+			.value = 0,
+			.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR,
+			.deviceIndex = 0
+		};
+		VkSubmitInfo2KHR info{
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR,
+			.pNext = nullptr,
+			.flags = {},
+			.waitSemaphoreInfoCount = wait_semaphore ? 1u : 0u,
+			.pWaitSemaphoreInfos = &wait_info,
+			.commandBufferInfoCount = 1,
+			.pCommandBufferInfos = &cmd_buf_info,
+			.signalSemaphoreInfoCount = signal_semaphore ? 1u : 0u,
+			.pSignalSemaphoreInfos = &signal_info
+		};
+		submit(info, signal_fence);
+		return;
+	}
+
 	VkSubmitInfo info{};
 	info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	info.commandBufferCount = 1;
@@ -145,7 +183,7 @@ void Queue::submit(CommandBuffer& cmd_buf, VkFence signal_fence, plib::bit_flag<
 	if (wait_semaphore) {
 		info.waitSemaphoreCount = 1;
 		info.pWaitSemaphores = &wait_semaphore;
-		auto const wait_stage_value = static_cast<VkPipelineStageFlags>(wait_stage.value());
+		auto const wait_stage_value = get_legacy_stage_flags(wait_stage.value());
 		info.pWaitDstStageMask = &wait_stage_value;
 	}
 	submit(info, signal_fence);
@@ -157,6 +195,11 @@ void Queue::submit(VkSubmitInfo const& submit_info, VkFence signal_fence) {
 	vkQueueSubmit(handle, 1, &submit_info, signal_fence);
 }
 
+void Queue::submit(VkSubmitInfo2KHR const& submit_info, VkFence signal_fence) {
+	std::lock_guard lock{ *mutex };
+	ctx->queue_submit2(handle, submit_info, signal_fence);
+}
+
 void Queue::present(VkPresentInfoKHR const& present_info) {
 	assert(can_present() && "Tried presenting from queue that has no present capabilities");
 	std::lock_guard lock{ *mutex };
@@ -1,7 +1,11 @@
 #include <phobos/render_graph.hpp>
+#include <phobos/hash.hpp>
 #include <cassert>
+#include <algorithm>
 
 #include <exception>
+#include <cstring>
+#include <tuple>
 
 namespace ph {
 
@@ -12,131 +16,866 @@ static bool is_output_attachment(ResourceUsage const& usage) {
     return false;
 }
 
+static VkImageLayout get_output_layout_for_format(VkFormat format) {
+    if (is_depth_format(format)) { return VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL; }
+
+    return VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+}
+
+static bool reads_contents(ResourceUsage const& usage) {
+    if (is_output_attachment(usage)) return usage.attachment.load_op == LoadOp::Load;
+    if (usage.access & ResourceAccess::ShaderRead) return true;
+    return false;
+}
+
+static bool writes_contents(ResourceUsage const& usage) {
+    if (is_output_attachment(usage)) return true;
+    if (usage.access & ResourceAccess::ShaderWrite) return true;
+    return false;
+}
+
+// Whether the usage replaces all previous contents of the resource. Views to a part of an attachment leave the rest intact.
+static bool overwrites_contents(ResourceUsage const& usage) {
+    return is_output_attachment(usage) && usage.attachment.load_op != LoadOp::Load && !usage.attachment.view;
+}
+
+static bool buffers_overlap(BufferSlice const& a, BufferSlice const& b) {
+    return a.buffer == b.buffer && a.offset < b.offset + b.range && b.offset < a.offset + a.range;
+}
+
+static bool was_used(std::pair<ResourceUsage, Pass*> const& usage) {
+    return usage.second != nullptr;
+}
+
+// Depth attachments are written in the fragment test stages, not in the attachment output stage.
+static plib::bit_flag<PipelineStage> get_attachment_stage(VkFormat format) {
+    if (is_depth_format(format)) { return plib::bit_flag<PipelineStage>{ PipelineStage::LateFragmentTests } | PipelineStage::EarlyFragmentTests; }
+
+    return plib::bit_flag<PipelineStage>{ PipelineStage::AttachmentOutput };
+}
+
 void RenderGraph::add_pass(Pass pass) {
 	passes.push_back(std::move(pass));
 }
 
+void RenderGraph::export_attachment(std::string_view name) {
+    exported_attachments.emplace_back(name);
+}
+
+void RenderGraph::export_image(ImageView view) {
+    exported_images.push_back(view.image);
+}
+
+void RenderGraph::export_buffer(BufferSlice slice) {
+    exported_buffers.push_back(slice);
+}
+
 void RenderGraph::build(Context& ctx) {
-	for (auto it = passes.begin(); it != passes.end(); ++it) {
-        Pass* pass = &*it;
-        auto attachments = get_attachment_descriptions(ctx, pass);
-       
-        // Create attachment references
-        std::vector<VkAttachmentReference> color_attachments{};
-        std::optional<VkAttachmentReference> depth_ref{};
-        size_t attachment_index = 0;
-        for (ResourceUsage const& resource : pass->resources) {
-            // Skip non-attachment resources
+    get_structure(ctx, current_structure);
+    // A retained graph that has the same structure as the last time it was built only needs its handles updated.
+    if (compiled_structure && compiled_structure->hash == current_structure.hash && *compiled_structure == current_structure) {
+        reuse_build(ctx);
+        return;
+    }
+    compile(ctx);
+    if (!compiled_structure) compiled_structure.emplace();
+    std::swap(*compiled_structure, current_structure);
+}
+
+void RenderGraph::compile(Context& ctx) {
+    create_resource_table(ctx);
+    cull_passes(ctx);
+    infer_load_ops();
+    built_passes.clear();
+    built_passes.resize(passes.size());
+    std::vector<TransientAttachmentUsage> transient_usages;
+    // Placing transient attachments in memory can recreate their images.
+    if (alias_transient_attachments(ctx, transient_usages)) {
+        create_resource_table(ctx);
+    }
+
+    for (size_t i = 0; i < passes.size(); ++i) {
+        Pass* pass = &passes[i];
+        BuiltPass& build = built_passes[i];
+        // Figure out what barriers to create
+        create_pass_barriers(ctx, *pass, build);
+        // Only create renderpass in non-compute passes
+        if (pass->no_renderpass) continue;
+        // With dynamic rendering, no render pass or framebuffer is needed.
+        if (ctx.dynamic_rendering_enabled()) {
+            create_rendering_barriers(ctx, *pass, build);
+            build_rendering_pass(ctx, *pass, build);
+        }
+        else {
+            build.attachments = get_attachment_descriptions(ctx, pass);
+            create_render_pass(ctx, *pass, build);
+        }
+    }
+    create_aliasing_barriers(transient_usages);
+    create_barrier_batches(ctx);
+}
+
+void RenderGraph::reuse_build(Context& ctx) {
+    if (kept_passes.size() != passes.size()) {
+        // Kept passes are in order, so no pass is overwritten before it is moved.
+        for (size_t i = 0; i < kept_passes.size(); ++i) {
+            if (kept_passes[i] != i) passes[i] = std::move(passes[kept_passes[i]]);
+        }
+        passes.resize(kept_passes.size());
+    }
+    for (UsageRef const& load : dont_care_loads) {
+        passes[load.pass].resources[load.resource].attachment.load_op = LoadOp::DontCare;
+    }
+    for (uint32_t i = 0; i < passes.size(); ++i) {
+        patch_pass(ctx, i, resolved_views.data() + resolved_view_offsets[kept_passes[i]]);
+    }
+}
+
+void RenderGraph::reset() {
+    passes.clear();
+    exported_attachments.clear();
+    exported_images.clear();
+    exported_buffers.clear();
+}
+
+uint32_t RenderGraph::get_culled_pass_count() const {
+    return culled_passes;
+}
+
+void RenderGraph::cull_passes(Context& ctx) {
+    // Walk backwards, so every pass that could read the results of a pass is already known to be live or dead.
+    std::vector<bool> live(passes.size(), false);
+    for (uint32_t pass = static_cast<uint32_t>(passes.size()); pass-- > 0;) {
+        bool writes = false;
+        for (uint32_t index = 0; index < passes[pass].resources.size() && !live[pass]; ++index) {
+            ResourceUsage const& resource = passes[pass].resources[index];
+            if (!writes_contents(resource)) continue;
+            writes = true;
+            live[pass] = is_graph_output(ctx, resource) || is_read_later(UsageRef{ .pass = pass, .resource = index }, live);
+        }
+        // A pass that doesn't declare any writes can have side effects the graph doesn't know about.
+        if (!writes) live[pass] = true;
+    }
+
+    // Attachments that nothing reads afterwards don't need to be written back to memory.
+    store_ops.assign(passes.size(), {});
+    for (uint32_t pass = 0; pass < passes.size(); ++pass) {
+        if (!live[pass]) continue;
+        store_ops[pass].resize(passes[pass].resources.size(), VK_ATTACHMENT_STORE_OP_STORE);
+        for (uint32_t index = 0; index < passes[pass].resources.size(); ++index) {
+            ResourceUsage const& resource = passes[pass].resources[index];
             if (!is_output_attachment(resource)) continue;
+            bool const used = is_graph_output(ctx, resource) || is_read_later(UsageRef{ .pass = pass, .resource = index }, live);
+            store_ops[pass][index] = used ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        }
+    }
 
-            Attachment attachment = ctx.get_attachment(resource.attachment.name);
-            // If a view is set, use that instead of the default ImageView.
-            ImageView view = resource.attachment.view ? resource.attachment.view : attachment.view;
-            VkAttachmentReference ref{};
-            ref.attachment = attachment_index;
-            if (is_depth_format(view.format)) {
-                ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-                depth_ref = ref;
-            }
-            else {
-                // If an attachment is not a depth attachment, it's a color attachment
-                ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-                color_attachments.push_back(ref);
-            }
+    kept_passes.clear();
+    for (uint32_t pass = 0; pass < passes.size(); ++pass) {
+        if (live[pass]) kept_passes.push_back(pass);
+    }
+    culled_passes = static_cast<uint32_t>(passes.size() - kept_passes.size());
+    if (culled_passes == 0) return;
+    size_t kept = 0;
+    for (size_t pass = 0; pass < passes.size(); ++pass) {
+        if (!live[pass]) continue;
+        if (kept != pass) {
+            passes[kept] = std::move(passes[pass]);
+            store_ops[kept] = std::move(store_ops[pass]);
+        }
+        kept += 1;
+    }
+    passes.resize(kept);
+    store_ops.resize(kept);
+    create_resource_table(ctx);
+}
+
+void RenderGraph::infer_load_ops() {
+    dont_care_loads.clear();
+    for (uint32_t pass = 0; pass < passes.size(); ++pass) {
+        for (ResourceUsage& resource : passes[pass].resources) {
+            if (!is_output_attachment(resource) || resource.attachment.load_op != LoadOp::Load) continue;
+            // Other attachments keep their contents across frames, so loading them is only pointless if they are transient.
+            if (!get_attachment(resource.attachment.name).transient) continue;
+            std::vector<UsageRef> const& timeline = get_usage_timeline(resource);
+            bool const written = std::any_of(timeline.begin(), timeline.end(), [this, pass](UsageRef const& usage) {
+                return usage.pass < pass && writes_contents(passes[usage.pass].resources[usage.resource]);
+            });
+            if (written) continue;
+            resource.attachment.load_op = LoadOp::DontCare;
+            dont_care_loads.push_back(UsageRef{ .pass = pass, .resource = static_cast<uint32_t>(&resource - passes[pass].resources.data()) });
+        }
+    }
+}
 
-            ++attachment_index;
+bool RenderGraph::is_graph_output(Context& ctx, ResourceUsage const& resource) {
+    if (resource.type == ResourceType::Buffer) {
+        BufferSlice const& slice = resource.buffer.slice;
+        bool const exported = std::any_of(exported_buffers.begin(), exported_buffers.end(), [&slice](BufferSlice const& other) {
+            return buffers_overlap(slice, other);
+        });
+        if (exported) return true;
+    }
+    else {
+        if (resource.type == ResourceType::Attachment) {
+            if (ctx.is_swapchain_attachment(resource.attachment.name)) return true;
+            if (std::find(exported_attachments.begin(), exported_attachments.end(), resource.attachment.name) != exported_attachments.end()) return true;
         }
+        if (std::find(exported_images.begin(), exported_images.end(), get_resource_view(resource).image) != exported_images.end()) return true;
+    }
 
-        BuiltPass& build = built_passes.emplace_back();
-        build.handle = nullptr;
+    // A resource that is read before it is written in the graph uses the contents of the previous frame.
+    // Transient attachments never keep their contents, so reading them first doesn't make them outputs.
+    UsageRef const first = get_usage_timeline(resource).front();
+    ResourceUsage const& first_usage = passes[first.pass].resources[first.resource];
+    if (first_usage.type == ResourceType::Attachment && get_attachment(first_usage.attachment.name).transient) return false;
+    return reads_contents(first_usage);
+}
 
-        // Figure out what barriers to create
-        create_pass_barriers(ctx, *pass, build);
+std::vector<RenderGraph::UsageRef> const& RenderGraph::get_usage_timeline(ResourceUsage const& resource) const {
+    if (resource.type == ResourceType::Buffer) {
+        return resource_table.buffer_usages[resource_table.buffer_ids.at(resource.buffer.slice)];
+    }
+    // Attachments are tracked by the image of the attachment, like in create_resource_table().
+    VkImage image = resource.type == ResourceType::Attachment ? get_attachment(resource.attachment.name).view.image : resource.image.view.image;
+    return resource_table.image_usages[resource_table.image_ids.at(image)];
+}
 
-        // Only create renderpass in non-compute passes
-        if (!pass->no_renderpass) {
-
-            // Create subpass description
-            VkSubpassDescription subpass{};
-            subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-            subpass.colorAttachmentCount = color_attachments.size();
-            subpass.pColorAttachments = color_attachments.data();
-            if (depth_ref != std::nullopt) {
-                subpass.pDepthStencilAttachment = &*depth_ref;
+bool RenderGraph::is_read_later(UsageRef usage, std::vector<bool> const& live) {
+    std::vector<UsageRef> const& timeline = get_usage_timeline(passes[usage.pass].resources[usage.resource]);
+    auto it = std::upper_bound(timeline.begin(), timeline.end(), usage.pass, [](uint32_t pass, UsageRef const& ref) {
+        return pass < ref.pass;
+    });
+    for (; it != timeline.end(); ++it) {
+        if (!live[it->pass]) continue;
+        ResourceUsage const& later = passes[it->pass].resources[it->resource];
+        if (reads_contents(later)) return true;
+        if (overwrites_contents(later)) return false;
+    }
+    return false;
+}
+
+BarrierStats RenderGraph::get_barrier_stats() const {
+    return barrier_stats;
+}
+
+TransientMemoryStats RenderGraph::get_transient_memory_stats() const {
+    return transient_stats;
+}
+
+bool RenderGraph::alias_transient_attachments(Context& ctx, std::vector<TransientAttachmentUsage>& usages) {
+    usages.clear();
+    for (auto const& [name, id] : resource_table.attachment_ids) {
+        if (!resource_table.attachments[id].transient) continue;
+        std::vector<UsageRef> const& timeline = resource_table.attachment_usages[id];
+        usages.push_back(TransientAttachmentUsage{ .name = name, .first_pass = timeline.front().pass, .last_pass = timeline.back().pass });
+    }
+    // Don't move the transient attachments of other graphs around.
+    if (usages.empty()) {
+        transient_stats = TransientMemoryStats{};
+        return false;
+    }
+    // The context only places the attachments again if the usages changed, so keep them in a fixed order.
+    std::sort(usages.begin(), usages.end(), [](TransientAttachmentUsage const& a, TransientAttachmentUsage const& b) {
+        return std::tie(a.first_pass, a.name) < std::tie(b.first_pass, b.name);
+    });
+    transient_stats = ctx.alias_transient_attachments(usages);
+    return true;
+}
+
+void RenderGraph::create_aliasing_barriers(std::vector<TransientAttachmentUsage> const& usages) {
+    for (TransientAttachmentUsage const& usage : usages) {
+        if (!usage.aliases) continue;
+        UsageRef const first = resource_table.attachment_usages[resource_table.attachment_ids.at(usage.name)].front();
+        UsageRef const previous = resource_table.attachment_usages[resource_table.attachment_ids.at(usages[*usage.aliases].name)].back();
+        ResourceUsage const& resource = passes[first.pass].resources[first.resource];
+        VkAccessFlags const previous_access = static_cast<VkAccessFlags>(passes[previous.pass].resources[previous.resource].access.value());
+
+        // The first use of an attachment transitions it out of VK_IMAGE_LAYOUT_UNDEFINED after all earlier commands, so that barrier
+        // only has to make the writes to the previous attachment in the same memory available as well.
+        BuiltPass& build = built_passes[first.pass];
+        auto transition = std::find_if(build.pre_barriers.begin(), build.pre_barriers.end(), [&first](Barrier const& barrier) {
+            return barrier.type == BarrierType::Image && barrier.resource == first.resource && barrier.image.oldLayout == VK_IMAGE_LAYOUT_UNDEFINED;
+        });
+        if (transition != build.pre_barriers.end()) {
+            transition->image.srcAccessMask |= previous_access;
+            continue;
+        }
+
+        Barrier barrier;
+        barrier.memory = VkMemoryBarrier{
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = previous_access,
+            .dstAccessMask = static_cast<VkAccessFlags>(resource.access.value())
+        };
+        barrier.type = BarrierType::Memory;
+        barrier.resource = first.resource;
+        barrier.src_stage = PipelineStage::AllCommands;
+        barrier.dst_stage = resource.stage;
+        build.pre_barriers.push_back(barrier);
+    }
+}
+
+// VK_REMAINING_MIP_LEVELS and VK_REMAINING_ARRAY_LAYERS extend the range to the end of the image.
+static bool ranges_overlap(uint32_t base_a, uint32_t count_a, uint32_t base_b, uint32_t count_b) {
+    uint64_t const end_a = count_a == VK_REMAINING_MIP_LEVELS ? UINT64_MAX : uint64_t(base_a) + count_a;
+    uint64_t const end_b = count_b == VK_REMAINING_MIP_LEVELS ? UINT64_MAX : uint64_t(base_b) + count_b;
+    return base_a < end_b && base_b < end_a;
+}
+
+// Image barriers and their synchronization2 variants have the same member names, so the merging code below works with both.
+template<typename T>
+static bool subresources_overlap(T const& a, T const& b) {
+    VkImageSubresourceRange const& ra = a.subresourceRange;
+    VkImageSubresourceRange const& rb = b.subresourceRange;
+    return a.image == b.image && (ra.aspectMask & rb.aspectMask) != 0
+        && ranges_overlap(ra.baseMipLevel, ra.levelCount, rb.baseMipLevel, rb.levelCount)
+        && ranges_overlap(ra.baseArrayLayer, ra.layerCount, rb.baseArrayLayer, rb.layerCount);
+}
+
+template<typename T>
+static bool same_subresource(T const& a, T const& b) {
+    VkImageSubresourceRange const& ra = a.subresourceRange;
+    VkImageSubresourceRange const& rb = b.subresourceRange;
+    return a.image == b.image && a.oldLayout == b.oldLayout && a.newLayout == b.newLayout && ra.aspectMask == rb.aspectMask
+        && ra.baseMipLevel == rb.baseMipLevel && ra.levelCount == rb.levelCount && ra.baseArrayLayer == rb.baseArrayLayer && ra.layerCount == rb.layerCount;
+}
+
+template<typename T>
+static void merge_barrier(T& barrier, T const& other) {
+    barrier.srcAccessMask |= other.srcAccessMask;
+    barrier.dstAccessMask |= other.dstAccessMask;
+    if constexpr (requires { barrier.srcStageMask; }) {
+        barrier.srcStageMask |= other.srcStageMask;
+        barrier.dstStageMask |= other.dstStageMask;
+    }
+}
+
+enum class MergeResult {
+    Added,
+    Merged,
+    // The barrier overlaps a different transition in the batch
+    Conflict
+};
+
+// These set index to the position of the barrier the new one was added as or merged into.
+template<typename T>
+static MergeResult add_image_barrier(std::vector<T>& barriers, T const& barrier, size_t& index) {
+    auto duplicate = std::find_if(barriers.begin(), barriers.end(), [&barrier](T const& other) { return same_subresource(other, barrier); });
+    if (duplicate != barriers.end()) {
+        merge_barrier(*duplicate, barrier);
+        index = duplicate - barriers.begin();
+        return MergeResult::Merged;
+    }
+    if (std::any_of(barriers.begin(), barriers.end(), [&barrier](T const& other) { return subresources_overlap(other, barrier); })) {
+        return MergeResult::Conflict;
+    }
+    index = barriers.size();
+    barriers.push_back(barrier);
+    return MergeResult::Added;
+}
+
+template<typename T>
+static MergeResult add_buffer_barrier(std::vector<T>& barriers, T const& barrier, size_t& index) {
+    auto duplicate = std::find_if(barriers.begin(), barriers.end(), [&barrier](T const& other) {
+        return other.buffer == barrier.buffer && other.offset == barrier.offset && other.size == barrier.size;
+    });
+    if (duplicate != barriers.end()) {
+        merge_barrier(*duplicate, barrier);
+        index = duplicate - barriers.begin();
+        return MergeResult::Merged;
+    }
+    index = barriers.size();
+    barriers.push_back(barrier);
+    return MergeResult::Added;
+}
+
+// Memory barriers cover all resources, so a batch needs at most one.
+template<typename T>
+static MergeResult add_memory_barrier(std::vector<T>& barriers, T const& barrier, size_t& index) {
+    index = 0;
+    if (!barriers.empty()) {
+        merge_barrier(barriers.front(), barrier);
+        return MergeResult::Merged;
+    }
+    barriers.push_back(barrier);
+    return MergeResult::Added;
+}
+
+static VkImageMemoryBarrier2KHR to_barrier2(VkImageMemoryBarrier const& barrier, VkPipelineStageFlags2KHR src_stage, VkPipelineStageFlags2KHR dst_stage) {
+    return VkImageMemoryBarrier2KHR{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR,
+        .pNext = nullptr,
+        .srcStageMask = src_stage,
+        .srcAccessMask = barrier.srcAccessMask,
+        .dstStageMask = dst_stage,
+        .dstAccessMask = barrier.dstAccessMask,
+        .oldLayout = barrier.oldLayout,
+        .newLayout = barrier.newLayout,
+        .srcQueueFamilyIndex = barrier.srcQueueFamilyIndex,
+        .dstQueueFamilyIndex = barrier.dstQueueFamilyIndex,
+        .image = barrier.image,
+        .subresourceRange = barrier.subresourceRange
+    };
+}
+
+static VkBufferMemoryBarrier2KHR to_barrier2(VkBufferMemoryBarrier const& barrier, VkPipelineStageFlags2KHR src_stage, VkPipelineStageFlags2KHR dst_stage) {
+    return VkBufferMemoryBarrier2KHR{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR,
+        .pNext = nullptr,
+        .srcStageMask = src_stage,
+        .srcAccessMask = barrier.srcAccessMask,
+        .dstStageMask = dst_stage,
+        .dstAccessMask = barrier.dstAccessMask,
+        .srcQueueFamilyIndex = barrier.srcQueueFamilyIndex,
+        .dstQueueFamilyIndex = barrier.dstQueueFamilyIndex,
+        .buffer = barrier.buffer,
+        .offset = barrier.offset,
+        .size = barrier.size
+    };
+}
+
+static VkMemoryBarrier2KHR to_barrier2(VkMemoryBarrier const& barrier, VkPipelineStageFlags2KHR src_stage, VkPipelineStageFlags2KHR dst_stage) {
+    return VkMemoryBarrier2KHR{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR,
+        .pNext = nullptr,
+        .srcStageMask = src_stage,
+        .srcAccessMask = barrier.srcAccessMask,
+        .dstStageMask = dst_stage,
+        .dstAccessMask = barrier.dstAccessMask
+    };
+}
+
+void RenderGraph::create_barrier_batches(Context& ctx) {
+    synchronization2 = ctx.synchronization2_enabled();
+    barrier_stats = BarrierStats{};
+    barrier_batches.clear();
+    barrier_batches.resize(passes.size() + 1);
+
+    // Adds the barrier to the last batch of the boundary. Transitions of the same subresource are merged if they are equal,
+    // other overlapping transitions must happen in order and start a new batch.
+    auto add_barrier = [this](std::vector<BarrierBatch>& batches, Barrier& barrier) {
+        barrier_stats.barriers += 1;
+        if (batches.empty()) batches.emplace_back();
+        VkPipelineStageFlags2KHR const src_stage = barrier.src_stage.value();
+        VkPipelineStageFlags2KHR const dst_stage = barrier.dst_stage.value();
+        auto add = [&batches, &barrier](auto member, auto const& value, auto add_to_batch) {
+            size_t index = 0;
+            MergeResult result = add_to_batch(batches.back().*member, value, index);
+            if (result == MergeResult::Conflict) {
+                (batches.emplace_back().*member).push_back(value);
+                index = 0;
+                result = MergeResult::Added;
             }
+            barrier.batch = static_cast<uint32_t>(batches.size() - 1);
+            barrier.batch_index = static_cast<uint32_t>(index);
+            return result;
+        };
 
-            std::vector<VkSubpassDependency> dependencies{};
-            /*
-            for (ResourceUsage const& resource : pass->resources) {
-                if (resource.type != ResourceType::Attachment) continue;
-                if (resource.access != ResourceAccess::ColorAttachmentOutput &&
-                    resource.access != ResourceAccess::DepthStencilAttachmentOutput) continue;
-                Attachment* attachment = ctx.get_attachment(resource.attachment.name);
-
-                auto previous_usage_info = find_previous_usage(ctx, pass, attachment);
-                if (previous_usage_info.second == nullptr) { // Not used earlier, no dependency needed
-                    continue;
-                }
+        MergeResult result = MergeResult::Merged;
+        switch (barrier.type) {
+        case BarrierType::Image:
+            result = synchronization2 ? add(&BarrierBatch::images2, to_barrier2(barrier.image, src_stage, dst_stage), add_image_barrier<VkImageMemoryBarrier2KHR>)
+                                      : add(&BarrierBatch::images, barrier.image, add_image_barrier<VkImageMemoryBarrier>);
+            break;
+        case BarrierType::Buffer:
+            result = synchronization2 ? add(&BarrierBatch::buffers2, to_barrier2(barrier.buffer, src_stage, dst_stage), add_buffer_barrier<VkBufferMemoryBarrier2KHR>)
+                                      : add(&BarrierBatch::buffers, barrier.buffer, add_buffer_barrier<VkBufferMemoryBarrier>);
+            break;
+        case BarrierType::Memory:
+            result = synchronization2 ? add(&BarrierBatch::memory2, to_barrier2(barrier.memory, src_stage, dst_stage), add_memory_barrier<VkMemoryBarrier2KHR>)
+                                      : add(&BarrierBatch::memory, barrier.memory, add_memory_barrier<VkMemoryBarrier>);
+            break;
+        }
+        if (result == MergeResult::Added) {
+            barrier_stats.merged_barriers += 1;
+        }
+        // Without synchronization2, all barriers in a call share the same stage masks.
+        if (!synchronization2) {
+            batches.back().src_stage |= get_legacy_stage_flags(src_stage);
+            batches.back().dst_stage |= get_legacy_stage_flags(dst_stage);
+        }
+    };
 
-                AttachmentUsage previous_usage = get_attachment_usage(previous_usage_info);
+    // Nothing is recorded between the post barriers of a pass and the pre barriers of the next pass, so they form a single boundary.
+    for (size_t i = 0; i < built_passes.size(); ++i) {
+        for (Barrier& barrier : built_passes[i].pre_barriers) { add_barrier(barrier_batches[i], barrier); }
+        for (Barrier& barrier : built_passes[i].post_barriers) { add_barrier(barrier_batches[i + 1], barrier); }
+    }
+    for (std::vector<BarrierBatch> const& batches : barrier_batches) {
+        barrier_stats.barrier_calls += static_cast<uint32_t>(batches.size());
+    }
+}
 
-                VkSubpassDependency dependency{};
-                dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-                dependency.dstSubpass = 0;
-                if (is_depth_format(attachment->view.format)) {
-                    dependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-                }
-                else {
-                    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-                }
-                dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-                dependency.srcAccessMask = previous_usage.access;
-                dependency.srcStageMask = previous_usage.stage;
-                dependencies.push_back(dependency);
+void RenderGraph::get_structure(Context& ctx, GraphStructure& structure) {
+    structure.values.clear();
+    structure.hash = 0;
+    auto add = [&structure](auto... values) {
+        (structure.values.push_back(static_cast<uint64_t>(values)), ...);
+    };
+    // Overwrites the names of the last structure, so their memory is reused.
+    size_t name_count = 0;
+    auto add_name = [&structure, &name_count](std::string_view name) {
+        if (name_count == structure.names.size()) structure.names.emplace_back(name);
+        else structure.names[name_count].assign(name);
+        name_count += 1;
+    };
+    // Which barriers are needed depends on which resources refer to the same image or buffer, not on the handles themselves.
+    // Every image and buffer is stored as the index of its first use in the graph instead.
+    image_indices.clear();
+    buffer_indices.clear();
+    auto get_index = [](auto& indices, auto const& object) -> uint32_t {
+        return indices.try_emplace(object, static_cast<uint32_t>(indices.size())).first->second;
+    };
+    auto is_exported = [this](VkImage image) {
+        return std::find(exported_images.begin(), exported_images.end(), image) != exported_images.end();
+    };
+
+    resolved_views.clear();
+    resolved_view_offsets.clear();
+    add(ctx.dynamic_rendering_enabled(), ctx.imageless_framebuffers_enabled(), ctx.synchronization2_enabled(), passes.size());
+    for (Pass const& pass : passes) {
+        resolved_view_offsets.push_back(resolved_views.size());
+        add_name(pass.name);
+        add(pass.no_renderpass, pass.resources.size());
+        for (ResourceUsage const& resource : pass.resources) {
+            add(resource.type, resource.stage.value(), resource.access.value());
+            if (resource.type == ResourceType::Buffer) {
+                BufferSlice const& slice = resource.buffer.slice;
+                bool const exported = std::any_of(exported_buffers.begin(), exported_buffers.end(), [&slice](BufferSlice const& other) {
+                    return buffers_overlap(slice, other);
+                });
+                add(get_index(buffer_indices, slice), exported);
+                resolved_views.emplace_back();
+                continue;
             }
-            */
-            // Now that we have the dependencies sorted we need to create the VkRenderPass
-            VkRenderPassCreateInfo rpci{};
-            rpci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-            rpci.attachmentCount = attachments.size();
-            rpci.pAttachments = attachments.data();
-            rpci.dependencyCount = dependencies.size();
-            rpci.pDependencies = dependencies.data();
-            rpci.subpassCount = 1;
-            rpci.pSubpasses = &subpass;
-            rpci.pNext = nullptr;
-
-            build.handle = ctx.get_or_create(rpci, "[Renderpass] " + pass->name);
-
-            // Step 2: Create VkFramebuffer for this renderpass
-            VkFramebufferCreateInfo fbci{};
-            fbci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            std::vector<VkImageView> attachment_views{};
-            for (ResourceUsage const& resource : pass->resources) {
-                if (!is_output_attachment(resource)) { continue; }
-                // If custom view was set, use that instead.
-                VkImageView view = resource.attachment.view ? resource.attachment.view.handle : ctx.get_attachment(resource.attachment.name).view.handle;
-                attachment_views.push_back(view);
+
+            ImageView view = resource.image.view;
+            if (resource.type == ResourceType::Attachment) {
+                Attachment const attachment = ctx.get_attachment(resource.attachment.name);
+                assert(attachment && "Invalid attachment name");
+                view = resource.attachment.view ? resource.attachment.view : attachment.view;
+                bool const exported = ctx.is_swapchain_attachment(resource.attachment.name)
+                    || std::find(exported_attachments.begin(), exported_attachments.end(), resource.attachment.name) != exported_attachments.end();
+                // Barriers always cover all layers of the attachment, and the render area is the size of the largest attachment.
+                add_name(resource.attachment.name);
+                add(resource.attachment.load_op, exported, attachment.transient, get_index(image_indices, attachment.view.image),
+                    attachment.view.format, attachment.view.samples, attachment.view.size.width, attachment.view.size.height,
+                    attachment.view.base_layer, attachment.view.layer_count);
+                // Imageless framebuffers are created from the image flags and usage instead of the views.
+                add(attachment.image.has_value(), attachment.image ? attachment.image->flags : 0, attachment.image ? attachment.image->usage : 0);
             }
-            fbci.attachmentCount = attachments.size();
-            fbci.pAttachments = attachment_views.data();
-            fbci.renderPass = build.handle;
-            fbci.layers = 1;
-            fbci.width = 1;
-            fbci.height = 1;
-            // Figure out width and height of the framebuffer. For this we need to find the largest size of all attachments.
-            for (ResourceUsage const& resource : pass->resources) {
-                if (!is_output_attachment(resource)) { continue; }
-                Attachment attachment = ctx.get_attachment(resource.attachment.name);
-                // Note that we can safely use the main ImageView here since all sizes for array layers of an image
-                // must be the same
-                fbci.width = std::max(attachment.view.size.width, fbci.width);
-                fbci.height = std::max(attachment.view.size.height, fbci.height);
+            add(get_index(image_indices, view.image), is_exported(view.image), view.format, view.samples, view.aspect, view.size.width, view.size.height,
+                view.base_level, view.level_count, view.base_layer, view.layer_count);
+            resolved_views.push_back(view);
+        }
+    }
+    structure.names.resize(name_count);
+
+    for (uint64_t value : structure.values) {
+        hash_combine(structure.hash, value);
+    }
+    for (std::string const& name : structure.names) {
+        hash_combine(structure.hash, name);
+    }
+}
+
+void RenderGraph::patch_pass(Context& ctx, uint32_t pass_index, ImageView const* views) {
+    Pass& pass = passes[pass_index];
+    BuiltPass& build = built_passes[pass_index];
+    // The batches of the boundary before and after the pass
+    std::vector<BarrierBatch>& pre_batches = barrier_batches[pass_index];
+    std::vector<BarrierBatch>& post_batches = barrier_batches[pass_index + 1];
+    auto patch = [this, &pass, views](Barrier& barrier, std::vector<BarrierBatch>& batches) {
+        BarrierBatch& batch = batches[barrier.batch];
+        if (barrier.type == BarrierType::Buffer) {
+            BufferSlice const& slice = pass.resources[barrier.resource].buffer.slice;
+            barrier.buffer.buffer = slice.buffer;
+            barrier.buffer.offset = slice.offset;
+            barrier.buffer.size = slice.range;
+            if (synchronization2) {
+                batch.buffers2[barrier.batch_index].buffer = slice.buffer;
+                batch.buffers2[barrier.batch_index].offset = slice.offset;
+                batch.buffers2[barrier.batch_index].size = slice.range;
+            }
+            else {
+                batch.buffers[barrier.batch_index].buffer = slice.buffer;
+                batch.buffers[barrier.batch_index].offset = slice.offset;
+                batch.buffers[barrier.batch_index].size = slice.range;
             }
-            build.render_area = VkExtent2D{ .width = fbci.width, .height = fbci.height };
-            build.framebuf = ctx.get_or_create(fbci, "[Framebuffer] " + pass->name);
         }
-	}
+        else if (barrier.type == BarrierType::Image) {
+            barrier.image.image = views[barrier.resource].image;
+            if (synchronization2) batch.images2[barrier.batch_index].image = barrier.image.image;
+            else batch.images[barrier.batch_index].image = barrier.image.image;
+        }
+    };
+    for (Barrier& barrier : build.pre_barriers) { patch(barrier, pre_batches); }
+    for (Barrier& barrier : build.post_barriers) { patch(barrier, post_batches); }
+
+    if (pass.no_renderpass) return;
+    if (build.dynamic_rendering) {
+        size_t color = 0;
+        for (uint32_t resource : build.attachment_resources) {
+            ImageView const& view = views[resource];
+            VkRenderingAttachmentInfoKHR& info = is_depth_format(view.format) ? *build.depth_attachment : build.color_attachments[color++];
+            info.imageView = view.handle;
+            std::memcpy(&info.clearValue, &pass.resources[resource].attachment.clear, sizeof(VkClearValue));
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < build.attachment_resources.size(); ++i) {
+        build.attachment_views[i] = views[build.attachment_resources[i]].handle;
+    }
+    // Looking the render pass and framebuffer up again keeps the cache from evicting them while the graph is reused.
+    // An imageless framebuffer is found without the views, it gets them when the render pass begins.
+    lookup_render_pass(ctx, pass, build);
+}
+
+void RenderGraph::create_render_pass(Context& ctx, Pass& pass, BuiltPass& build) {
+    // Create attachment references
+    build.color_refs.clear();
+    build.depth_ref = std::nullopt;
+    build.attachment_resources.clear();
+    build.attachment_views.clear();
+    // For an imageless framebuffer, the views are described by their format, usage and size only.
+    build.image_infos.clear();
+    build.view_formats.clear();
+    build.render_area = VkExtent2D{ .width = 1, .height = 1 };
+    for (ResourceUsage const& resource : pass.resources) {
+        // Skip non-attachment resources
+        if (!is_output_attachment(resource)) continue;
+
+        Attachment const& attachment = get_attachment(resource.attachment.name);
+        // If a view is set, use that instead of the default ImageView.
+        ImageView view = resource.attachment.view ? resource.attachment.view : attachment.view;
+        VkAttachmentReference ref{};
+        ref.attachment = build.attachment_views.size();
+        if (is_depth_format(view.format)) {
+            ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+            build.depth_ref = ref;
+        }
+        else {
+            // If an attachment is not a depth attachment, it's a color attachment
+            ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            build.color_refs.push_back(ref);
+        }
+        build.attachment_resources.push_back(static_cast<uint32_t>(&resource - pass.resources.data()));
+        build.attachment_views.push_back(view.handle);
+
+        build.view_formats.push_back(view.format);
+        build.image_infos.push_back(VkFramebufferAttachmentImageInfo{
+            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_ATTACHMENT_IMAGE_INFO,
+            .pNext = nullptr,
+            // Only the swapchain attachment has no image. Swapchain images are created with just the color attachment usage.
+            .flags = attachment.image ? attachment.image->flags : VkImageCreateFlags{},
+            .usage = attachment.image ? attachment.image->usage : VkImageUsageFlags{ VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT },
+            .width = view.size.width,
+            .height = view.size.height,
+            .layerCount = std::max(view.layer_count, 1u),
+            .viewFormatCount = 1,
+            // Set by lookup_render_pass(), view_formats may still grow
+            .pViewFormats = nullptr
+        });
+
+        // The framebuffer is as large as the largest attachment. Note that we can safely use the main ImageView here since all sizes 
+        // for array layers of an image must be the same
+        build.render_area.width = std::max(attachment.view.size.width, build.render_area.width);
+        build.render_area.height = std::max(attachment.view.size.height, build.render_area.height);
+    }
+    build.imageless = ctx.imageless_framebuffers_enabled();
+    lookup_render_pass(ctx, pass, build);
+}
+
+void RenderGraph::lookup_render_pass(Context& ctx, Pass const& pass, BuiltPass& build) {
+    // Create subpass description
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = build.color_refs.size();
+    subpass.pColorAttachments = build.color_refs.data();
+    if (build.depth_ref != std::nullopt) {
+        subpass.pDepthStencilAttachment = &*build.depth_ref;
+    }
+
+    std::vector<VkSubpassDependency> dependencies{};
+    /*
+    for (ResourceUsage const& resource : pass.resources) {
+        if (resource.type != ResourceType::Attachment) continue;
+        if (resource.access != ResourceAccess::ColorAttachmentOutput &&
+            resource.access != ResourceAccess::DepthStencilAttachmentOutput) continue;
+        Attachment* attachment = ctx.get_attachment(resource.attachment.name);
+
+        auto previous_usage_info = find_previous_usage(ctx, pass, attachment);
+        if (previous_usage_info.second == nullptr) { // Not used earlier, no dependency needed
+            continue;
+        }
+
+        AttachmentUsage previous_usage = get_attachment_usage(previous_usage_info);
+
+        VkSubpassDependency dependency{};
+        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependency.dstSubpass = 0;
+        if (is_depth_format(attachment->view.format)) {
+            dependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        }
+        else {
+            dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        }
+        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependency.srcAccessMask = previous_usage.access;
+        dependency.srcStageMask = previous_usage.stage;
+        dependencies.push_back(dependency);
+    }
+    */
+    // Now that we have the dependencies sorted we need to create the VkRenderPass
+    VkRenderPassCreateInfo rpci{};
+    rpci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    rpci.attachmentCount = build.attachments.size();
+    rpci.pAttachments = build.attachments.data();
+    rpci.dependencyCount = dependencies.size();
+    rpci.pDependencies = dependencies.data();
+    rpci.subpassCount = 1;
+    rpci.pSubpasses = &subpass;
+    rpci.pNext = nullptr;
+
+    build.handle = ctx.get_or_create(rpci, "[Renderpass] " + pass.name);
+
+    // Step 2: Create VkFramebuffer for this renderpass
+    VkFramebufferCreateInfo fbci{};
+    fbci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    for (size_t i = 0; i < build.image_infos.size(); ++i) {
+        build.image_infos[i].pViewFormats = &build.view_formats[i];
+    }
+    VkFramebufferAttachmentsCreateInfo attachments_info{
+        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_ATTACHMENTS_CREATE_INFO,
+        .pNext = nullptr,
+        .attachmentImageInfoCount = (uint32_t)build.image_infos.size(),
+        .pAttachmentImageInfos = build.image_infos.data()
+    };
+    fbci.attachmentCount = build.attachments.size();
+    if (build.imageless) {
+        // The framebuffer no longer depends on the views, so the same framebuffer is used for every swapchain image
+        // and after attachments are recreated with the same size.
+        fbci.flags = VK_FRAMEBUFFER_CREATE_IMAGELESS_BIT;
+        fbci.pNext = &attachments_info;
+        fbci.pAttachments = nullptr;
+    }
+    else {
+        fbci.pAttachments = build.attachment_views.data();
+    }
+    fbci.renderPass = build.handle;
+    fbci.layers = 1;
+    fbci.width = build.render_area.width;
+    fbci.height = build.render_area.height;
+    build.framebuf = ctx.get_or_create(fbci, "[Framebuffer] " + pass.name);
+}
+
+void RenderGraph::build_rendering_pass(Context& ctx, Pass& pass, BuiltPass& result) {
+    result.dynamic_rendering = true;
+    result.attachment_resources.clear();
+    result.color_attachments.clear();
+    result.depth_attachment = std::nullopt;
+    result.formats = RenderingFormats{};
+    result.render_area = VkExtent2D{ .width = 1, .height = 1 };
+    for (ResourceUsage const& resource : pass.resources) {
+        if (!is_output_attachment(resource)) { continue; }
+        Attachment const& attachment = get_attachment(resource.attachment.name);
+        assert(attachment && "Invalid attachment name");
+        // If a view is set, use that instead of the default ImageView.
+        ImageView view = resource.attachment.view ? resource.attachment.view : attachment.view;
+        result.attachment_resources.push_back(static_cast<uint32_t>(&resource - pass.resources.data()));
+
+        VkClearValue clear{};
+        static_assert(sizeof(VkClearValue) == sizeof(ph::ClearValue));
+        std::memcpy(&clear, &resource.attachment.clear, sizeof(VkClearValue));
+        VkRenderingAttachmentInfoKHR info{
+            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+            .pNext = nullptr,
+            .imageView = view.handle,
+            .imageLayout = get_output_layout_for_format(view.format),
+            .resolveMode = VK_RESOLVE_MODE_NONE,
+            .resolveImageView = nullptr,
+            .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .loadOp = static_cast<VkAttachmentLoadOp>(resource.attachment.load_op),
+            .storeOp = store_ops[&pass - passes.data()][&resource - pass.resources.data()],
+            .clearValue = clear
+        };
+        if (is_depth_format(view.format)) {
+            result.depth_attachment = info;
+            result.formats.depth_format = view.format;
+        }
+        else {
+            result.color_attachments.push_back(info);
+            result.formats.color_formats.push_back(view.format);
+        }
+
+        // All array layers of an image have the same size, so the main ImageView can be used here.
+        result.render_area.width = std::max(attachment.view.size.width, result.render_area.width);
+        result.render_area.height = std::max(attachment.view.size.height, result.render_area.height);
+    }
+}
+
+void RenderGraph::create_rendering_barriers(Context& ctx, Pass& pass, BuiltPass& result) {
+    for (ResourceUsage const& resource : pass.resources) {
+        if (!is_output_attachment(resource)) { continue; }
+        uint32_t const resource_index = static_cast<uint32_t>(&resource - pass.resources.data());
+        Attachment const& attachment = get_attachment(resource.attachment.name);
+        ImageView view = resource.attachment.view ? resource.attachment.view : attachment.view;
+        VkImageLayout const layout = get_output_layout_for_format(view.format);
+        plib::bit_flag<PipelineStage> const stage = get_attachment_stage(view.format);
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.pNext = nullptr;
+        barrier.image = view.image;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = static_cast<VkImageAspectFlags>(view.aspect);
+        barrier.subresourceRange.baseMipLevel = view.base_level;
+        barrier.subresourceRange.levelCount = view.level_count;
+        barrier.subresourceRange.baseArrayLayer = attachment.view.base_layer;
+        barrier.subresourceRange.layerCount = attachment.view.layer_count;
+
+        // Replaces the initialLayout transition. If the image was not used earlier in the graph,
+        // create_pass_barriers() already inserted a transition out of VK_IMAGE_LAYOUT_UNDEFINED.
+        auto previous_usage_info = find_previous_usage(ctx, &pass, &view);
+        if (was_used(previous_usage_info)) {
+            barrier.oldLayout = get_initial_layout(ctx, &pass, resource);
+            barrier.newLayout = layout;
+            barrier.srcAccessMask = static_cast<VkAccessFlags>(previous_usage_info.first.access.value());
+            barrier.dstAccessMask = static_cast<VkAccessFlags>(resource.access.value());
+            if (resource.attachment.load_op == LoadOp::Load) {
+                barrier.dstAccessMask |= is_depth_format(view.format) ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT : VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+            }
+
+            Barrier final_barrier;
+            final_barrier.image = barrier;
+            final_barrier.type = BarrierType::Image;
+            final_barrier.resource = resource_index;
+            final_barrier.src_stage = is_output_attachment(previous_usage_info.first) ? get_attachment_stage(view.format) : previous_usage_info.first.stage;
+            final_barrier.dst_stage = stage;
+            result.pre_barriers.push_back(final_barrier);
+        }
+
+        // Replaces the finalLayout transition, which only differs from the attachment layout for presenting.
+        VkImageLayout const final_layout = get_final_layout(ctx, &pass, resource);
+        if (final_layout != layout) {
+            barrier.oldLayout = layout;
+            barrier.newLayout = final_layout;
+            barrier.srcAccessMask = static_cast<VkAccessFlags>(resource.access.value());
+            barrier.dstAccessMask = {};
+
+            Barrier final_barrier;
+            final_barrier.image = barrier;
+            final_barrier.type = BarrierType::Image;
+            final_barrier.resource = resource_index;
+            final_barrier.src_stage = stage;
+            final_barrier.dst_stage = PipelineStage::BottomOfPipe;
+            result.post_barriers.push_back(final_barrier);
+        }
+    }
 }
 
 std::vector<VkAttachmentDescription> RenderGraph::get_attachment_descriptions(Context& ctx, Pass* pass) {
@@ -144,13 +883,13 @@ std::vector<VkAttachmentDescription> RenderGraph::get_attachment_descriptions(Co
 	for (ResourceUsage const& resource : pass->resources) {
         if (!is_output_attachment(resource)) { continue; }
 		VkAttachmentDescription description{};
-		Attachment attachment = ctx.get_attachment(resource.attachment.name);
+		Attachment const& attachment = get_attachment(resource.attachment.name);
 		assert(attachment && "Invalid attachment name");
 
 		description.format = attachment.view.format;
 		description.samples = attachment.view.samples;
 		description.loadOp = static_cast<VkAttachmentLoadOp>(resource.attachment.load_op);
-		description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		description.storeOp = store_ops[pass - passes.data()][&resource - pass->resources.data()];
 		// Stencil operations are currently not supported
 		description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -162,16 +901,6 @@ std::vector<VkAttachmentDescription> RenderGraph::get_attachment_descriptions(Co
 	return attachments;
 }
 
-static VkImageLayout get_output_layout_for_format(VkFormat format) {
-    if (is_depth_format(format)) { return VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL; }
-
-    return VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-}
-
-static bool was_used(std::pair<ResourceUsage, Pass*> const& usage) {
-    return usage.second != nullptr;
-}
-
 VkImageLayout RenderGraph::get_initial_layout(Context& ctx, Pass* pass, ResourceUsage const& resource) {
     // We need to find the most recent usage of this attachment as an output attachment and set the initial layout accordingly
   
@@ -214,7 +943,7 @@ VkImageLayout RenderGraph::get_final_layout(Context& ctx, Pass* pass, ResourceUs
     // Note that 'later used' in this case only means the NEXT usage of this attachment. Any further usage can be taken care of by
     // further renderpasses
 
-    Attachment att = ctx.get_attachment(resource.attachment.name);
+    Attachment const& att = get_attachment(resource.attachment.name);
     auto next_usage_info = find_next_usage(ctx, pass, resource.attachment.name);
 
     if (!was_used(next_usage_info)) {
@@ -248,165 +977,120 @@ VkImageLayout RenderGraph::get_final_layout(Context& ctx, Pass* pass, ResourceUs
     throw std::runtime_error("Invalid resource access");
 }
 
-std::pair<ResourceUsage, Pass*> RenderGraph::find_previous_usage(Context& ctx, Pass* current_pass, std::string_view attachment) {
-    // First pass isn't used earlier
-    if (current_pass == &passes.front()) {
-        return {};
-    }
-
-    // Go over each earlier pass
-    for (Pass* pass = current_pass - 1; pass >= &passes.front(); --pass) {
-        // Look in this pass's resources
-        auto find_resource = [&ctx, attachment](ph::ResourceUsage const& resource) {
-            if (resource.type != ResourceType::Attachment) return false;
-            // Since views are no longer always equal we compare by name.
-            return attachment == resource.attachment.name;
-        };
+void RenderGraph::create_resource_table(Context& ctx) {
+    ResourceTable& table = resource_table;
+    table.attachment_ids.clear();
+    table.image_ids.clear();
+    table.buffer_ids.clear();
+    table.attachments.clear();
+    table.attachment_usages.clear();
+    table.image_usages.clear();
+    table.buffer_usages.clear();
+
+    // Returns the timeline of the object, adding it if this is its first usage.
+    auto get_timeline = [](auto& ids, auto const& key, std::vector<std::vector<UsageRef>>& timelines) -> std::vector<UsageRef>& {
+        auto [it, added] = ids.try_emplace(key, static_cast<uint32_t>(timelines.size()));
+        if (added) timelines.emplace_back();
+        return timelines[it->second];
+    };
+
+    for (uint32_t pass = 0; pass < passes.size(); ++pass) {
+        for (uint32_t index = 0; index < passes[pass].resources.size(); ++index) {
+            ResourceUsage const& resource = passes[pass].resources[index];
+            UsageRef const usage{ .pass = pass, .resource = index };
+            if (resource.type == ResourceType::Buffer) {
+                get_timeline(table.buffer_ids, resource.buffer.slice, table.buffer_usages).push_back(usage);
+                continue;
+            }
 
-        auto usage = std::find_if(pass->resources.begin(), pass->resources.end(), find_resource);
-        if (usage != pass->resources.end()) {
-            return { *usage, pass };
+            VkImage image = resource.image.view.image;
+            if (resource.type == ResourceType::Attachment) {
+                auto [it, added] = table.attachment_ids.try_emplace(resource.attachment.name, static_cast<uint32_t>(table.attachments.size()));
+                if (added) {
+                    table.attachments.push_back(ctx.get_attachment(resource.attachment.name));
+                    assert(table.attachments.back() && "Invalid attachment name");
+                    table.attachment_usages.emplace_back();
+                }
+                table.attachment_usages[it->second].push_back(usage);
+                // Barriers are matched on the image of the attachment, even if this usage has a custom view.
+                image = table.attachments[it->second].view.image;
+            }
+            get_timeline(table.image_ids, image, table.image_usages).push_back(usage);
         }
     }
-    // Not used in an earlier pass. Return empty ResourceUsage
-    return {};
 }
 
-std::pair<ResourceUsage, Pass*> RenderGraph::find_next_usage(Context& ctx, Pass* current_pass, std::string_view attachment) {
-    // Last pass isn't used later
-    if (current_pass == &passes.back()) {
-        return {};
-    }
+Attachment const& RenderGraph::get_attachment(std::string_view name) const {
+    return resource_table.attachments[resource_table.attachment_ids.at(name)];
+}
 
-    // Go over each later pass
-    for (Pass* pass = current_pass + 1; pass <= &passes.back(); ++pass) {
+ImageView RenderGraph::get_resource_view(ResourceUsage const& resource) const {
+    if (resource.type == ResourceType::Attachment) {
+        return resource.attachment.view ? resource.attachment.view : get_attachment(resource.attachment.name).view;
+    }
+    return resource.image.view;
+}
 
-        auto find_resource = [&ctx, attachment](ph::ResourceUsage const& resource) {
-            if (resource.type != ResourceType::Attachment) return false;
-            return attachment == resource.attachment.name;
-        };
+std::pair<ResourceUsage, Pass*> RenderGraph::get_previous_usage(std::vector<UsageRef> const& timeline, Pass* current_pass) {
+    uint32_t const current = static_cast<uint32_t>(current_pass - passes.data());
+    auto it = std::lower_bound(timeline.begin(), timeline.end(), current, [](UsageRef const& usage, uint32_t pass) {
+        return usage.pass < pass;
+    });
+    // Not used in an earlier pass. Return empty ResourceUsage
+    if (it == timeline.begin()) return {};
+
+    // If the previous pass uses the resource more than once, the first usage is returned.
+    uint32_t const previous = std::prev(it)->pass;
+    it = std::lower_bound(timeline.begin(), it, previous, [](UsageRef const& usage, uint32_t pass) {
+        return usage.pass < pass;
+    });
+    return { passes[it->pass].resources[it->resource], &passes[it->pass] };
+}
 
-        auto usage = std::find_if(pass->resources.begin(), pass->resources.end(), find_resource);
-        if (usage != pass->resources.end()) {
-            return { *usage, pass };
-        }
-    }
+std::pair<ResourceUsage, Pass*> RenderGraph::get_next_usage(std::vector<UsageRef> const& timeline, Pass* current_pass) {
+    uint32_t const current = static_cast<uint32_t>(current_pass - passes.data());
+    auto it = std::upper_bound(timeline.begin(), timeline.end(), current, [](uint32_t pass, UsageRef const& usage) {
+        return pass < usage.pass;
+    });
     // Not used in a later pass. Return empty ResourceUsage
-    return {};
+    if (it == timeline.end()) return {};
+    return { passes[it->pass].resources[it->resource], &passes[it->pass] };
 }
 
-std::pair<ResourceUsage, Pass*> RenderGraph::find_previous_usage(Pass* current_pass, BufferSlice const* buffer) {
-    // First pass isn't used earlier
-    if (current_pass == &passes.front()) {
-        return {};
-    }
+std::pair<ResourceUsage, Pass*> RenderGraph::find_previous_usage(Context& ctx, Pass* current_pass, std::string_view attachment) {
+    auto it = resource_table.attachment_ids.find(attachment);
+    if (it == resource_table.attachment_ids.end()) return {};
+    return get_previous_usage(resource_table.attachment_usages[it->second], current_pass);
+}
 
-    // Go over each earlier pass
-    for (Pass* pass = current_pass - 1; pass >= &passes.front(); --pass) {
-        // Look in this pass's resources
-        auto find_resource = [buffer](ph::ResourceUsage const& resource) {
-            if (resource.type != ResourceType::Buffer) return false;
-            return *buffer == resource.buffer.slice;
-        };
+std::pair<ResourceUsage, Pass*> RenderGraph::find_next_usage(Context& ctx, Pass* current_pass, std::string_view attachment) {
+    auto it = resource_table.attachment_ids.find(attachment);
+    if (it == resource_table.attachment_ids.end()) return {};
+    return get_next_usage(resource_table.attachment_usages[it->second], current_pass);
+}
 
-        auto usage = std::find_if(pass->resources.begin(), pass->resources.end(), find_resource);
-        if (usage != pass->resources.end()) {
-            return { *usage, pass };
-        }
-    }
-    // Not used in an earlier pass. Return empty ResourceUsage
-    return {};
+std::pair<ResourceUsage, Pass*> RenderGraph::find_previous_usage(Pass* current_pass, BufferSlice const* buffer) {
+    auto it = resource_table.buffer_ids.find(*buffer);
+    if (it == resource_table.buffer_ids.end()) return {};
+    return get_previous_usage(resource_table.buffer_usages[it->second], current_pass);
 }
 
 std::pair<ResourceUsage, Pass*> RenderGraph::find_next_usage(Pass* current_pass, BufferSlice const* buffer) {
-    // Last pass isn't used later
-    if (current_pass == &passes.back()) {
-        return {};
-    }
-
-    // Go over each later pass
-    for (Pass* pass = current_pass + 1; pass <= &passes.back(); ++pass) {
-        // Look in this pass's resources
-        auto find_resource = [buffer](ph::ResourceUsage const& resource) {
-            if (resource.type != ResourceType::Buffer) return false;
-            return *buffer == resource.buffer.slice;
-        };
-
-        auto usage = std::find_if(pass->resources.begin(), pass->resources.end(), find_resource);
-        if (usage != pass->resources.end()) {
-            return { *usage, pass };
-        }
-    }
-    // Not used in a later pass. Return empty ResourceUsage
-    return {};
+    auto it = resource_table.buffer_ids.find(*buffer);
+    if (it == resource_table.buffer_ids.end()) return {};
+    return get_next_usage(resource_table.buffer_usages[it->second], current_pass);
 }
 
 std::pair<ResourceUsage, Pass*> RenderGraph::find_previous_usage(Context& ctx, Pass* current_pass, ImageView const* image) {
-    // First pass isn't used earlier
-    if (current_pass == &passes.front()) {
-        return {};
-    }
-
-    // Go over each earlier pass
-    for (Pass* pass = current_pass - 1; pass >= &passes.front(); --pass) {
-        auto find_resource = [image, &ctx](ph::ResourceUsage const& resource) {
-            if (resource.type == ResourceType::Attachment) {
-                // If views are equal, we classify this as found
-                // Else, if there is an image and image handles are equal, we found one.
-                // Otherwise, we didn't find anything.
-                Attachment attachment = ctx.get_attachment(resource.attachment.name);
-                if (image->handle == attachment.view.handle) return true;
-                else if (attachment.image && image->image == attachment.image->handle) return true;
-                else return false;
-            }
-            if (resource.type != ResourceType::Image && resource.type != ResourceType::StorageImage) return false;
-            // Same explanation as above inside the Attachment case
-            if (image->handle == resource.image.view.handle) return true;
-            else if (image->image == resource.image.view.image) return true;
-            else return false;
-        };
-
-        auto usage = std::find_if(pass->resources.begin(), pass->resources.end(), find_resource);
-        if (usage != pass->resources.end()) {
-            return { *usage, pass };
-        }
-    }
-    // Not used in an earlier pass. Return empty ResourceUsage
-    return {};
+    auto it = resource_table.image_ids.find(image->image);
+    if (it == resource_table.image_ids.end()) return {};
+    return get_previous_usage(resource_table.image_usages[it->second], current_pass);
 }
 
 std::pair<ResourceUsage, Pass*> RenderGraph::find_next_usage(Context& ctx, Pass* current_pass, ImageView const* image) {
-    // Last pass isn't used later
-    if (current_pass == &passes.back()) {
-        return {};
-    }
-
-    // Go over each later pass
-    for (Pass* pass = current_pass + 1; pass <= &passes.back(); ++pass) {
-        auto find_resource = [image, &ctx](ph::ResourceUsage const& resource) {
-            if (resource.type == ResourceType::Attachment) {
-                // If views are equal, we classify this as found
-                // Else, if there is an image and image handles are equal, we found one.
-                // Otherwise, we didn't find anything.
-                Attachment attachment = ctx.get_attachment(resource.attachment.name);
-                if (image->handle == attachment.view.handle) return true;
-                else if (attachment.image && image->image == attachment.image->handle) return true;
-                else return false;
-            }
-            if (resource.type != ResourceType::Image && resource.type != ResourceType::StorageImage) return false;
-            // Same explanation as above inside the Attachment case
-            if (image->handle == resource.image.view.handle) return true;
-            else if (image->image == resource.image.view.image) return true;
-            else return false;
-        };
-
-        auto usage = std::find_if(pass->resources.begin(), pass->resources.end(), find_resource);
-        if (usage != pass->resources.end()) {
-            return { *usage, pass };
-        }
-    }
-    // Not used in a later pass. Return empty ResourceUsage
-    return {};
+    auto it = resource_table.image_ids.find(image->image);
+    if (it == resource_table.image_ids.end()) return {};
+    return get_next_usage(resource_table.image_usages[it->second], current_pass);
 }
 
 RenderGraph::AttachmentUsage RenderGraph::get_attachment_usage(std::pair<ResourceUsage, Pass*> const& res_usage) {
@@ -414,14 +1098,14 @@ RenderGraph::AttachmentUsage RenderGraph::get_attachment_usage(std::pair<Resourc
     auto const& pass = res_usage.second;
     if (usage.access == ResourceAccess::ShaderRead) {
         return AttachmentUsage{
-            .stage = static_cast<VkPipelineStageFlags>(usage.stage.value()),
+            .stage = get_legacy_stage_flags(usage.stage.value()),
             .access = static_cast<VkAccessFlags>(usage.access.value()),
             .pass = pass
         };
     }
     if (usage.access == ResourceAccess::ColorAttachmentOutput || usage.access == ResourceAccess::DepthStencilAttachmentOutput) {
         return AttachmentUsage{
-            .stage = static_cast<VkPipelineStageFlags>(usage.stage.value()),
+            .stage = get_legacy_stage_flags(usage.stage.value()),
             .access = static_cast<VkAccessFlags>(usage.access.value()),
             .pass = pass
         };
@@ -433,6 +1117,7 @@ void RenderGraph::create_pass_barriers(Context& ctx, Pass& pass, BuiltPass& resu
     // We go over this pass's resources and look for buffers, find their next usage and insert barriers where necessary.
     // Note that we don't have to look at the previous usage, since there will already be a barrier inserted.
     for (ResourceUsage const& resource : pass.resources) {
+        uint32_t const resource_index = static_cast<uint32_t>(&resource - pass.resources.data());
         if (resource.type == ResourceType::Buffer) {
             ph::BufferSlice const* buffer = &resource.buffer.slice;
             auto next_usage = find_next_usage(&pass, buffer);
@@ -468,6 +1153,7 @@ void RenderGraph::create_pass_barriers(Context& ctx, Pass& pass, BuiltPass& resu
                     Barrier final_barrier;
                     final_barrier.buffer = barrier;
                     final_barrier.type = BarrierType::Buffer;
+                    final_barrier.resource = resource_index;
                     final_barrier.src_stage = resource.stage;
                     final_barrier.dst_stage = next.stage;
                     result.post_barriers.push_back(final_barrier);
@@ -504,6 +1190,7 @@ void RenderGraph::create_pass_barriers(Context& ctx, Pass& pass, BuiltPass& resu
                 Barrier final_barrier;
                 final_barrier.image = barrier;
                 final_barrier.type = BarrierType::Image;
+                final_barrier.resource = resource_index;
                 final_barrier.src_stage = ph::PipelineStage::AllCommands;
                 final_barrier.dst_stage = resource.stage;
                 // Note that this is a PRE barrier!
@@ -530,7 +1217,7 @@ void RenderGraph::create_pass_barriers(Context& ctx, Pass& pass, BuiltPass& resu
                 if (resource.type == ResourceType::StorageImage) { barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL; }
                 else if (resource.type == ResourceType::Image) { barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; }
                 else if (resource.type == ResourceType::Attachment) { 
-                    Attachment att = ctx.get_attachment(resource.attachment.name);
+                    Attachment const& att = get_attachment(resource.attachment.name);
                     if (is_depth_format(att.view.format)) {
                         barrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
                     }
@@ -582,6 +1269,7 @@ void RenderGraph::create_pass_barriers(Context& ctx, Pass& pass, BuiltPass& resu
                     Barrier final_barrier;
                     final_barrier.image = barrier;
                     final_barrier.type = BarrierType::Image;
+                    final_barrier.resource = resource_index;
                     final_barrier.src_stage = resource.stage;
                     final_barrier.dst_stage = next.stage;
                     result.post_barriers.push_back(final_barrier);
@@ -590,7 +1278,7 @@ void RenderGraph::create_pass_barriers(Context& ctx, Pass& pass, BuiltPass& resu
         }
 
         if (resource.type == ResourceType::Attachment) {
-            Attachment attachment = ctx.get_attachment(resource.attachment.name);
+            Attachment const& attachment = get_attachment(resource.attachment.name);
             ph::ImageView view = resource.attachment.view ? resource.attachment.view : attachment.view;
 
             // If there is no previous usage, we will insert an additional barrier to ensure the proper layout is used at the beginning of the frame
@@ -624,6 +1312,7 @@ void RenderGraph::create_pass_barriers(Context& ctx, Pass& pass, BuiltPass& resu
                     Barrier final_barrier;
                     final_barrier.image = barrier;
                     final_barrier.type = BarrierType::Image;
+                    final_barrier.resource = resource_index;
                     final_barrier.src_stage = ph::PipelineStage::AllCommands;
                     if (resource.access == ResourceAccess::ColorAttachmentOutput) {
                         final_barrier.dst_stage = ph::PipelineStage::AttachmentOutput;
@@ -696,6 +1385,7 @@ void RenderGraph::create_pass_barriers(Context& ctx, Pass& pass, BuiltPass& resu
                     Barrier final_barrier;
                     final_barrier.image = barrier;
                     final_barrier.type = BarrierType::Image;
+                    final_barrier.resource = resource_index;
                     if (resource.access == ResourceAccess::ColorAttachmentOutput) {
                         final_barrier.src_stage = ph::PipelineStage::AttachmentOutput;
                     }
@@ -710,24 +1400,35 @@ void RenderGraph::create_pass_barriers(Context& ctx, Pass& pass, BuiltPass& resu
     }
 }
 
+void RenderGraphExecutor::record_barriers(ph::CommandBuffer& cmd_buf, RenderGraph const& graph, std::vector<RenderGraph::BarrierBatch> const& batches) {
+    for (RenderGraph::BarrierBatch const& batch : batches) {
+        if (graph.synchronization2) {
+            VkDependencyInfoKHR dependency{
+                .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR,
+                .pNext = nullptr,
+                .dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT,
+                .memoryBarrierCount = (uint32_t)batch.memory2.size(),
+                .pMemoryBarriers = batch.memory2.data(),
+                .bufferMemoryBarrierCount = (uint32_t)batch.buffers2.size(),
+                .pBufferMemoryBarriers = batch.buffers2.data(),
+                .imageMemoryBarrierCount = (uint32_t)batch.images2.size(),
+                .pImageMemoryBarriers = batch.images2.data()
+            };
+            cmd_buf.barriers(dependency);
+        }
+        else {
+            cmd_buf.barriers(plib::bit_flag<PipelineStage>{ static_cast<PipelineStage>(batch.src_stage) }, plib::bit_flag<PipelineStage>{ static_cast<PipelineStage>(batch.dst_stage) },
+                batch.memory, batch.buffers, batch.images);
+        }
+    }
+}
+
 void RenderGraphExecutor::execute(ph::CommandBuffer& cmd_buf, RenderGraph& graph) {
     for (size_t i = 0; i < graph.passes.size(); ++i) { 
         Pass& pass = graph.passes[i];
         RenderGraph::BuiltPass& build = graph.built_passes[i];
-        // Before the pass begins we execute all pre barriers
-        for (auto const& barrier : build.pre_barriers) {
-            switch (barrier.type) {
-            case RenderGraph::BarrierType::Buffer:
-                cmd_buf.barrier(barrier.src_stage, barrier.dst_stage, barrier.buffer);
-                break;
-            case RenderGraph::BarrierType::Image:
-                cmd_buf.barrier(barrier.src_stage, barrier.dst_stage, barrier.image);
-                break;
-            case RenderGraph::BarrierType::Memory:
-                cmd_buf.barrier(barrier.src_stage, barrier.dst_stage, barrier.memory);
-                break;
-            }
-        }
+        // Before the pass begins we execute all barriers between the previous pass and this one
+        record_barriers(cmd_buf, graph, graph.barrier_batches[i]);
         if (build.handle) {
             VkRenderPassBeginInfo pass_begin_info{};
             pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -747,30 +1448,46 @@ void RenderGraphExecutor::execute(ph::CommandBuffer& cmd_buf, RenderGraph& graph
             }
             pass_begin_info.clearValueCount = clear_values.size();
             pass_begin_info.pClearValues = clear_values.data();
+            VkRenderPassAttachmentBeginInfo attachment_begin_info{
+                .sType = VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO,
+                .pNext = nullptr,
+                .attachmentCount = (uint32_t)build.attachment_views.size(),
+                .pAttachments = build.attachment_views.data()
+            };
+            // Imageless framebuffers get their views when the render pass begins
+            if (build.imageless) {
+                pass_begin_info.pNext = &attachment_begin_info;
+            }
 
             cmd_buf.begin_renderpass(pass_begin_info);
         }
+        else if (build.dynamic_rendering) {
+            VkRenderingInfoKHR rendering_info{
+                .sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+                .pNext = nullptr,
+                .flags = {},
+                .renderArea = VkRect2D{ .offset = VkOffset2D{ .x = 0, .y = 0 }, .extent = build.render_area },
+                .layerCount = 1,
+                .viewMask = 0,
+                .colorAttachmentCount = (uint32_t)build.color_attachments.size(),
+                .pColorAttachments = build.color_attachments.data(),
+                .pDepthAttachment = build.depth_attachment ? &*build.depth_attachment : nullptr,
+                .pStencilAttachment = nullptr
+            };
+            cmd_buf.begin_rendering(rendering_info, build.formats);
+        }
         if (pass.execute != nullptr) {
             pass.execute(cmd_buf);
         }
         if (build.handle) {
             cmd_buf.end_renderpass();
         }
-        // Once the execution and optionally renderpass is complete we add all barriers.
-        for (auto const& barrier : build.post_barriers) {
-            switch (barrier.type) {
-            case RenderGraph::BarrierType::Buffer:
-                cmd_buf.barrier(barrier.src_stage, barrier.dst_stage, barrier.buffer);
-                break;
-            case RenderGraph::BarrierType::Image:
-                cmd_buf.barrier(barrier.src_stage, barrier.dst_stage, barrier.image);
-                break;
-            case RenderGraph::BarrierType::Memory:
-                cmd_buf.barrier(barrier.src_stage, barrier.dst_stage, barrier.memory);
-                break;
-            }
+        else if (build.dynamic_rendering) {
+            cmd_buf.end_rendering();
         }
 	}
+    // The post barriers of the last pass
+    record_barriers(cmd_buf, graph, graph.barrier_batches.back());
 }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,224 @@
+// Cache micro-benchmark.
+// Compares ph::Cache with the cache phobos used before it, which was an std::unordered_map keyed on the hash of the key.
+// For shader handle keys (a small integer id) and framebuffer keys it measures:
+//  - insert: nanoseconds per inserted key.
+//  - lookup: nanoseconds per get() of a key that is in the cache.
+//  - frame: microseconds per frame to look up a working set of an eighth of the keys and then run the per-frame
+//    aging and eviction. Entries are never old enough to be evicted, so this is the cost of tracking their age.
+// Does not need a GPU.
+
+#include <phobos/cache.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace legacy {
+
+// The cache phobos used before ph::Cache, without the functions the benchmark
+// does not use. Entries are keyed on the hash only.
+template <typename Key, typename Value> class Cache {
+private:
+  struct Entry {
+    Value data{};
+    Key key{};
+    mutable size_t frames_since_last_usage = 0;
+    mutable bool used_this_frame = false;
+  };
+
+public:
+  Cache(uint32_t max_frames = 0) {
+    mutex = std::make_unique<std::mutex>();
+    this->max_frames = max_frames;
+  }
+
+  template <typename F> void foreach_unused(F &&func) {
+    std::lock_guard lock(*mutex);
+    for (auto &[_, val] : cache) {
+      if (val.frames_since_last_usage > max_frames) {
+        func(val.data);
+      }
+    }
+  }
+
+  void erase_unused() {
+    std::lock_guard lock(*mutex);
+    for (auto it = cache.begin(); it != cache.end();) {
+      if (it->second.frames_since_last_usage > max_frames) {
+        it = cache.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  void insert(Key const &key, Value val) {
+    size_t hash = std::hash<Key>()(key);
+    std::lock_guard lock(*mutex);
+    cache[hash] = Entry{.data = std::move(val),
+                        .key = key,
+                        .frames_since_last_usage = 0,
+                        .used_this_frame = false};
+  }
+
+  Value *get(Key const &key) {
+    size_t hash = std::hash<Key>()(key);
+    std::lock_guard lock(*mutex);
+    auto it = cache.find(hash);
+    if (it != cache.end()) {
+      it->second.used_this_frame = true;
+      return &it->second.data;
+    } else
+      return nullptr;
+  }
+
+  void next_frame() {
+    std::lock_guard lock(*mutex);
+    for (auto &[key, entry] : cache) {
+      if (!entry.used_this_frame) {
+        entry.frames_since_last_usage += 1;
+      } else {
+        entry.frames_since_last_usage = 0;
+      }
+      entry.used_this_frame = false;
+    }
+  }
+
+private:
+  std::unordered_map<size_t, Entry> cache;
+  std::unique_ptr<std::mutex> mutex;
+
+  uint32_t max_frames = 0;
+};
+
+} // namespace legacy
+
+static constexpr size_t key_count = 16384;
+static constexpr uint32_t lookup_rounds = 50;
+static constexpr uint32_t frame_count = 200;
+// Larger than frame_count, so no entry is evicted during the benchmark.
+static constexpr uint32_t max_frames = 1000;
+
+using clock_type = std::chrono::steady_clock;
+using Value = VkFramebuffer;
+
+template <typename Handle> static Handle fake_handle(uint64_t index) {
+  return reinterpret_cast<Handle>(0x7f0000000000ull + index * 256);
+}
+
+struct FramebufferKeys {
+  std::vector<std::array<VkImageView, 2>> views;
+  std::vector<VkFramebufferCreateInfo> infos;
+};
+
+static void make_framebuffer_keys(FramebufferKeys &keys) {
+  keys.views.resize(key_count);
+  for (size_t i = 0; i < key_count; ++i) {
+    keys.views[i] = {fake_handle<VkImageView>(i),
+                     fake_handle<VkImageView>(key_count + i / 4)};
+    VkFramebufferCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    info.renderPass = fake_handle<VkRenderPass>(2 * key_count + i % 16);
+    info.attachmentCount = 2;
+    info.pAttachments = keys.views[i].data();
+    info.width = 1920;
+    info.height = 1080;
+    info.layers = 1;
+    keys.infos.push_back(info);
+  }
+}
+
+struct CacheResult {
+  double insert_ns = 0.0;
+  double lookup_ns = 0.0;
+  double frame_us = 0.0;
+};
+
+static double elapsed_ns(clock_type::time_point start) {
+  return std::chrono::duration<double, std::nano>(clock_type::now() - start)
+      .count();
+}
+
+// Next frame and eviction differ between the caches, the rest of the
+// interface is the same.
+template <typename CacheType, typename Key, typename EndFrame>
+static CacheResult measure(CacheType &cache, std::vector<Key> const &keys,
+                           EndFrame &&end_frame) {
+  CacheResult result{};
+  clock_type::time_point start = clock_type::now();
+  for (size_t i = 0; i < keys.size(); ++i) {
+    cache.insert(keys[i], fake_handle<Value>(i));
+  }
+  result.insert_ns = elapsed_ns(start) / keys.size();
+
+  size_t found = 0;
+  start = clock_type::now();
+  for (uint32_t round = 0; round < lookup_rounds; ++round) {
+    for (Key const &key : keys) {
+      found += cache.get(key) != nullptr;
+    }
+  }
+  result.lookup_ns =
+      elapsed_ns(start) / (static_cast<double>(lookup_rounds) * keys.size());
+
+  size_t const working_set = keys.size() / 8;
+  start = clock_type::now();
+  for (uint32_t frame = 0; frame < frame_count; ++frame) {
+    for (size_t i = 0; i < working_set; ++i) {
+      found += cache.get(keys[(frame * 97 + i * 8) % keys.size()]) != nullptr;
+    }
+    end_frame(cache);
+  }
+  result.frame_us = elapsed_ns(start) / 1000.0 / frame_count;
+
+  if (found != lookup_rounds * keys.size() + frame_count * working_set) {
+    std::printf("error: lookups missed entries\n");
+  }
+  return result;
+}
+
+template <typename Key>
+static CacheResult measure_legacy(std::vector<Key> const &keys) {
+  legacy::Cache<Key, Value> cache(max_frames);
+  return measure(cache, keys, [](legacy::Cache<Key, Value> &cache) {
+    cache.next_frame();
+    cache.foreach_unused([](Value) {});
+    cache.erase_unused();
+  });
+}
+
+template <typename Key>
+static CacheResult measure_current(std::vector<Key> const &keys) {
+  ph::Cache<Key, Value> cache(max_frames);
+  return measure(cache, keys, [](ph::Cache<Key, Value> &cache) {
+    cache.next_frame();
+    cache.evict_unused([](Value) {});
+  });
+}
+
+static void print_result(char const *keys, char const *cache,
+                         CacheResult const &result) {
+  std::printf("%-12s %-8s insert %8.2f ns   lookup %8.2f ns   frame %8.2f us\n",
+              keys, cache, result.insert_ns, result.lookup_ns,
+              result.frame_us);
+}
+
+int main() {
+  std::vector<ph::ShaderHandle> shader_keys;
+  for (uint32_t i = 0; i < key_count; ++i) {
+    shader_keys.push_back(ph::ShaderHandle{.id = i});
+  }
+  FramebufferKeys framebuffers;
+  make_framebuffer_keys(framebuffers);
+
+  std::printf("%zu keys, working set of %zu keys per frame\n", key_count,
+              key_count / 8);
+  print_result("shader", "legacy", measure_legacy(shader_keys));
+  print_result("shader", "ph", measure_current(shader_keys));
+  print_result("framebuffer", "legacy", measure_legacy(framebuffers.infos));
+  print_result("framebuffer", "ph", measure_current(framebuffers.infos));
+}
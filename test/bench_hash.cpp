@@ -0,0 +1,306 @@
+// Cache key hashing benchmark.
+// Compares the wyhash based hashes in phobos/hash.hpp with the boost-style hash_combine they replaced, on render pass and
+// framebuffer keys like the ones the cache sees. For every key set it reports:
+//  - full collisions: distinct keys with the same 64-bit hash, which cost a key comparison on every lookup.
+//  - bucket collisions: keys that land in an occupied slot of a power of two table at the cache's maximum load of 75%,
+//    which is what the open addressing in ph::Cache probes on.
+//  - throughput: nanoseconds per hashed key.
+// Does not need a GPU.
+
+#include <phobos/hash.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace legacy {
+
+// The hash_combine phobos used before the wyhash based one.
+template <typename T> void hash_combine(size_t &seed, T const &v) {
+  seed ^= std::hash<T>{}(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+template <typename T, typename... Rest>
+void hash_combine(size_t &seed, T const &v, Rest const &...rest) {
+  hash_combine(seed, v);
+  hash_combine(seed, rest...);
+}
+
+size_t hash_handle(void const *handle) {
+  size_t h = 0;
+  hash_combine(h, reinterpret_cast<uint64_t>(handle));
+  return h;
+}
+
+size_t hash_attachment(VkAttachmentDescription const &x) {
+  size_t h = 0;
+  hash_combine(h, x.flags, x.initialLayout, x.finalLayout, x.format, x.loadOp,
+               x.stencilLoadOp, x.storeOp, x.stencilStoreOp, x.samples);
+  return h;
+}
+
+size_t hash_reference(VkAttachmentReference const &x) {
+  size_t h = 0;
+  hash_combine(h, x.attachment, x.layout);
+  return h;
+}
+
+size_t hash_subpass(VkSubpassDescription const &x) {
+  size_t h = 0;
+  for (size_t i = 0; i < x.colorAttachmentCount; ++i) {
+    hash_combine(h, hash_reference(x.pColorAttachments[i]));
+  }
+  if (x.pDepthStencilAttachment) {
+    hash_combine(h, hash_reference(*x.pDepthStencilAttachment));
+  }
+  return h;
+}
+
+size_t hash_render_pass(VkRenderPassCreateInfo const &info) {
+  size_t h = 0;
+  for (size_t i = 0; i < info.attachmentCount; ++i) {
+    hash_combine(h, hash_attachment(info.pAttachments[i]));
+  }
+  for (size_t i = 0; i < info.subpassCount; ++i) {
+    hash_combine(h, hash_subpass(info.pSubpasses[i]));
+  }
+  return h;
+}
+
+size_t hash_framebuffer(VkFramebufferCreateInfo const &info) {
+  size_t h = 0;
+  hash_combine(h, hash_handle(info.renderPass), info.width, info.height,
+               info.layers);
+  for (size_t i = 0; i < info.attachmentCount; ++i) {
+    hash_combine(h, hash_handle(info.pAttachments[i]));
+  }
+  return h;
+}
+
+} // namespace legacy
+
+// Owns the arrays the create infos point to.
+struct RenderPassKeys {
+  std::vector<std::vector<VkAttachmentDescription>> attachments;
+  std::vector<std::vector<VkAttachmentReference>> color_refs;
+  std::vector<VkAttachmentReference> depth_refs;
+  std::vector<VkSubpassDescription> subpasses;
+  std::vector<VkRenderPassCreateInfo> infos;
+};
+
+struct FramebufferKeys {
+  std::vector<std::vector<VkImageView>> views;
+  std::vector<VkFramebufferCreateInfo> infos;
+};
+
+// Handles are usually pointers to driver objects, so they are aligned and
+// close together.
+template <typename Handle> static Handle fake_handle(uint64_t index) {
+  return reinterpret_cast<Handle>(0x7f0000000000ull + index * 256);
+}
+
+// Every combination of formats, load and store ops and sample counts for one to
+// four color attachments, with or without depth.
+static void make_render_pass_keys(RenderPassKeys &keys) {
+  VkFormat const formats[] = {
+      VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_B8G8R8A8_SRGB,
+      VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+  VkAttachmentLoadOp const load_ops[] = {VK_ATTACHMENT_LOAD_OP_LOAD,
+                                         VK_ATTACHMENT_LOAD_OP_CLEAR,
+                                         VK_ATTACHMENT_LOAD_OP_DONT_CARE};
+  VkAttachmentStoreOp const store_ops[] = {VK_ATTACHMENT_STORE_OP_STORE,
+                                           VK_ATTACHMENT_STORE_OP_DONT_CARE};
+  VkSampleCountFlagBits const samples[] = {VK_SAMPLE_COUNT_1_BIT,
+                                           VK_SAMPLE_COUNT_4_BIT};
+
+  std::vector<VkAttachmentDescription> color_states;
+  for (VkFormat format : formats) {
+    for (VkAttachmentLoadOp load : load_ops) {
+      for (VkAttachmentStoreOp store : store_ops) {
+        for (VkSampleCountFlagBits count : samples) {
+          VkAttachmentDescription desc{};
+          desc.format = format;
+          desc.samples = count;
+          desc.loadOp = load;
+          desc.storeOp = store;
+          desc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+          desc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+          desc.initialLayout = load == VK_ATTACHMENT_LOAD_OP_LOAD
+                                   ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                                   : VK_IMAGE_LAYOUT_UNDEFINED;
+          desc.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+          color_states.push_back(desc);
+        }
+      }
+    }
+  }
+  VkAttachmentDescription depth{};
+  depth.format = VK_FORMAT_D32_SFLOAT;
+  depth.samples = VK_SAMPLE_COUNT_1_BIT;
+  depth.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  depth.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depth.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  depth.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depth.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depth.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  // The first attachment takes every state, the others a few, so the key
+  // count stays reasonable.
+  size_t const n = color_states.size();
+  for (uint32_t color_count = 1; color_count <= 4; ++color_count) {
+    size_t const variations = color_count == 1 ? n : n * 8;
+    for (size_t v = 0; v < variations; ++v) {
+      for (bool with_depth : {false, true}) {
+        std::vector<VkAttachmentDescription> attachments;
+        size_t state = v;
+        for (uint32_t i = 0; i < color_count; ++i) {
+          attachments.push_back(color_states[(state + i * 7) % n]);
+          state /= (i == 0 ? n : 8);
+        }
+        if (with_depth) {
+          attachments.push_back(depth);
+        }
+        std::vector<VkAttachmentReference> refs;
+        for (uint32_t i = 0; i < color_count; ++i) {
+          refs.push_back({i, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+        }
+        keys.attachments.push_back(std::move(attachments));
+        keys.color_refs.push_back(std::move(refs));
+        keys.depth_refs.push_back(
+            {color_count, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL});
+      }
+    }
+  }
+
+  // All arrays are filled, so pointers into them stay valid now.
+  for (size_t i = 0; i < keys.attachments.size(); ++i) {
+    bool const with_depth =
+        keys.attachments[i].size() > keys.color_refs[i].size();
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount =
+        static_cast<uint32_t>(keys.color_refs[i].size());
+    subpass.pColorAttachments = keys.color_refs[i].data();
+    subpass.pDepthStencilAttachment =
+        with_depth ? &keys.depth_refs[i] : nullptr;
+    keys.subpasses.push_back(subpass);
+  }
+  for (size_t i = 0; i < keys.attachments.size(); ++i) {
+    VkRenderPassCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    info.attachmentCount = static_cast<uint32_t>(keys.attachments[i].size());
+    info.pAttachments = keys.attachments[i].data();
+    info.subpassCount = 1;
+    info.pSubpasses = &keys.subpasses[i];
+    keys.infos.push_back(info);
+  }
+}
+
+// Framebuffers for a few render passes over a pool of views, at a few sizes.
+static void make_framebuffer_keys(FramebufferKeys &keys) {
+  VkExtent2D const sizes[] = {{1280, 720}, {1920, 1080}, {2560, 1440}};
+  // Reserved up front, so the create infos can point into it.
+  keys.views.reserve(16 * 512 * std::size(sizes));
+  for (uint64_t pass = 0; pass < 16; ++pass) {
+    for (uint64_t view = 0; view < 512; ++view) {
+      for (VkExtent2D size : sizes) {
+        keys.views.push_back({fake_handle<VkImageView>(view),
+                              fake_handle<VkImageView>(1024 + view / 4)});
+        VkFramebufferCreateInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        info.renderPass = fake_handle<VkRenderPass>(4096 + pass);
+        info.attachmentCount = 2;
+        info.pAttachments = keys.views.back().data();
+        info.width = size.width;
+        info.height = size.height;
+        info.layers = 1;
+        keys.infos.push_back(info);
+      }
+    }
+  }
+}
+
+struct HashResult {
+  size_t full_collisions = 0;
+  size_t bucket_collisions = 0;
+  double ns_per_key = 0.0;
+};
+
+template <typename Key, typename Hasher>
+static HashResult measure(std::vector<Key> const &keys, Hasher &&hasher) {
+  HashResult result{};
+  std::vector<size_t> hashes;
+  hashes.reserve(keys.size());
+  for (Key const &key : keys) {
+    hashes.push_back(hasher(key));
+  }
+
+  std::unordered_set<size_t> distinct(hashes.begin(), hashes.end());
+  result.full_collisions = hashes.size() - distinct.size();
+
+  // Same sizing as ph::Cache: a power of two, at most 75% full.
+  size_t slots = 1;
+  while (hashes.size() * 4 > slots * 3) {
+    slots *= 2;
+  }
+  std::vector<bool> occupied(slots);
+  for (size_t hash : hashes) {
+    size_t const slot = hash & (slots - 1);
+    if (occupied[slot]) {
+      result.bucket_collisions += 1;
+    }
+    occupied[slot] = true;
+  }
+
+  constexpr int rounds = 200;
+  size_t sink = 0;
+  auto const start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    for (Key const &key : keys) {
+      sink += hasher(key);
+    }
+  }
+  auto const end = std::chrono::steady_clock::now();
+  result.ns_per_key = std::chrono::duration<double, std::nano>(end - start)
+                          .count() /
+                      (static_cast<double>(rounds) * keys.size());
+  // Keeps the hashing from being optimized out.
+  if (sink == 42) {
+    std::printf(" ");
+  }
+  return result;
+}
+
+static void print_result(char const *keys, char const *hasher, size_t count,
+                         HashResult const &result) {
+  std::printf("%-13s %-8s %7zu keys  full collisions %6zu  bucket "
+              "collisions %6zu (%5.1f%%)  %7.2f ns/key\n",
+              keys, hasher, count, result.full_collisions,
+              result.bucket_collisions,
+              100.0 * static_cast<double>(result.bucket_collisions) / count,
+              result.ns_per_key);
+}
+
+int main() {
+  RenderPassKeys render_passes;
+  make_render_pass_keys(render_passes);
+  FramebufferKeys framebuffers;
+  make_framebuffer_keys(framebuffers);
+
+  size_t const pass_count = render_passes.infos.size();
+  print_result("render pass", "legacy", pass_count,
+               measure(render_passes.infos, legacy::hash_render_pass));
+  print_result("render pass", "wyhash", pass_count,
+               measure(render_passes.infos, std::hash<VkRenderPassCreateInfo>{}));
+
+  size_t const framebuffer_count = framebuffers.infos.size();
+  print_result("framebuffer", "legacy", framebuffer_count,
+               measure(framebuffers.infos, legacy::hash_framebuffer));
+  print_result("framebuffer", "wyhash", framebuffer_count,
+               measure(framebuffers.infos, std::hash<VkFramebufferCreateInfo>{}));
+}
@@ -0,0 +1,111 @@
+// Render graph build benchmark.
+// Builds a 30 pass graph over and over, once with a new graph every time and once with a graph that is kept alive and
+// reset(), so build() can reuse the layouts and barriers of the last build. Only build() is timed, nothing is executed.
+// Uses a headless context, to run it on lavapipe point VK_ICD_FILENAMES at lvp_icd.*.json.
+
+#include <phobos/context.hpp>
+#include <phobos/render_graph.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class StderrLogger : public ph::LogInterface {
+public:
+  void write(ph::LogSeverity sev, std::string_view message) override {
+    if (sev == ph::LogSeverity::Warning || sev == ph::LogSeverity::Error ||
+        sev == ph::LogSeverity::Fatal) {
+      std::cerr << message << std::endl;
+    }
+  }
+};
+
+static constexpr uint32_t pass_count = 30;
+static constexpr uint32_t attachment_count = 8;
+static constexpr uint32_t iterations = 1000;
+
+using clock_type = std::chrono::steady_clock;
+
+static std::string attachment_name(uint32_t index) {
+  return "bench_rt_" + std::to_string(index % attachment_count);
+}
+
+// Every pass renders to one attachment with a shared depth buffer, and samples
+// the attachment of the pass before it, so every pass needs barriers.
+static void add_passes(ph::RenderGraph &graph) {
+  for (uint32_t i = 0; i < pass_count; ++i) {
+    ph::PassBuilder builder =
+        ph::PassBuilder::create("bench_pass_" + std::to_string(i));
+    builder.add_attachment(attachment_name(i), ph::LoadOp::Clear,
+                           {.color = {0.0f, 0.0f, 0.0f, 1.0f}});
+    builder.add_depth_attachment("bench_depth", ph::LoadOp::Clear,
+                                 {.depth_stencil = {1.0f, 0}});
+    if (i > 0) {
+      builder.sample_attachment(attachment_name(i - 1),
+                                ph::PipelineStage::FragmentShader);
+    }
+    graph.add_pass(builder.execute([](ph::CommandBuffer &) {}).get());
+  }
+  graph.export_attachment(attachment_name(pass_count - 1));
+}
+
+int main() {
+  StderrLogger logger;
+  ph::AppSettings config;
+  config.app_name = "Phobos Render Graph Benchmark";
+  config.create_headless = true;
+  config.logger = &logger;
+  config.gpu_requirements.requested_queues = {
+      ph::QueueRequest{.dedicated = false, .type = ph::QueueType::Graphics}};
+  ph::Context ctx(config);
+
+  for (uint32_t i = 0; i < attachment_count; ++i) {
+    ctx.create_attachment(attachment_name(i), {1280, 720},
+                          VK_FORMAT_R8G8B8A8_UNORM,
+                          ph::ImageType::ColorAttachment);
+  }
+  ctx.create_attachment("bench_depth", {1280, 720}, VK_FORMAT_D32_SFLOAT,
+                        ph::ImageType::DepthStencilAttachment);
+
+  // Render passes and framebuffers are cached by the context, so the first
+  // build is left out of both measurements.
+  {
+    ph::RenderGraph warmup;
+    add_passes(warmup);
+    warmup.build(ctx);
+  }
+
+  clock_type::time_point start = clock_type::now();
+  for (uint32_t i = 0; i < iterations; ++i) {
+    ph::RenderGraph graph;
+    add_passes(graph);
+    graph.build(ctx);
+  }
+  double const fresh =
+      std::chrono::duration<double, std::micro>(clock_type::now() - start)
+          .count() /
+      iterations;
+
+  ph::RenderGraph retained;
+  add_passes(retained);
+  retained.build(ctx);
+  start = clock_type::now();
+  for (uint32_t i = 0; i < iterations; ++i) {
+    retained.reset();
+    add_passes(retained);
+    retained.build(ctx);
+  }
+  double const reused =
+      std::chrono::duration<double, std::micro>(clock_type::now() - start)
+          .count() /
+      iterations;
+
+  ph::BarrierStats const stats = retained.get_barrier_stats();
+  std::printf("%u passes, %u barriers, %u barrier calls\n", pass_count,
+              stats.barriers, stats.barrier_calls);
+  std::printf("new graph      %10.2f us per build\n", fresh);
+  std::printf("retained graph %10.2f us per build\n", reused);
+  std::printf("speedup: %.2fx\n", fresh / reused);
+}
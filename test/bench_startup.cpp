@@ -0,0 +1,155 @@
+// Startup benchmark for the on-disk pipeline cache.
+// Measures the time from creating a headless context until every pipeline is compiled, once with an empty pipeline cache
+// and once with the cache written when the first context was destroyed. To run it on lavapipe, point VK_ICD_FILENAMES
+// at lvp_icd.*.json. Must be run from the build directory, so data/shaders/ is found.
+
+#include <phobos/context.hpp>
+#include <phobos/render_graph.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class StderrLogger : public ph::LogInterface {
+public:
+  void write(ph::LogSeverity sev, std::string_view message) override {
+    if (sev == ph::LogSeverity::Warning || sev == ph::LogSeverity::Error ||
+        sev == ph::LogSeverity::Fatal) {
+      std::cerr << message << std::endl;
+    }
+  }
+};
+
+static constexpr const char *cache_path = "bench_startup.cache";
+
+using clock_type = std::chrono::steady_clock;
+
+struct StartupTimes {
+  double create_context = 0.0;
+  double compile = 0.0;
+  double destroy_context = 0.0;
+};
+
+static double ms_since(clock_type::time_point start) {
+  return std::chrono::duration<double, std::milli>(clock_type::now() - start)
+      .count();
+}
+
+// Creates a context, defines every pipeline variant and compiles them all by
+// binding them once.
+static StartupTimes run_startup() {
+  StderrLogger logger;
+  ph::AppSettings config;
+  config.app_name = "Phobos Startup Benchmark";
+  config.create_headless = true;
+  config.logger = &logger;
+  config.gpu_requirements.requested_queues = {
+      ph::QueueRequest{.dedicated = false, .type = ph::QueueType::Graphics}};
+  config.gpu_requirements.features.fillModeNonSolid = true;
+  config.pipeline_cache_path = cache_path;
+  // Compile everything on this thread, so the measured time is the compile time.
+  config.pipeline_compile_threads = 0;
+
+  StartupTimes times{};
+  clock_type::time_point start = clock_type::now();
+  {
+    ph::Context ctx(config);
+    times.create_context = ms_since(start);
+
+    start = clock_type::now();
+    ctx.create_attachment("bench_target", {256, 256},
+                          VK_FORMAT_R8G8B8A8_UNORM,
+                          ph::ImageType::ColorAttachment);
+
+    // Every combination of these states is a different VkPipeline.
+    std::vector<ph::PipelineId> pipelines;
+    VkCullModeFlags const cull_modes[] = {
+        VK_CULL_MODE_NONE, VK_CULL_MODE_FRONT_BIT, VK_CULL_MODE_BACK_BIT};
+    VkPolygonMode const polygon_modes[] = {VK_POLYGON_MODE_FILL,
+                                           VK_POLYGON_MODE_LINE};
+    for (VkCullModeFlags cull : cull_modes) {
+      for (VkPolygonMode polygon : polygon_modes) {
+        for (bool blend : {false, true}) {
+          std::string name = "startup_" + std::to_string(pipelines.size());
+          ph::PipelineCreateInfo pci =
+              ph::PipelineBuilder::create(ctx, name)
+                  .add_shader("data/shaders/read.vert.spv", "main",
+                              ph::ShaderStage::Vertex)
+                  .add_shader("data/shaders/read.frag.spv", "main",
+                              ph::ShaderStage::Fragment)
+                  .add_vertex_input(0)
+                  .add_vertex_attribute(0, 0, VK_FORMAT_R32G32_SFLOAT)
+                  .add_vertex_attribute(0, 1, VK_FORMAT_R32G32_SFLOAT)
+                  .add_dynamic_state(VK_DYNAMIC_STATE_VIEWPORT)
+                  .add_dynamic_state(VK_DYNAMIC_STATE_SCISSOR)
+                  .add_blend_attachment(blend)
+                  .set_polygon_mode(polygon)
+                  .set_cull_mode(cull)
+                  .reflect()
+                  .get();
+          pipelines.push_back(ctx.create_named_pipeline(std::move(pci)));
+        }
+      }
+    }
+    ph::ComputePipelineCreateInfo compute_pci =
+        ph::ComputePipelineBuilder::create(ctx, "startup_compute")
+            .set_shader("data/shaders/compute.comp.spv", "main")
+            .reflect()
+            .get();
+    ph::PipelineId compute = ctx.create_named_pipeline(std::move(compute_pci));
+
+    ph::Pass pass =
+        ph::PassBuilder::create("startup")
+            .add_attachment("bench_target", ph::LoadOp::Clear,
+                            {.color = {0.0f, 0.0f, 0.0f, 1.0f}})
+            .execute([&pipelines](ph::CommandBuffer &cmd_buf) {
+              for (ph::PipelineId id : pipelines) {
+                cmd_buf.bind_pipeline(id);
+              }
+            })
+            .get();
+    ph::RenderGraph graph;
+    graph.add_pass(pass);
+    graph.export_attachment("bench_target");
+    graph.build(ctx);
+
+    [[maybe_unused]] ph::InThreadContext itc = ctx.begin_thread(0);
+    ph::Queue &queue = *ctx.get_queue(ph::QueueType::Graphics);
+    VkFence fence = ctx.create_fence();
+    ph::CommandBuffer cmd_buf = queue.begin_single_time(0);
+    cmd_buf.bind_compute_pipeline(compute);
+    ph::RenderGraphExecutor executor{};
+    executor.execute(cmd_buf, graph);
+    queue.end_single_time(cmd_buf, fence);
+    ctx.wait_for_fence(fence);
+    times.compile = ms_since(start);
+
+    queue.free_single_time(cmd_buf, 0);
+    ctx.destroy_fence(fence);
+    ctx.end_thread(0);
+    ctx.wait_idle();
+    start = clock_type::now();
+  }
+  // Destroying the context writes the pipeline cache.
+  times.destroy_context = ms_since(start);
+  return times;
+}
+
+static void print_times(const char *label, StartupTimes const &times) {
+  std::printf("%-6s context %8.2f ms   pipelines %8.2f ms   shutdown %8.2f ms\n",
+              label, times.create_context, times.compile,
+              times.destroy_context);
+}
+
+int main() {
+  std::filesystem::remove(cache_path);
+  StartupTimes const cold = run_startup();
+  StartupTimes const warm = run_startup();
+
+  print_times("cold", cold);
+  print_times("warm", warm);
+  std::printf("pipeline compile speedup: %.2fx\n", cold.compile / warm.compile);
+}
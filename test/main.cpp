@@ -173,11 +173,14 @@ struct ImageWriteTask : public Task {
     ph::Pass image_write =
         ph::PassBuilder::create_compute("image_write_async")
             .write_storage_image(target_image, ph::PipelineStage::ComputeShader)
-            .execute([this, &itc](ph::CommandBuffer &cmd_buf) {
+            .execute([this, &itc, thread_index](ph::CommandBuffer &cmd_buf) {
               cmd_buf.bind_compute_pipeline("compute_write");
+              // This is waited on with our own fence instead of the frame
+              // fence, so the set must live until end_thread().
               VkDescriptorSet set =
-                  ph::DescriptorBuilder::create(ctx,
-                                                cmd_buf.get_bound_pipeline())
+                  ph::DescriptorBuilder::create(
+                      ctx, cmd_buf.get_bound_pipeline(), 0, thread_index,
+                      ph::DescriptorLifetime::Thread)
                       .add_storage_image("out_img", target_image)
                       .get();
               cmd_buf.bind_descriptor_set(set);
@@ -187,6 +190,8 @@ struct ImageWriteTask : public Task {
             .get();
     ph::RenderGraph graph;
     graph.add_pass(image_write);
+    // The image is used outside of this graph, so the pass must not be culled.
+    graph.export_image(target_image);
     graph.build(ctx);
     ph::RenderGraphExecutor executor{};
 
@@ -239,7 +244,7 @@ int main() {
     ph::Context ctx(config);
     ph::Queue &graphics = *ctx.get_queue(ph::QueueType::Graphics);
 
-    ctx.create_attachment("target", {800, 600}, VK_FORMAT_R8G8B8A8_SRGB);
+    ctx.create_attachment("target", {800, 600}, VK_FORMAT_R8G8B8A8_SRGB, ph::ImageType::ColorAttachment);
 
     // Create pipeline for reading from the buffer and displaying the result
     ph::PipelineCreateInfo read_pci =
@@ -262,13 +267,15 @@ int main() {
     ctx.create_named_pipeline(std::move(read_pci));
 
     TaskScheduler scheduler(ctx.thread_count());
+    // Kept across frames, so the graph is only compiled again when its structure changes.
+    ph::RenderGraph graph{};
 
     while (wsi->is_open()) {
       wsi->poll_events();
       ph::InFlightContext ifc = ctx.wait_for_frame();
 
       scheduler.poll();
-      ph::RenderGraph graph{};
+      graph.reset();
 
       // Buffers for this frame
 
@@ -295,7 +302,7 @@ int main() {
                 cmd_buf.bind_pipeline("read");
                 cmd_buf.auto_viewport_scissor();
 
-                ph::ImageView view = ctx.get_attachment("target")->view;
+                ph::ImageView view = ctx.get_attachment("target").view;
                 VkDescriptorSet set =
                     ph::DescriptorBuilder::create(ctx,
                                                   cmd_buf.get_bound_pipeline())